@@ -0,0 +1,176 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+// Compares the construction time and the traversal cost of the linear BVH
+// with the ones of the compact grid and the SAH-built BVH on the same
+// scene. The scene is either a triangle mesh loaded from an OBJ file or a
+// mesh of randomly placed small triangles.
+//
+// Usage: elucido_lbvh_benchmark [<obj file> | <number of triangles>]
+//                               [<number of threads>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/accelerators/CompactGrid.h"
+#include "../src/accelerators/BVH.h"
+#include "../src/accelerators/LBVH.h"
+#include "../src/objects/TriangleMesh.h"
+#include "../src/core/ThreadPool.h"
+
+namespace {
+const uint32_t kNumberTriangles = 200000; // Of the random mesh.
+const uint32_t kNumberBuilds    = 5;      // The median build time is reported.
+const uint32_t kNumberRays      = 200000;
+
+typedef std::chrono::steady_clock benchmark_clock;
+
+// Creates a mesh of randomly placed small triangles inside [-10, 10]^3.
+std::shared_ptr<TriangleMesh> random_triangle_mesh(const uint32_t &number_triangles) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<float_t> position(-10.f, 10.f);
+  std::uniform_real_distribution<float_t> edge(-0.5f, 0.5f);
+
+  auto mesh = std::make_shared<TriangleMesh>();
+  for (uint32_t t = 0; t < number_triangles; t++) {
+    glm::vec4 v0(position(generator), position(generator), position(generator), 1.f);
+    mesh->va.push_back(v0);
+    for (uint32_t v = 0; v < 2; v++) {
+      mesh->va.push_back(v0 + glm::vec4(edge(generator), edge(generator), edge(generator), 0.f));
+    }
+    for (uint32_t v = 0; v < 3; v++) {
+      mesh->via.push_back(3 * t + v + 1);
+    }
+  }
+  mesh->nt = number_triangles;
+  mesh->apply_transformations();
+  return mesh;
+}
+
+// Rays from points on a sphere around the scene towards points inside the
+// scene's bounding box.
+std::vector<Ray> generate_rays(const AABBox &box) {
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> unit(0.f, 1.f);
+  std::normal_distribution<float_t> normal(0.f, 1.f);
+
+  glm::vec4 center = 0.5f * (box.bounds[0] + box.bounds[1]);
+  glm::vec4 extent = box.bounds[1] - box.bounds[0];
+  float_t radius = glm::length(glm::vec3(extent));
+
+  std::vector<Ray> rays(kNumberRays);
+  for (auto &ray : rays) {
+    glm::vec4 d(normal(generator), normal(generator), normal(generator), 0.f);
+    glm::vec4 o = center + radius * glm::normalize(d);
+    glm::vec4 p(box.bounds[0].x + unit(generator) * extent.x,
+                box.bounds[0].y + unit(generator) * extent.y,
+                box.bounds[0].z + unit(generator) * extent.z,
+                1.f);
+    o.w = 1.f;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(p - o));
+  }
+  return rays;
+}
+
+struct benchmark_result {
+  double    bt{0.};   // Median build time in ms.
+  double    rps{0.};  // Traced rays per second.
+  double    npt{0.};  // Ray-primitive intersection tests per ray.
+  uint32_t  nh{0};    // Number of rays hitting the scene.
+};
+
+benchmark_result run(AccelerationStructure &as,
+                     const std::vector<std::shared_ptr<Object>> &objects,
+                     const AABBox &box,
+                     const uint32_t &number_primitives,
+                     const std::vector<Ray> &rays) {
+  benchmark_result result;
+
+  std::vector<double> build_times;
+  for (uint32_t b = 0; b < kNumberBuilds; b++) {
+    auto ci = as_construct_info();
+    auto start = benchmark_clock::now();
+    as.construct(box, objects, number_primitives, ci);
+    std::chrono::duration<double, std::milli> d = benchmark_clock::now() - start;
+    build_times.push_back(d.count());
+  }
+  std::sort(build_times.begin(), build_times.end());
+  result.bt = build_times[kNumberBuilds / 2];
+
+  traversal_info ti;
+  auto start = benchmark_clock::now();
+  for (auto const &ray : rays) {
+    hit_record hr;
+    if (as.closest_hit(ray, hr, ti)) result.nh++;
+  }
+  std::chrono::duration<double> d = benchmark_clock::now() - start;
+  result.rps = rays.size() / d.count();
+  result.npt = static_cast<double>(ti.nrpt) / rays.size();
+  return result;
+}
+}
+
+//==============================================================================
+int main(int argc, char **argv) {
+  std::shared_ptr<TriangleMesh> mesh;
+  uint32_t number_threads{0};
+
+  if (argc > 1 && std::string(argv[1]).find(".obj") != std::string::npos) {
+    mesh = std::make_shared<TriangleMesh>();
+    if (!mesh->load_mesh(argv[1]).l) {
+      std::cout << "Couldn't load the mesh " << argv[1] << "." << std::endl;
+      return 1;
+    }
+    mesh->apply_transformations();
+  } else {
+    uint32_t nt = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : kNumberTriangles;
+    mesh = random_triangle_mesh(nt);
+  }
+  if (argc > 2) number_threads = static_cast<uint32_t>(std::atoi(argv[2]));
+
+  std::vector<std::shared_ptr<Object>> objects = {mesh};
+  AABBox box = mesh->bounding_box();
+  auto rays = generate_rays(box);
+  auto pool = std::make_shared<ThreadPool>(number_threads);
+
+  std::cout << "# of triangles:\t\t" << mesh->nt << std::endl;
+  std::cout << "# of threads:\t\t" << pool->size() << std::endl;
+  std::cout << "# of rays:\t\t\t" << rays.size() << std::endl;
+#ifndef ELUCIDO_RENDER_STATISTICS
+  std::cout << "Render statistics are disabled; intersection tests are not counted."
+            << std::endl;
+#endif
+  std::cout << std::endl;
+
+  std::vector<std::pair<std::string, std::shared_ptr<AccelerationStructure>>> structures;
+  structures.emplace_back("compact_grid", std::make_shared<CompactGrid>());
+  structures.emplace_back("bvh", std::make_shared<BVH>());
+  structures.emplace_back("lbvh", std::make_shared<LBVH>());
+
+  std::cout << std::left
+            << std::setw(16) << "structure"
+            << std::setw(16) << "build [ms]"
+            << std::setw(16) << "Mrays/s"
+            << std::setw(16) << "tests/ray"
+            << "hits" << std::endl;
+
+  for (auto const &s : structures) {
+    s.second->set_thread_pool(pool);
+    auto r = run(*s.second, objects, box, mesh->nt, rays);
+    std::cout << std::left << std::fixed << std::setprecision(2)
+              << std::setw(16) << s.first
+              << std::setw(16) << r.bt
+              << std::setw(16) << r.rps * 1e-6
+              << std::setw(16) << r.npt
+              << r.nh << std::endl;
+  }
+  return 0;
+}
@@ -2,6 +2,10 @@
 // Author: Haralambi Todorov <harrytodorov@gmail.com>
 
 #include "AABBox.h"
+
+#include <algorithm>
+#include <glm/geometric.hpp>
+
 #include "../core/Ray.h"
 
 //==============================================================================
@@ -17,6 +21,19 @@ void AABBox::extend_by(const glm::vec4 &p) {
   if (p.z > bounds[1].z) bounds[1].z = p.z;
 }
 
+//==============================================================================
+AABBox AABBox::transformed(const glm::mat4 &m) const {
+  AABBox result;
+  for (uint32_t c = 0; c < 8; c++) {
+    glm::vec4 corner(bounds[(c & 1) ? 1 : 0].x,
+                     bounds[(c & 2) ? 1 : 0].y,
+                     bounds[(c & 4) ? 1 : 0].z,
+                     1.f);
+    result.extend_by(m * corner);
+  }
+  return result;
+}
+
 //==============================================================================
 bool AABBox::intersect(const Ray &r) const {
   float_t tmin, tmax, tymin, tymax, tzmin, tzmax;
@@ -72,4 +89,41 @@ bool AABBox::intersect(const Ray &r, float_t &t_min) const {
 
   t_min = tmin;
   return true;
-}
\ No newline at end of file
+}
+
+//==============================================================================
+bool AABBox::overlaps_triangle(const glm::vec4 &v0,
+                               const glm::vec4 &v1,
+                               const glm::vec4 &v2) const {
+  // Move the box into the origin.
+  glm::vec3 center = 0.5f * glm::vec3(bounds[0] + bounds[1]);
+  glm::vec3 h      = 0.5f * glm::vec3(bounds[1] - bounds[0]);
+  glm::vec3 v[3]   = {glm::vec3(v0) - center,
+                      glm::vec3(v1) - center,
+                      glm::vec3(v2) - center};
+  glm::vec3 e[3]   = {v[1] - v[0], v[2] - v[1], v[0] - v[2]};
+
+  // The face normals of the box.
+  for (uint32_t a = 0; a < 3; a++) {
+    if (std::min({v[0][a], v[1][a], v[2][a]}) > h[a] ||
+        std::max({v[0][a], v[1][a], v[2][a]}) < -h[a]) return false;
+  }
+
+  // The cross products of the box's axes and the triangle's edges.
+  for (uint32_t a = 0; a < 3; a++) {
+    glm::vec3 unit(0.f);
+    unit[a] = 1.f;
+    for (uint32_t j = 0; j < 3; j++) {
+      glm::vec3 axis = glm::cross(unit, e[j]);
+      float_t p0 = glm::dot(v[0], axis);
+      float_t p1 = glm::dot(v[1], axis);
+      float_t p2 = glm::dot(v[2], axis);
+      float_t r  = glm::dot(h, glm::abs(axis));
+      if (std::min({p0, p1, p2}) > r || std::max({p0, p1, p2}) < -r) return false;
+    }
+  }
+
+  // The triangle's normal.
+  glm::vec3 n = glm::cross(e[0], e[1]);
+  return std::abs(glm::dot(n, v[0])) <= glm::dot(h, glm::abs(n));
+}
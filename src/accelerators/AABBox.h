@@ -4,6 +4,7 @@
 #ifndef ELUCIDO_BBOX_H
 #define ELUCIDO_BBOX_H
 
+#include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
 #include "../core/Utilities.h"
@@ -42,6 +43,16 @@ class AABBox {
     float_t base = diagonal.x * diagonal.y;
     return base * diagonal.z;
   }
+  /**
+   * Computes the area of the six faces of the box, as used by the surface
+   * area heuristic.
+   */
+  inline float_t getSurfaceArea() const {
+    glm::vec4 diagonal = getDiagonal();
+    return 2.f * (diagonal.x * diagonal.y +
+                  diagonal.y * diagonal.z +
+                  diagonal.z * diagonal.x);
+  }
   inline Axis longestAxis() const {
     glm::vec4 diagonal = getDiagonal();
     if (diagonal.x >= diagonal.y) {
@@ -56,6 +67,22 @@ class AABBox {
   bool intersect(const Ray &r, float_t &t_min) const;
   void extend_by(const glm::vec4 &p);
 
+  /**
+   * Computes the bounding box of the box's corners transformed by m.
+   */
+  AABBox transformed(const glm::mat4 &m) const;
+
+  /**
+   * Checks if the triangle (v0, v1, v2) overlaps the box with the separating
+   * axis theorem: the triangle and the box are disjoint, if their
+   * projections onto one of the box's face normals, the triangle's normal
+   * or the cross products of their edges don't overlap.
+   * @return: True, if the triangle overlaps the box.
+   */
+  bool overlaps_triangle(const glm::vec4 &v0,
+                         const glm::vec4 &v1,
+                         const glm::vec4 &v2) const;
+
 //==============================================================================
 // Data members
 //==============================================================================
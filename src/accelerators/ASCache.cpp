@@ -0,0 +1,91 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "ASCache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+inline uint64_t align(const uint64_t &o) {
+  return (o + kASCacheAlignment - 1) / kASCacheAlignment * kASCacheAlignment;
+}
+}
+
+//==============================================================================
+bool ASCacheWriter::write(const std::string &f,
+                          const uint32_t &type,
+                          const uint64_t &key) const {
+  as_cache_header h;
+  std::memcpy(h.magic, kASCacheMagic, sizeof(h.magic));
+  h.version = kASCacheVersion;
+  h.type    = type;
+  h.key     = key;
+  h.ns      = sections.size();
+
+  std::vector<as_cache_section> table(sections.size());
+  uint64_t o = sizeof(h) + table.size() * sizeof(as_cache_section);
+  for (size_t i = 0; i < sections.size(); i++) {
+    table[i].o = align(o);
+    table[i].s = sections[i].second;
+    o = table[i].o + table[i].s;
+  }
+
+  static std::atomic<uint32_t> counter(0);
+  std::string tf = f + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+  {
+    std::ofstream fs(tf, std::ios::binary | std::ios::trunc);
+    if (!fs.good()) return false;
+
+    const char zeros[kASCacheAlignment] = {};
+    fs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    fs.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(as_cache_section));
+    for (size_t i = 0; i < sections.size(); i++) {
+      fs.write(zeros, table[i].o - static_cast<uint64_t>(fs.tellp()));
+      fs.write(sections[i].first, sections[i].second);
+    }
+    if (!fs.good()) {
+      fs.close();
+      std::remove(tf.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(tf.c_str(), f.c_str()) != 0) {
+    std::remove(tf.c_str());
+    return false;
+  }
+  return true;
+}
+
+//==============================================================================
+bool ASCacheReader::open(const std::string &f,
+                         const uint32_t &type,
+                         const uint64_t &key) {
+  // The mapping is writable, so that a structure can be modified in place,
+  // e.g. when it's refitted; the file itself never changes.
+  auto m = std::make_shared<MappedFile>();
+  if (!m->open(f.c_str(), true, false) || m->size() < sizeof(as_cache_header)) return false;
+
+  as_cache_header h;
+  std::memcpy(&h, m->data(), sizeof(h));
+  if (std::memcmp(h.magic, kASCacheMagic, sizeof(h.magic)) != 0 ||
+      h.version != kASCacheVersion ||
+      h.type != type ||
+      h.key != key ||
+      h.ns > (m->size() - sizeof(h)) / sizeof(as_cache_section)) {
+    return false;
+  }
+
+  std::vector<as_cache_section> t(h.ns);
+  std::memcpy(t.data(), m->data() + sizeof(h), t.size() * sizeof(as_cache_section));
+  for (auto const &s : t) {
+    if (s.o % kASCacheAlignment != 0 || s.o > m->size() || s.s > m->size() - s.o) return false;
+  }
+
+  mf = m;
+  table.swap(t);
+  return true;
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_ASCACHE_H
+#define ELUCIDO_ASCACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../core/Buffer.h"
+#include "../core/MappedFile.h"
+
+// Acceleration structure cache files are named after their entry and the
+// structure's type with this extension.
+const char kASCacheExtension[] = ".eac";
+const char kASCacheMagic[8] = {'E', 'L', 'U', 'A', 'C', 'C', 'S', '\0'};
+const uint32_t kASCacheVersion = 1;
+const uint64_t kASCacheAlignment = 64;   // Of the sections in the file.
+
+/**
+ * Header of an acceleration structure cache file. It's followed by a table
+ * with the offset and the size of every section; the sections hold the
+ * arrays of the built structure in its in-memory layout.
+ */
+struct as_cache_header {
+  char      magic[8];     // kASCacheMagic.
+  uint32_t  version{0};   // kASCacheVersion.
+  uint32_t  type{0};      // Type of the acceleration structure.
+  uint64_t  key{0};       // Hash of the geometry and the build parameters.
+  uint64_t  ns{0};        // Number of sections.
+};
+
+struct as_cache_section {
+  uint64_t  o{0};   // Offset of the section in the file.
+  uint64_t  s{0};   // Size of the section in bytes.
+};
+
+/**
+ * Incremental 64-bit hash of 32-bit words; used to identify the geometry
+ * and the build parameters of an acceleration structure.
+ */
+class Hash64 {
+ public:
+  explicit Hash64(const uint64_t &seed = 0x9e3779b97f4a7c15ull) : h(seed) {}
+
+  inline void add(const uint32_t &w) {
+    h = (h ^ w) * 0x100000001b3ull;
+    h ^= h >> 29;
+  }
+  inline void add(const uint64_t &w) {
+    add(static_cast<uint32_t>(w));
+    add(static_cast<uint32_t>(w >> 32));
+  }
+  inline void add(const float &f) {
+    uint32_t w;
+    std::memcpy(&w, &f, sizeof(w));
+    add(w);
+  }
+
+  // Finalizes the hash, so that every input bit affects every output bit.
+  inline uint64_t value() const {
+    uint64_t z = h;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+ private:
+  uint64_t h;
+};
+
+/**
+ * Collects the sections of a built acceleration structure and writes them
+ * into a cache file.
+ */
+class ASCacheWriter {
+ public:
+  /**
+   * Adds a section; the data has to stay valid until write() is called.
+   */
+  template <typename T>
+  inline void add(const T *data, const size_t &n) {
+    sections.emplace_back(reinterpret_cast<const char *>(data), n * sizeof(T));
+  }
+
+  /**
+   * Writes the sections into the file f. The file is written under a
+   * temporary name first and renamed, so that an incomplete cache is never
+   * read.
+   * @return: False, if the file couldn't be written.
+   */
+  bool write(const std::string &f, const uint32_t &type, const uint64_t &key) const;
+
+ private:
+  std::vector<std::pair<const char *, size_t>> sections;
+};
+
+/**
+ * Maps a cache file into memory and gives access to its sections without
+ * copying them.
+ */
+class ASCacheReader {
+ public:
+  /**
+   * Maps the file f, if it's a cache of the given type and key.
+   */
+  bool open(const std::string &f, const uint32_t &type, const uint64_t &key);
+
+  inline size_t number_sections() const { return table.size(); }
+
+  /**
+   * Makes the buffer b a view of the section i.
+   * @return: False, if the section doesn't exist or doesn't hold a whole
+   *          number of elements.
+   */
+  template <typename T>
+  inline bool view(const size_t &i, Buffer<T> &b) const {
+    if (i >= table.size() || table[i].s % sizeof(T) != 0) return false;
+    b.view(reinterpret_cast<T *>(mf->data() + table[i].o), table[i].s / sizeof(T), mf);
+    return true;
+  }
+
+  /**
+   * Reads the section i into the single value v.
+   */
+  template <typename T>
+  inline bool read(const size_t &i, T &v) const {
+    if (i >= table.size() || table[i].s != sizeof(T)) return false;
+    std::memcpy(&v, mf->data() + table[i].o, sizeof(T));
+    return true;
+  }
+
+ private:
+  std::shared_ptr<MappedFile>   mf;
+  std::vector<as_cache_section> table;
+};
+
+#endif //ELUCIDO_ASCACHE_H
@@ -3,23 +3,241 @@
 
 #include "AccelerationStructure.h"
 
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "ASCache.h"
+
+namespace {
+const uint32_t kCacheHashBlock = 1 << 16;  // Primitives hashed per block.
+
+// Processor time consumed by the calling thread in ns.
+uint64_t thread_time() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+}
+
 //==============================================================================
-std::vector<Primitive> AccelerationStructure::convert_to_primitive(
-    const std::shared_ptr<Object> &obj) const {
-  std::vector<Primitive> result;
+std::vector<PrimitiveRef> AccelerationStructure::convert_to_primitive(
+    const std::shared_ptr<Object> &obj,
+    const uint32_t &oi) const {
+  std::vector<PrimitiveRef> result;
 
   // If the object is not a triangle mesh, it's already a primitive.
   if (obj->object_type() != triangle_mesh) {
-    result.emplace_back(obj, 0);
+    result.emplace_back(obj->object_type(), oi, 0);
     return result;
   }
 
   // The object is a triangle mesh. Iterate over its triangles and pack
   // them in a vector of primitives.
   auto mesh = std::static_pointer_cast<TriangleMesh>(obj);
-  for (size_t i = 0; i < mesh->nt; i++) {
-    result.emplace_back(obj, i);
+  result.reserve(mesh->nt);
+  for (uint32_t i = 0; i < mesh->nt; i++) {
+    result.emplace_back(triangle_mesh, oi, i);
   }
 
   return result;
 }
+
+//==============================================================================
+bool AccelerationStructure::traverse(const Ray &r,
+                                     isect_info &ii,
+                                     const uint32_t &worker) const {
+  hit_record hr;
+  traversal_info ti;
+  ti.w = worker;
+
+  // Reset the intersection information.
+  ii = isect_info();
+  bool intersected = closest_hit(r, hr, ti);
+  ii.nrpt = ti.nrpt;
+  ii.nmt  = ti.nmt;
+  ii.nds  = ti.nds;
+
+  if (intersected) finalize(r, hr, ii);
+  return intersected;
+}
+
+//==============================================================================
+void AccelerationStructure::finalize(const Ray &r,
+                                     const hit_record &hr,
+                                     isect_info &ii) const {
+  const Object *o = object_table[hr.p.oi].get();
+
+  switch (hr.p.type()) {
+    case sphere:
+      static_cast<const Sphere *>(o)->hit_info(r, hr.t, ii);
+      break;
+    case triangle:
+      static_cast<const Triangle *>(o)->hit_info(r, hr.t, hr.u, hr.v, hr.fp, ii);
+      break;
+    case triangle_mesh:
+      static_cast<const TriangleMesh *>(o)->hit_info(r, hr.p.ti, hr.t, hr.u,
+                                                     hr.v, hr.fp, ii);
+      break;
+    default:
+      return;
+  }
+
+  ii.ho = object_table[hr.p.oi];
+}
+
+//==============================================================================
+void AccelerationStructure::start_construction() {
+  cs  = std::chrono::high_resolution_clock::now();
+  cst = thread_time();
+  cw  = 0;
+}
+
+//==============================================================================
+void AccelerationStructure::finish_construction(as_construct_info &info) {
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::high_resolution_clock::now() - cs).count();
+  uint64_t work = thread_time() - cst + cw;
+
+  info.nt = number_workers();
+  info.su = 1.f;
+  if (elapsed > 0 && thread_pool != nullptr) {
+    info.su = static_cast<float_t>(work) / elapsed;
+  }
+}
+
+//==============================================================================
+void AccelerationStructure::submit_construction_task(
+    const std::function<void()> &task) {
+  if (thread_pool == nullptr) {
+    task();
+    return;
+  }
+
+  thread_pool->submit([this, task](const uint32_t &) {
+    uint64_t s = thread_time();
+    task();
+    cw += thread_time() - s;
+  });
+}
+
+//==============================================================================
+void AccelerationStructure::wait_construction_tasks() {
+  if (thread_pool != nullptr) thread_pool->wait();
+}
+
+//==============================================================================
+void AccelerationStructure::parallel_for(
+    const uint32_t &n,
+    const std::function<void(const uint32_t &chunk,
+                             const uint32_t &begin,
+                             const uint32_t &end)> &f) {
+  uint32_t nc = number_workers();
+  for (uint32_t c = 0; c < nc; c++) {
+    uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(n) * c / nc);
+    uint32_t end   = static_cast<uint32_t>(static_cast<uint64_t>(n) * (c + 1) / nc);
+    submit_construction_task([&f, c, begin, end]() { f(c, begin, end); });
+  }
+  wait_construction_tasks();
+}
+
+//==============================================================================
+void AccelerationStructure::fill_triangle_buffer(const uint32_t *order,
+                                                 const uint32_t &n) {
+  triangles.resize(n);
+  parallel_for(n, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) set_triangle(primitives[order[i]], i);
+  });
+}
+
+//==============================================================================
+uint64_t AccelerationStructure::cache_key(const std::vector<float_t> &parameters) {
+  // The primitives are hashed in blocks of a fixed size, so that the key
+  // doesn't depend on the number of workers.
+  auto np = static_cast<uint32_t>(primitives.size());
+  uint32_t number_blocks = (np + kCacheHashBlock - 1) / kCacheHashBlock;
+  std::vector<uint64_t> block_hashes(number_blocks);
+  parallel_for(number_blocks, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    glm::vec4 v0, v1, v2;
+    for (uint32_t bi = b; bi < e; bi++) {
+      Hash64 h;
+      uint32_t end = std::min(np, (bi + 1) * kCacheHashBlock);
+      for (uint32_t i = bi * kCacheHashBlock; i < end; i++) {
+        h.add(static_cast<uint32_t>(primitives[i].type()));
+        if (primitive_triangle(primitives[i], v0, v1, v2)) {
+          for (uint32_t a = 0; a < 3; a++) {
+            h.add(v0[a]);
+            h.add(v1[a]);
+            h.add(v2[a]);
+          }
+        } else {
+          AABBox pb = primitive_box(primitives[i]);
+          for (uint32_t a = 0; a < 3; a++) {
+            h.add(pb.bounds[0][a]);
+            h.add(pb.bounds[1][a]);
+          }
+        }
+      }
+      block_hashes[bi] = h.value();
+    }
+  });
+
+  Hash64 h;
+  h.add(kASCacheVersion);
+  h.add(static_cast<uint32_t>(as_type));
+  h.add(static_cast<uint32_t>(parameters.size()));
+  for (auto const &p : parameters) h.add(p);
+  for (uint32_t a = 0; a < 3; a++) {
+    h.add(bbox.bounds[0][a]);
+    h.add(bbox.bounds[1][a]);
+  }
+  h.add(np);
+  for (auto const &bh : block_hashes) h.add(bh);
+  return h.value();
+}
+
+//==============================================================================
+bool AccelerationStructure::update_cached(const std::string &directory,
+                                          const std::string &entry,
+                                          const AABBox &box,
+                                          const std::vector<std::shared_ptr<Object>> &objects,
+                                          const uint32_t &number_primitives,
+                                          as_construct_info &info) {
+  std::vector<float_t> parameters;
+  if (directory.empty() || !cache_parameters(parameters)) {
+    update(box, objects, number_primitives, info);
+    return false;
+  }
+
+  start_construction();
+  compute_primitives(number_primitives, objects);
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  // The key is stored in the file; a file of another geometry or other
+  // build parameters is replaced.
+  uint64_t key = cache_key(parameters);
+  std::ostringstream name;
+  name << directory << "/" << entry << "_" << static_cast<uint32_t>(as_type)
+       << kASCacheExtension;
+
+  ASCacheReader r;
+  if (r.open(name.str(), as_type, key) && read_cache(r, info)) {
+    finish_construction(info);
+    info.c = true;
+    return true;
+  }
+
+  // The construction reuses the primitives computed for the key.
+  primitives_computed = true;
+  update(box, objects, number_primitives, info);
+  primitives_computed = false;
+
+  // The cache is an optimization; failing to write it isn't an error.
+  mkdir(directory.c_str(), 0755);
+  ASCacheWriter w;
+  write_cache(w);
+  w.write(name.str(), as_type, key);
+  return false;
+}
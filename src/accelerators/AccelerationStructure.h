@@ -4,49 +4,75 @@
 #ifndef ELUCIDO_ACCELERATIONSTRUCTURE_H
 #define ELUCIDO_ACCELERATIONSTRUCTURE_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+
 #include "../objects/Object.h"
+#include "../objects/Sphere.h"
+#include "../objects/Triangle.h"
 #include "../objects/TriangleMesh.h"
+#include "../core/Common.h"
+#include "../core/ThreadPool.h"
+#include "../core/TriangleBuffer.h"
+
+class ASCacheWriter;
+class ASCacheReader;
 
-struct Primitive {
+/**
+ * Reference to a primitive of an acceleration structure, i.e. a sphere, a
+ * triangle or a single triangle of a triangle mesh. The object is referred
+ * to by its index in the acceleration structure's object table.
+ */
+struct PrimitiveRef {
 //==============================================================================
 // Constructors & destructors.
 //==============================================================================
-  Primitive() {}
-  Primitive(const std::shared_ptr<Object> &_obj, const uint32_t &ti) :
-      obj(_obj),
-      tri_ind(ti)
+  PrimitiveRef() : ti(0), oi(0), ot(not_set_ot) {}
+  PrimitiveRef(const ObjectType &type,
+               const uint32_t &object_index,
+               const uint32_t &triangle_index) :
+      ti(triangle_index),
+      oi(object_index),
+      ot(type)
   {}
 
-  ~Primitive() {}
-
 //==============================================================================
 // Function declarations
 //==============================================================================
-  bool intersect(const Ray &r, isect_info &ii) const {
-    if (obj->object_type() == triangle_mesh) {
-      return std::static_pointer_cast<TriangleMesh>(obj)->intersect_triangle(r,
-                                                                             tri_ind,
-                                                                             ii);
-    }
-    return obj->intersect(r, ii);
-  }
-
-  const AABBox & getBB() const {
-    if (obj->object_type() != triangle_mesh) {
-      return obj->bounding_box();
-    }
-    return std::static_pointer_cast<TriangleMesh>(obj)->get_BB(tri_ind);
-  }
+  inline ObjectType type() const { return static_cast<ObjectType>(ot); }
 
-  glm::vec4 centroid() const {
-    return obj->centroid(tri_ind);
-  }
+  /**
+   * Only triangles of triangle meshes are stored in triangle buffers; all
+   * other primitives are intersected one by one.
+   */
+  inline bool in_triangle_buffer() const { return ot == triangle_mesh; }
 
 //==============================================================================
 // Data members
 //==============================================================================
-  std::shared_ptr<Object> obj;
-  uint32_t                tri_ind;
+  uint32_t  ti;       // Index of the triangle in a triangle mesh.
+  uint32_t  oi : 28;  // Index of the object in the object table.
+  uint32_t  ot : 4;   // Type of the object.
+};
+
+static_assert(sizeof(PrimitiveRef) == 8, "PrimitiveRef should be 8 bytes large.");
+
+/**
+ * The closest intersection found so far while traversing an acceleration
+ * structure. It holds only what is needed to continue the traversal; the
+ * intersection point, its normal and the intersected object are computed
+ * once for the final hit by AccelerationStructure::finalize.
+ */
+struct hit_record {
+  float_t       t{infinity};  // Distance from the ray's origin to the
+                              // intersection point.
+  float_t       u{0.f};       // Barycentric coordinate u of a triangle.
+  float_t       v{0.f};       // Barycentric coordinate v of a triangle.
+  PrimitiveRef  p{};          // The intersected primitive.
+  bool          fp{false};    // Flip normal.
+
+  inline bool hit() const { return p.type() != not_set_ot; }
 };
 
 class AccelerationStructure {
@@ -65,10 +91,12 @@ class AccelerationStructure {
    * Converts an object (sphere, triangle or triangle mesh) into a vector
    * of primitives. Primitives vector is emptied before filling.
    * @param obj:    The object to be converted.
+   * @param oi:     The index of the object in the object table.
    * @return:       The compound primitives of the object.
    */
-  std::vector<Primitive> convert_to_primitive(const std::shared_ptr<Object> &obj) const;
-  inline const std::vector<Primitive> & get_primitives() const {
+  std::vector<PrimitiveRef> convert_to_primitive(const std::shared_ptr<Object> &obj,
+                                                 const uint32_t &oi = 0) const;
+  inline const std::vector<PrimitiveRef> & get_primitives() const {
     return primitives;
   };
   inline void compute_primitives(const uint32_t &number_primitives,
@@ -76,8 +104,12 @@ class AccelerationStructure {
     // Clear existing primitives.
     if (!primitives.empty()) primitives.clear();
     primitives.reserve(number_primitives);
-    for (auto const &object : objects) {
-      std::vector<Primitive> toPrimitive = convert_to_primitive(object);
+    object_table = objects;
+    scalar_primitives = false;
+    for (uint32_t oi = 0; oi < objects.size(); oi++) {
+      if (objects[oi]->object_type() != triangle_mesh) scalar_primitives = true;
+
+      std::vector<PrimitiveRef> toPrimitive = convert_to_primitive(objects[oi], oi);
       primitives.insert(primitives.end(),
                         toPrimitive.begin(),
                         toPrimitive.end());
@@ -86,19 +118,343 @@ class AccelerationStructure {
 
   inline const AccelerationStructureType & get_type() const { return as_type; }
 
-  virtual bool traverse(const Ray &r, isect_info &i) const = 0;
+  /**
+   * Sets the thread pool used for the construction. Without a thread pool
+   * the acceleration structure is constructed on the calling thread. Only
+   * the pool's workers, or a single thread without a pool, may traverse the
+   * structure concurrently.
+   */
+  inline void set_thread_pool(const std::shared_ptr<ThreadPool> &tp) {
+    thread_pool = tp;
+  }
+  inline const std::shared_ptr<ThreadPool> & get_thread_pool() const { return thread_pool; }
+
+  /**
+   * Finds the closest intersection of the ray with the primitives and
+   * computes the complete intersection information for it.
+   * @param r:      The ray to be traced through the acceleration structure.
+   * @param ii:     The intersection information of the closest
+   *                intersection; nrpt and nmt contain the statistics of the
+   *                traversal.
+   * @param worker: The index of the worker tracing the ray.
+   * @return:       True if the ray intersects any primitive, false
+   *                otherwise.
+   */
+  bool traverse(const Ray &r, isect_info &ii, const uint32_t &worker = 0) const;
+
+  /**
+   * Finds the closest intersection of the ray with the primitives. Only
+   * the hit record is updated during the traversal.
+   * @param r:  The ray to be traced through the acceleration structure.
+   * @param hr: The closest intersection.
+   * @param ti: Statistics gathered during the traversal.
+   * @return:   True if the ray intersects any primitive, false otherwise.
+   */
+  virtual bool closest_hit(const Ray &r,
+                           hit_record &hr,
+                           traversal_info &ti) const = 0;
+
+  /**
+   * Computes the intersection point, its normal and the intersected object
+   * for a hit record found by closest_hit.
+   */
+  void finalize(const Ray &r, const hit_record &hr, isect_info &ii) const;
+
+  /**
+   * Determines if any primitive blocks the ray before the distance t_max.
+   * The traversal stops at the first such primitive, thus it's meant to be
+   * used for shadow rays, where the closest intersection is not needed.
+   * @param r:      The ray to be traced through the acceleration structure.
+   * @param t_max:  The maximal distance from the ray's origin, up to which
+   *                an intersection is considered, e.g. the distance to a
+   *                light source.
+   * @param ti:     Statistics gathered during the traversal.
+   * @return:       True if the ray is blocked before t_max, false otherwise.
+   */
+  virtual bool occluded(const Ray &r,
+                        const float_t &t_max,
+                        traversal_info &ti) const = 0;
+
   virtual void construct(const AABBox &box,
                          const std::vector<std::shared_ptr<Object>> &objects,
                          const uint32_t &number_primitives,
                          as_construct_info &info) = 0;
 
+  /**
+   * Brings the acceleration structure up to date after the objects were
+   * transformed, e.g. between the frames of an animation. By default, the
+   * structure is constructed from scratch.
+   */
+  virtual void update(const AABBox &box,
+                      const std::vector<std::shared_ptr<Object>> &objects,
+                      const uint32_t &number_primitives,
+                      as_construct_info &info) {
+    construct(box, objects, number_primitives, info);
+  }
+
+  /**
+   * Loads the acceleration structure from the cache file of an entry in
+   * the directory, if the file holds the structure for the same geometry
+   * and build parameters; otherwise the structure is updated and replaces
+   * the file. Every entry keeps a single file per structure type, so the
+   * directory doesn't grow, when the geometry changes. Structures, which
+   * can't be cached, are just updated.
+   * @param directory:  The cache directory; created, if it doesn't exist.
+   * @param entry:      The name of the entry, e.g. the scene's name.
+   * @return:           True, if the structure was loaded from the cache.
+   */
+  bool update_cached(const std::string &directory,
+                     const std::string &entry,
+                     const AABBox &box,
+                     const std::vector<std::shared_ptr<Object>> &objects,
+                     const uint32_t &number_primitives,
+                     as_construct_info &info);
+
+  /**
+   * Appends the build parameters, which determine the built structure, to
+   * p. Returns false, if the structure can't be cached.
+   */
+  virtual bool cache_parameters(std::vector<float_t> &/*p*/) const { return false; }
+
+  /**
+   * Adds the arrays of the built structure as sections to the writer.
+   */
+  virtual void write_cache(ASCacheWriter &/*w*/) const {}
+
+  /**
+   * Restores the structure from the sections of a cache file; the
+   * primitives and the bounding box are already set.
+   * @return: False, if the sections don't fit the structure.
+   */
+  virtual bool read_cache(const ASCacheReader &/*r*/, as_construct_info &/*info*/) { return false; }
+
+
+ protected:
+  /**
+   * Intersects the ray with the primitive p. The intersection routine is
+   * chosen by the primitive's type without a virtual call.
+   * @param p:  The primitive to be intersected.
+   * @param r:  The ray.
+   * @param hr: The hit record; updated only for intersections closer than
+   *            hr.t.
+   * @return:   True in case of an intersection closer than hr.t.
+   */
+  inline bool intersect_primitive(const PrimitiveRef &p,
+                                  const Ray &r,
+                                  hit_record &hr) const {
+    const Object *o = object_table[p.oi].get();
+    float_t t{infinity}, u{0.f}, v{0.f};
+    bool fp{false};
+    bool intersected{false};
+
+    switch (p.type()) {
+      case sphere:
+        intersected = static_cast<const Sphere *>(o)->intersect_distance(r, t);
+        break;
+      case triangle:
+        intersected = static_cast<const Triangle *>(o)->intersect_distance(r, t, u, v, fp);
+        break;
+      case triangle_mesh: {
+        glm::vec4 v0, v1, v2;
+        static_cast<const TriangleMesh *>(o)->triangle_vertices(p.ti, v0, v1, v2);
+        intersected = triangle_intersect(r, v0, v1, v2, t, u, v, fp);
+        break;
+      }
+      default:
+        return false;
+    }
+
+    if (!intersected || !(t < hr.t)) return false;
+    hr.t  = t;
+    hr.u  = u;
+    hr.v  = v;
+    hr.p  = p;
+    hr.fp = fp;
+    return true;
+  }
+
+  /**
+   * Records an intersection with the triangle of the primitive p found by
+   * the triangle buffer.
+   */
+  static inline void record_hit(const triangle_hit &th,
+                                const PrimitiveRef &p,
+                                hit_record &hr) {
+    hr.t  = th.t;
+    hr.u  = th.u;
+    hr.v  = th.v;
+    hr.p  = p;
+    hr.fp = th.fp;
+  }
+
+  inline bool occluded_primitive(const PrimitiveRef &p,
+                                 const Ray &r,
+                                 const float_t &t_max) const {
+    const Object *o = object_table[p.oi].get();
+
+    switch (p.type()) {
+      case sphere:
+        return static_cast<const Sphere *>(o)->Sphere::occluded(r, t_max);
+      case triangle:
+        return static_cast<const Triangle *>(o)->Triangle::occluded(r, t_max);
+      case triangle_mesh:
+        return static_cast<const TriangleMesh *>(o)->occluded_triangle(r, p.ti, t_max);
+      default:
+        return false;
+    }
+  }
+
+  inline AABBox primitive_box(const PrimitiveRef &p) const {
+    if (p.type() == triangle_mesh) {
+      return static_cast<const TriangleMesh *>(object_table[p.oi].get())->get_BB(p.ti);
+    }
+    return object_table[p.oi]->bounding_box();
+  }
+
+  /**
+   * Gets the vertices of the primitive p, if it's a triangle.
+   * @return: False, if the primitive isn't a triangle.
+   */
+  inline bool primitive_triangle(const PrimitiveRef &p,
+                                 glm::vec4 &v0,
+                                 glm::vec4 &v1,
+                                 glm::vec4 &v2) const {
+    const Object *o = object_table[p.oi].get();
+
+    switch (p.type()) {
+      case triangle: {
+        auto t = static_cast<const Triangle *>(o);
+        v0 = t->vert0();
+        v1 = t->vert1();
+        v2 = t->vert2();
+        return true;
+      }
+      case triangle_mesh:
+        static_cast<const TriangleMesh *>(o)->triangle_vertices(p.ti, v0, v1, v2);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  inline glm::vec4 primitive_centroid(const PrimitiveRef &p) const {
+    const Object *o = object_table[p.oi].get();
+
+    switch (p.type()) {
+      case sphere:
+        return static_cast<const Sphere *>(o)->Sphere::centroid(p.ti);
+      case triangle:
+        return static_cast<const Triangle *>(o)->Triangle::centroid(p.ti);
+      case triangle_mesh:
+        return static_cast<const TriangleMesh *>(o)->TriangleMesh::centroid(p.ti);
+      default:
+        return glm::vec4(0.f);
+    }
+  }
+
+  /**
+   * Writes the triangle of the primitive p as triangle i into the triangle
+   * buffer.
+   */
+  inline void set_triangle(const PrimitiveRef &p, const uint32_t &i) {
+    if (!p.in_triangle_buffer()) return;
+
+    glm::vec4 v0, v1, v2;
+    static_cast<const TriangleMesh *>(object_table[p.oi].get())->triangle_vertices(p.ti,
+                                                                                  v0,
+                                                                                  v1,
+                                                                                  v2);
+    triangles.set(i, v0, v1, v2);
+  }
+
+  /**
+   * Fills the triangle buffer with the triangles of the primitives in the
+   * given order.
+   * @param order:  Indices of the primitives.
+   * @param n:      Number of indices.
+   */
+  void fill_triangle_buffer(const uint32_t *order, const uint32_t &n);
+
+  /**
+   * Computes the key of a cache file: a hash of the structure's type, its
+   * build parameters, the bounding box and all primitives.
+   */
+  uint64_t cache_key(const std::vector<float_t> &parameters);
+
+  /**
+   * Computes the primitives at the beginning of a construction, unless
+   * update_cached already computed them for it.
+   */
+  inline void prepare_primitives(const uint32_t &number_primitives,
+                                 const std::vector<std::shared_ptr<Object>> &objects) {
+    if (primitives_computed) {
+      primitives_computed = false;
+      return;
+    }
+    compute_primitives(number_primitives, objects);
+  }
+
+  inline uint32_t number_workers() const {
+    return (thread_pool != nullptr) ? thread_pool->size() : 1;
+  }
+
+  /**
+   * Starts measuring the construction; has to be called at the beginning
+   * of construct().
+   */
+  void start_construction();
+
+  /**
+   * Writes the number of construction threads and the speedup of the
+   * construction into info. The speedup is estimated as the processor time
+   * spent by all threads divided by the elapsed time.
+   */
+  void finish_construction(as_construct_info &info);
+
+  /**
+   * Submits a construction task to the thread pool or executes it right
+   * away, if there is no thread pool.
+   */
+  void submit_construction_task(const std::function<void()> &task);
+
+  /**
+   * Blocks until all submitted construction tasks are finished.
+   */
+  void wait_construction_tasks();
+
+  /**
+   * Splits the range [0, n) into a chunk per worker and calls f for every
+   * chunk in parallel. Returns, after all chunks are processed.
+   * @param n:  The size of the range.
+   * @param f:  Called with the index, the beginning and the end of a chunk.
+   */
+  void parallel_for(const uint32_t &n,
+                    const std::function<void(const uint32_t &chunk,
+                                             const uint32_t &begin,
+                                             const uint32_t &end)> &f);
+
 //==============================================================================
 // Data members
 //==============================================================================
  protected:
-  AABBox                      bbox{};
-  std::vector<Primitive>      primitives{};
-  AccelerationStructureType   as_type{not_set_act};
+  AABBox                                bbox{};
+  std::vector<std::shared_ptr<Object>>  object_table{};           // Objects referred to by the primitives.
+  std::vector<PrimitiveRef>             primitives{};
+  AccelerationStructureType             as_type{not_set_act};
+  std::shared_ptr<ThreadPool>           thread_pool{nullptr};
+  TriangleBuffer                        triangles{};              // Triangles of the primitives in the order,
+                                                                  // in which they're stored by the structure.
+  bool                                  scalar_primitives{false}; // Some primitives are not stored in the
+                                                                  // triangle buffer.
+  bool                                  primitives_computed{false}; // The primitives of the current
+                                                                    // construction are computed.
+
+ private:
+  std::chrono::high_resolution_clock::time_point  cs{};     // Start of the construction.
+  uint64_t                                        cst{0};   // Processor time of the constructing
+                                                            // thread at the start in ns.
+  std::atomic<uint64_t>                           cw{0};    // Processor time spent in construction
+                                                            // tasks in ns.
 };
 
 #endif //ELUCIDO_ACCELERATIONSTRUCTURE_H
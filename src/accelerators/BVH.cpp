@@ -0,0 +1,487 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "BVH.h"
+
+#include <algorithm>
+
+namespace {
+const uint32_t kNumberBins        = 12;   // Number of bins for the SAH.
+const uint32_t kMaxSAHDepth       = 32;   // Deeper nodes are split at the median.
+const uint32_t kStackSize         = 64;   // Bounds the depth of the tree.
+const uint32_t kMaxLeafPrimitives = 255;  // Leaves never hold more primitives.
+const uint32_t kMinTaskPrimitives = 4096; // Smaller subtrees are not built in parallel.
+const uint32_t kTasksPerWorker    = 4;    // Subtrees built in parallel per worker.
+const uint8_t  kSubtreeAxis       = 3;    // Marks nodes replaced by a subtree built in parallel.
+
+/**
+ * Slab test of a ray with the bounding box of a node in the interval
+ * [0, t_max].
+ */
+inline bool intersect_node(const BVHNode &n,
+                           const glm::vec4 &o,
+                           const glm::vec4 &id,
+                           const float_t &t_max) {
+  float_t tmin = 0.f, tmax = t_max;
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t t0 = (n.bmin[a] - o[a]) * id[a];
+    float_t t1 = (n.bmax[a] - o[a]) * id[a];
+    if (id[a] < 0.f) std::swap(t0, t1);
+    tmin = t0 > tmin ? t0 : tmin;
+    tmax = t1 < tmax ? t1 : tmax;
+    if (tmin > tmax) return false;
+  }
+  return true;
+}
+
+inline uint32_t bin_index(const float_t &c,
+                          const float_t &cmin,
+                          const float_t &inv_extent) {
+  auto b = static_cast<uint32_t>(kNumberBins * (c - cmin) * inv_extent);
+  return std::min(b, kNumberBins - 1);
+}
+}
+
+//==============================================================================
+void BVH::construct(const AABBox &box,
+                    const std::vector<std::shared_ptr<Object>> &objects,
+                    const uint32_t &number_primitives,
+                    as_construct_info &info) {
+  start_construction();
+
+  // Compute primitives.
+  prepare_primitives(number_primitives, objects);
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  nodes.clear();
+  if (primitives.empty()) {
+    triangles.resize(0);
+    built_node_area = 0.f;
+    gather_info(info);
+    finish_construction(info);
+    return;
+  }
+
+  // Bounding boxes and centroids are computed once for all primitives.
+  auto np = static_cast<uint32_t>(primitives.size());
+  build_state bs;
+  bs.bounds.resize(np);
+  bs.centroids.resize(np);
+  bs.indices.resize(np);
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      bs.bounds[i]    = primitive_box(primitives[i]);
+      bs.centroids[i] = primitive_centroid(primitives[i]);
+      bs.indices[i]   = i;
+    }
+  });
+
+  // The top of the tree is built serially, until the subtrees are small
+  // enough to keep all workers busy.
+  bool spawn = number_workers() > 1;
+  bs.ss = std::max(kMinTaskPrimitives, np / (kTasksPerWorker * number_workers()));
+
+  // A binary tree with N leaves has 2N - 1 nodes.
+  std::vector<BVHNode> top;
+  top.reserve(spawn ? 2 * (np / bs.ss + 1) : 2 * np - 1);
+  build_node(bs, 0, np, 0, top, spawn);
+  wait_construction_tasks();
+
+  if (bs.subtrees.empty()) {
+    nodes.swap(top);
+  } else {
+    nodes.reserve(2 * np - 1);
+    flatten(top, 0, bs);
+  }
+  nodes.shrink_to_fit();
+
+  // Reorder the primitives, so that the primitives of each leaf are
+  // consecutive; the triangle buffer is stored in the same order.
+  std::vector<PrimitiveRef> ordered_primitives(np);
+  triangles.resize(np);
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      ordered_primitives[i] = primitives[bs.indices[i]];
+      set_triangle(ordered_primitives[i], i);
+    }
+  });
+  primitives.swap(ordered_primitives);
+
+  built_node_area = node_area();
+  gather_info(info);
+
+  finish_construction(info);
+}
+
+//==============================================================================
+void BVH::update(const AABBox &box,
+                 const std::vector<std::shared_ptr<Object>> &objects,
+                 const uint32_t &number_primitives,
+                 as_construct_info &info) {
+  // The topology could change only, if objects are added or removed.
+  if (nodes.empty() || objects != object_table ||
+      number_primitives != primitives.size()) {
+    construct(box, objects, number_primitives, info);
+    return;
+  }
+
+  start_construction();
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  refit();
+
+  // Moving primitives apart makes the node bounds overlap more and more.
+  if (node_area() > refit_threshold * built_node_area) {
+    construct(box, objects, number_primitives, info);
+    return;
+  }
+
+  info.rf = true;
+  gather_info(info);
+
+  finish_construction(info);
+}
+
+//==============================================================================
+void BVH::refit() {
+  auto np = static_cast<uint32_t>(primitives.size());
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) set_triangle(primitives[i], i);
+  });
+
+  // The leaves are refitted in parallel.
+  auto nn = static_cast<uint32_t>(nodes.size());
+  parallel_for(nn, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t n = b; n < e; n++) {
+      BVHNode &node = nodes[n];
+      if (node.np == 0) continue;
+
+      AABBox leaf_box;
+      for (uint32_t i = node.offset; i < node.offset + node.np; i++) {
+        AABBox pb = primitive_box(primitives[i]);
+        leaf_box.extend_by(pb.bounds[0]);
+        leaf_box.extend_by(pb.bounds[1]);
+      }
+      for (uint32_t a = 0; a < 3; a++) {
+        node.bmin[a] = leaf_box.bounds[0][a];
+        node.bmax[a] = leaf_box.bounds[1][a];
+      }
+    }
+  });
+
+  // The children of a node are stored behind it, so the interior nodes are
+  // refitted bottom-up in reverse order.
+  for (uint32_t n = nn; n-- > 0;) {
+    BVHNode &node = nodes[n];
+    if (node.np > 0) continue;
+
+    const BVHNode &first = nodes[n + 1];
+    const BVHNode &second = nodes[node.offset];
+    for (uint32_t a = 0; a < 3; a++) {
+      node.bmin[a] = std::min(first.bmin[a], second.bmin[a]);
+      node.bmax[a] = std::max(first.bmax[a], second.bmax[a]);
+    }
+  }
+}
+
+//==============================================================================
+float_t BVH::node_area() const {
+  if (nodes.empty()) return 0.f;
+
+  auto area = [](const BVHNode &n) {
+    float_t ex = n.bmax[0] - n.bmin[0];
+    float_t ey = n.bmax[1] - n.bmin[1];
+    float_t ez = n.bmax[2] - n.bmin[2];
+    return 2.f * (ex * ey + ey * ez + ez * ex);
+  };
+
+  float_t root_area = area(nodes[0]);
+  if (!(root_area > 0.f)) return 1.f;
+
+  float_t sum{0.f};
+  for (auto const &node : nodes) {
+    if (node.np == 0) sum += area(node);
+  }
+  return sum / root_area;
+}
+
+//==============================================================================
+void BVH::gather_info(as_construct_info &info) const {
+  info.nn = static_cast<uint32_t>(nodes.size());
+  info.nl = 0;
+  for (auto const &node : nodes) {
+    if (node.np > 0) info.nl++;
+  }
+  info.npl = (info.nl > 0) ? static_cast<float_t>(primitives.size()) / info.nl : 0.f;
+}
+
+//==============================================================================
+uint32_t BVH::build_node(build_state &bs,
+                         const uint32_t &begin,
+                         const uint32_t &end,
+                         const uint32_t &depth,
+                         std::vector<BVHNode> &out,
+                         const bool &spawn) {
+  auto node_index = static_cast<uint32_t>(out.size());
+  out.emplace_back();
+
+  uint32_t n = end - begin;
+
+  // Hand the subtree over to a construction task.
+  if (spawn && depth > 0 && n <= bs.ss) {
+    bs.subtrees.emplace_back();
+    std::vector<BVHNode> *subtree = &bs.subtrees.back();
+
+    out[node_index].offset = static_cast<uint32_t>(bs.subtrees.size() - 1);
+    out[node_index].np     = 0;
+    out[node_index].axis   = kSubtreeAxis;
+
+    submit_construction_task([this, &bs, subtree, begin, end, depth]() {
+      subtree->reserve(2 * (end - begin) - 1);
+      build_node(bs, begin, end, depth, *subtree, false);
+    });
+    return node_index;
+  }
+
+  // Compute the bounds of the primitives and of their centroids.
+  AABBox node_box, centroid_box;
+  for (uint32_t i = begin; i < end; i++) {
+    node_box.extend_by(bs.bounds[bs.indices[i]].bounds[0]);
+    node_box.extend_by(bs.bounds[bs.indices[i]].bounds[1]);
+    centroid_box.extend_by(bs.centroids[bs.indices[i]]);
+  }
+  for (uint32_t a = 0; a < 3; a++) {
+    out[node_index].bmin[a] = node_box.bounds[0][a];
+    out[node_index].bmax[a] = node_box.bounds[1][a];
+  }
+
+  uint32_t max_leaf = std::min(max_primitives, kMaxLeafPrimitives);
+  auto make_leaf = [&]() {
+    out[node_index].offset = begin;
+    out[node_index].np     = static_cast<uint16_t>(n);
+    return node_index;
+  };
+
+  if (n == 1) return make_leaf();
+
+  auto axis = static_cast<uint32_t>(centroid_box.longestAxis());
+  float_t cmin   = centroid_box.bounds[0][axis];
+  float_t extent = centroid_box.bounds[1][axis] - cmin;
+  uint32_t mid;
+
+  if (extent <= 0.f || depth >= kMaxSAHDepth) {
+    // All centroids coincide or the tree gets too deep: split at the median.
+    if (n <= max_leaf) return make_leaf();
+
+    mid = begin + n / 2;
+    std::nth_element(bs.indices.begin() + begin,
+                     bs.indices.begin() + mid,
+                     bs.indices.begin() + end,
+                     [&](const uint32_t &a, const uint32_t &b) {
+                       return bs.centroids[a][axis] < bs.centroids[b][axis];
+                     });
+  } else {
+    // Bin the primitives according to their centroids.
+    float_t  inv_extent = 1.f / extent;
+    uint32_t bin_count[kNumberBins] = {};
+    AABBox   bin_box[kNumberBins];
+    for (uint32_t i = begin; i < end; i++) {
+      uint32_t b = bin_index(bs.centroids[bs.indices[i]][axis], cmin, inv_extent);
+      bin_count[b]++;
+      bin_box[b].extend_by(bs.bounds[bs.indices[i]].bounds[0]);
+      bin_box[b].extend_by(bs.bounds[bs.indices[i]].bounds[1]);
+    }
+
+    // Sweep from the right to get the area and count right of each split.
+    float_t  right_area[kNumberBins - 1];
+    uint32_t right_count[kNumberBins - 1];
+    AABBox   right_box;
+    uint32_t count{0};
+    for (uint32_t b = kNumberBins - 1; b > 0; b--) {
+      right_box.extend_by(bin_box[b].bounds[0]);
+      right_box.extend_by(bin_box[b].bounds[1]);
+      count += bin_count[b];
+      right_area[b - 1]  = (count > 0) ? right_box.getSurfaceArea() : 0.f;
+      right_count[b - 1] = count;
+    }
+
+    // Sweep from the left and evaluate the cost of each split:
+    //  C = C_t + (N_l * A_l + N_r * A_r) / A,
+    // relative to a cost of 1 for a ray-primitive intersection test.
+    float_t  inv_area = 1.f / node_box.getSurfaceArea();
+    float_t  best_cost{infinity};
+    uint32_t best_split{0};
+    AABBox   left_box;
+    count = 0;
+    for (uint32_t b = 0; b < kNumberBins - 1; b++) {
+      left_box.extend_by(bin_box[b].bounds[0]);
+      left_box.extend_by(bin_box[b].bounds[1]);
+      count += bin_count[b];
+      if (count == 0 || right_count[b] == 0) continue;
+
+      float_t cost = traversal_cost +
+          (count * left_box.getSurfaceArea() +
+           right_count[b] * right_area[b]) * inv_area;
+      if (cost < best_cost) {
+        best_cost  = cost;
+        best_split = b;
+      }
+    }
+
+    // Create a leaf, if intersecting all primitives is cheaper than the
+    // split.
+    if (n <= max_leaf && best_cost >= static_cast<float_t>(n))
+      return make_leaf();
+
+    mid = static_cast<uint32_t>(std::partition(
+        bs.indices.begin() + begin,
+        bs.indices.begin() + end,
+        [&](const uint32_t &i) {
+          return bin_index(bs.centroids[i][axis], cmin, inv_extent) <= best_split;
+        }) - bs.indices.begin());
+  }
+
+  // The first child follows its parent directly.
+  out[node_index].np   = 0;
+  out[node_index].axis = static_cast<uint8_t>(axis);
+  build_node(bs, begin, mid, depth + 1, out, spawn);
+  uint32_t second_child = build_node(bs, mid, end, depth + 1, out, spawn);
+  out[node_index].offset = second_child;
+  return node_index;
+}
+
+//==============================================================================
+void BVH::flatten(const std::vector<BVHNode> &top,
+                  const uint32_t &ni,
+                  const build_state &bs) {
+  const BVHNode &node = top[ni];
+
+  // Copy the subtree built in parallel; the indices of the second children
+  // are relative to the subtree's root.
+  if (node.np == 0 && node.axis == kSubtreeAxis) {
+    auto base = static_cast<uint32_t>(nodes.size());
+    for (auto const &subtree_node : bs.subtrees[node.offset]) {
+      nodes.push_back(subtree_node);
+      if (subtree_node.np == 0) nodes.back().offset += base;
+    }
+    return;
+  }
+
+  auto node_index = static_cast<uint32_t>(nodes.size());
+  nodes.push_back(node);
+  if (node.np > 0) return;
+
+  flatten(top, ni + 1, bs);
+  nodes[node_index].offset = static_cast<uint32_t>(nodes.size());
+  flatten(top, node.offset, bs);
+}
+
+//==============================================================================
+bool BVH::closest_hit(const Ray &r,
+                      hit_record &hr,
+                      traversal_info &ti) const {
+  uint64_t intersected_primitives{0};
+
+  if (nodes.empty()) return false;
+
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  uint32_t stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  while (true) {
+    const BVHNode &node = nodes[cn];
+
+    // Nodes entered behind the closest intersection found so far are
+    // skipped.
+    if (intersect_node(node, o, id, hr.t)) {
+      if (node.np > 0) {
+        uint32_t end = node.offset + node.np;
+        if (scalar_primitives) {
+          for (uint32_t i = node.offset; i < end; i++) {
+            if (!primitives[i].in_triangle_buffer()) {
+              intersect_primitive(primitives[i], r, hr);
+            }
+          }
+        }
+
+        triangle_hit th;
+        if (triangles.intersect_range(r, node.offset, end, hr.t, th)) {
+          record_hit(th, primitives[th.i], hr);
+        }
+        intersected_primitives += node.np;
+      } else {
+        // Visit the child closer to the ray's origin first.
+        if (r.sign()[node.axis]) {
+          stack[sp++] = cn + 1;
+          cn = node.offset;
+        } else {
+          stack[sp++] = node.offset;
+          cn = cn + 1;
+        }
+        continue;
+      }
+    }
+
+    if (sp == 0) break;
+    cn = stack[--sp];
+  }
+
+  STAT_ADD(ti.nrpt, intersected_primitives);
+  return hr.hit();
+}
+
+//==============================================================================
+bool BVH::occluded(const Ray &r,
+                   const float_t &t_max,
+                   traversal_info &ti) const {
+  if (nodes.empty()) return false;
+
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  uint32_t stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  while (true) {
+    const BVHNode &node = nodes[cn];
+
+    if (intersect_node(node, o, id, t_max)) {
+      if (node.np > 0) {
+        uint32_t end = node.offset + node.np;
+        STAT_ADD(ti.nrpt, node.np);
+        if (scalar_primitives) {
+          for (uint32_t i = node.offset; i < end; i++) {
+            if (!primitives[i].in_triangle_buffer() &&
+                occluded_primitive(primitives[i], r, t_max)) {
+              return true;
+            }
+          }
+        }
+
+        if (triangles.occluded_range(r, node.offset, end, t_max)) return true;
+      } else {
+        if (r.sign()[node.axis]) {
+          stack[sp++] = cn + 1;
+          cn = node.offset;
+        } else {
+          stack[sp++] = node.offset;
+          cn = cn + 1;
+        }
+        continue;
+      }
+    }
+
+    if (sp == 0) break;
+    cn = stack[--sp];
+  }
+
+  return false;
+}
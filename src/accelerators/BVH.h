@@ -0,0 +1,143 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_BVH_H
+#define ELUCIDO_BVH_H
+
+#include <deque>
+#include <vector>
+
+#include "AccelerationStructure.h"
+#include "AABBox.h"
+
+/**
+ * A node of the bounding volume hierarchy. The nodes are stored depth-first
+ * in a single array, so the first child of an interior node always follows
+ * its parent directly and only the index of the second child is stored.
+ */
+struct BVHNode {
+  float     bmin[3];  // Minimum bound of the node's bounding box.
+  float     bmax[3];  // Maximum bound of the node's bounding box.
+  uint32_t  offset;   // Leaf: index of the node's first primitive.
+                      // Interior: index of the node's second child.
+  uint16_t  np;       // Number of primitives; 0 for interior nodes.
+  uint8_t   axis;     // Split axis of an interior node.
+  uint8_t   pad;      // Pads the node to 32 bytes.
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode should be 32 bytes large.");
+
+class BVH : public AccelerationStructure {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  BVH() :
+      AccelerationStructure(),
+      nodes()
+  {
+    as_type = bvh;
+  }
+
+  ~BVH() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  void            construct(const AABBox &box,
+                            const std::vector<std::shared_ptr<Object>> &objects,
+                            const uint32_t &number_primitives,
+                            as_construct_info &info);
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
+
+  /**
+   * Refits the node bounds bottom-up, if the hierarchy was built over the
+   * same objects with the same number of primitives. The hierarchy is
+   * rebuilt, if its node area grows by more than the refit threshold
+   * compared to the one after its construction.
+   */
+  void            update(const AABBox &box,
+                         const std::vector<std::shared_ptr<Object>> &objects,
+                         const uint32_t &number_primitives,
+                         as_construct_info &info);
+
+  inline void set_max_primitives(const uint32_t &mp) { max_primitives = mp; }
+  inline void set_refit_threshold(const float_t &rt) { refit_threshold = rt; }
+
+  inline const std::vector<BVHNode> & get_nodes() const { return nodes; }
+
+ private:
+  struct build_state {
+    std::vector<uint32_t>             indices;    // Primitive indices; partitioned in place.
+    std::vector<AABBox>               bounds;     // Bounding boxes of the primitives.
+    std::vector<glm::vec4>            centroids;  // Centroids of the primitives.
+    std::deque<std::vector<BVHNode>>  subtrees;   // Subtrees built by construction tasks.
+    uint32_t                          ss{0};      // Subtrees with at most ss primitives
+                                                  // are built by a construction task.
+  };
+
+  /**
+   * Builds the subtree over the primitives with indices in [begin, end) and
+   * appends its nodes to out. The split is chosen with the binned surface
+   * area heuristic along the longest axis of the primitives' centroid
+   * bounds; the indices in the range are partitioned in place.
+   * If spawn is set, small enough subtrees are built by construction tasks;
+   * a placeholder node referring to the subtree is appended to out instead.
+   * @param bs:     The state of the construction.
+   * @param begin:  Start of the range in the primitive indices.
+   * @param end:    One past the end of the range in the primitive indices.
+   * @param depth:  The depth of the node in the tree.
+   * @param out:    The nodes of the subtree are appended to out.
+   * @param spawn:  Build small enough subtrees in parallel.
+   * @return:       The index of the subtree's root node in out.
+   */
+  uint32_t build_node(build_state &bs,
+                      const uint32_t &begin,
+                      const uint32_t &end,
+                      const uint32_t &depth,
+                      std::vector<BVHNode> &out,
+                      const bool &spawn);
+
+  /**
+   * Appends the subtree of the node ni in top to the node array in
+   * depth-first order and replaces placeholder nodes with the subtrees
+   * built in parallel.
+   */
+  void flatten(const std::vector<BVHNode> &top,
+               const uint32_t &ni,
+               const build_state &bs);
+
+  /**
+   * Recomputes the triangle buffer and the bounding boxes of all nodes from
+   * the current primitives; the topology of the hierarchy is kept.
+   */
+  void refit();
+
+ protected:
+  /**
+   * Sum of the surface areas of the interior nodes relative to the root's
+   * surface area. It's proportional to the expected cost of traversing the
+   * hierarchy with a random ray and independent of the scene's scale.
+   */
+  float_t node_area() const;
+
+  void gather_info(as_construct_info &info) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ protected:
+  std::vector<BVHNode>  nodes;
+  uint32_t              max_primitives{4};
+  float_t               traversal_cost{0.125f};
+  float_t               refit_threshold{1.5f};  // Rebuild, if the node area grows by
+                                                // more than this factor.
+  float_t               built_node_area{0.f};   // Node area after the construction.
+};
+
+#endif //ELUCIDO_BVH_H
@@ -3,84 +3,49 @@
 
 #include "CompactGrid.h"
 
+#include <algorithm>
+
+#include "ASCache.h"
+
+namespace {
+const uint32_t kMaxDistance = 255;  // Distances of the distance field are capped.
+}
+
 //==============================================================================
 void CompactGrid::construct(const AABBox &box,
                             const std::vector<std::shared_ptr<Object>> &objects,
                             const uint32_t &number_primitives,
                             as_construct_info &info) {
+  start_construction();
+
   // Compute primitives.
-  compute_primitives(number_primitives, objects);
+  prepare_primitives(number_primitives, objects);
 
   bbox.bounds[0] = box.bounds[0];
   bbox.bounds[1] = box.bounds[1];
 
   compute_resolution(bbox, primitives.size());
 
-  // Free cells and object lists memory, if they're not empty.
-  delete[] cells;
-  delete[] object_lists;
-
-  // Initialize cell's array and set all entries to 0.
-  uint32_t cells_size = resolution[0] * resolution[1] * resolution[2] + 1;
-  cells = new uint32_t[cells_size]();
-
-  uint32_t *min_cell = nullptr;
-  uint32_t *max_cell = nullptr;
-
-  // Iterate over primitives and increment the overlapping cells.
-  for (uint32_t i = 0; i < primitives.size(); i++) {
-    min_cell = compute_primitive_bound_cell(primitives[i].getBB().bounds[0],
-                                            bbox.bounds[0]);
-    max_cell = compute_primitive_bound_cell(primitives[i].getBB().bounds[1],
-                                            bbox.bounds[0]);
-
-    // Iterate over corresponding grid cells.
-    for (uint32_t z = min_cell[2]; z <= max_cell[2]; ++z) {
-      for (uint32_t y = min_cell[1]; y <= max_cell[1]; ++y) {
-        for (uint32_t x = min_cell[0]; x <= max_cell[0]; ++x) {
-          // Compute the cell's index.
-          size_t cellIndex = offset(x, y, z);
-         cells[cellIndex]++;
-        }
-      }
-    }
-  }
+  auto np = static_cast<uint32_t>(primitives.size());
+  reset_mailboxes(np, number_workers());
 
-  // Accumulate the size for the object lists.
-  for (size_t i = 1; i <= cells_size; i++) {
-    cells[i] += cells[i - 1];
-  }
+  fill_cells();
+  compute_distances();
 
-  // Initialize the object's list array.
-  object_lists = new uint32_t[cells[cells_size - 1]];
-
-  // Iterate over the primitives in reverse order and
-  //  1. decrement the offset for of the cell entry;
-  //  2. add the object to the corresponding cell's object list.
-  for (size_t i = primitives.size(); i --> 0 ;) {
-    min_cell = compute_primitive_bound_cell(primitives[i].getBB().bounds[0],
-                                            bbox.bounds[0]);
-    max_cell = compute_primitive_bound_cell(primitives[i].getBB().bounds[1],
-                                            bbox.bounds[0]);
-
-    // Iterate over corresponding grid cells.
-    for (uint32_t z = min_cell[2]; z <= max_cell[2]; ++z) {
-      for (uint32_t y = min_cell[1]; y <= max_cell[1]; ++y) {
-        for (uint32_t x = min_cell[0]; x <= max_cell[0]; ++x) {
-          // Compute the cell's index.
-          size_t cellIndex = offset(x, y, z);
-
-          cells[cellIndex]--;
-          object_lists[cells[cellIndex]] = i;
-        }
-      }
-    }
-  }
+  // The triangles are stored in the order of the object lists, so that the
+  // triangles of a cell are adjacent.
+  fill_triangle_buffer(object_lists.data(), static_cast<uint32_t>(object_lists.size()));
 
+  gather_info(info);
+  finish_construction(info);
+}
+
+//==============================================================================
+void CompactGrid::gather_info(as_construct_info &info) const {
   // Iterate once more over all cells to gather statistical information
   // about the grid (e.g. number of non-empty cells, av number of primitives
   // per cell)
-  for (size_t i = 0; i < cells_size - 1; i++) {
+  for (size_t i = 0; i + 1 < cells.size(); i++) {
     uint32_t num_primitives_in_cell = cells[i + 1] - cells[i];
     if (num_primitives_in_cell > 0) {
       info.nfc++;
@@ -94,56 +59,294 @@ void CompactGrid::construct(const AABBox &box,
 }
 
 //==============================================================================
-bool CompactGrid::traverse(const Ray &r, isect_info &ii) const {
+bool CompactGrid::cache_parameters(std::vector<float_t> &p) const {
+  p.push_back(alpha);
+  p.push_back(static_cast<float_t>(maxResolution));
+  p.push_back(distance_field ? 1.f : 0.f);
+  p.push_back(exact_insertion ? 1.f : 0.f);
+  return true;
+}
+
+//==============================================================================
+void CompactGrid::write_cache(ASCacheWriter &w) const {
+  w.add(resolution, 3);
+  w.add(cells.data(), cells.size());
+  w.add(object_lists.data(), object_lists.size());
+  w.add(distances.data(), distances.size());
+}
+
+//==============================================================================
+bool CompactGrid::read_cache(const ASCacheReader &r, as_construct_info &info) {
+  // The resolution follows from the bounding box and the number of
+  // primitives, which are part of the cache's key.
+  compute_resolution(bbox, primitives.size());
+
+  Buffer<uint32_t> res;
+  if (r.number_sections() != 4 || !r.view(0, res) || res.size() != 3 ||
+      res[0] != resolution[0] || res[1] != resolution[1] || res[2] != resolution[2] ||
+      !r.view(1, cells) || cells.size() != number_cells() + 1 ||
+      !r.view(2, object_lists) || object_lists.size() != cells.back() ||
+      !valid_cells()) {
+    cells.clear();
+    object_lists.clear();
+    return false;
+  }
+
+  // The distance field is stored for every cell or not at all.
+  Buffer<uint8_t> d;
+  if (!r.view(3, d) || (!d.empty() && d.size() != number_cells())) {
+    cells.clear();
+    object_lists.clear();
+    return false;
+  }
+  distances.assign(d.begin(), d.end());
+
+  reset_mailboxes(static_cast<uint32_t>(primitives.size()), number_workers());
+  fill_triangle_buffer(object_lists.data(), static_cast<uint32_t>(object_lists.size()));
+  gather_info(info);
+  return true;
+}
+
+//==============================================================================
+bool CompactGrid::valid_cells() const {
+  if (cells[0] != 0) return false;
+  for (uint32_t i = 0; i + 1 < cells.size(); i++) {
+    if (cells[i] > cells[i + 1]) return false;
+  }
+  for (auto const &p : object_lists) {
+    if (p >= primitives.size()) return false;
+  }
+  return true;
+}
+
+//==============================================================================
+void CompactGrid::fill_cells() {
+  auto np = static_cast<uint32_t>(primitives.size());
+  uint32_t number_cells = resolution[0] * resolution[1] * resolution[2];
+  uint32_t cells_size   = number_cells + 1;
+  cells.clear();
+  cells.resize(cells_size);
+
+  // Compute the range of cells overlapped by every primitive once.
+  std::vector<uint32_t> cell_ranges(6 * static_cast<size_t>(np));
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      uint32_t min_cell[3], max_cell[3];
+      AABBox pb = primitive_box(primitives[i]);
+      compute_primitive_bound_cell(pb.bounds[0], bbox.bounds[0], min_cell);
+      compute_primitive_bound_cell(pb.bounds[1], bbox.bounds[0], max_cell);
+      std::copy(min_cell, min_cell + 3, &cell_ranges[6 * i]);
+      std::copy(max_cell, max_cell + 3, &cell_ranges[6 * i + 3]);
+    }
+  });
+
+  // Every chunk of primitives counts the primitives per cell in its own
+  // histogram, so no synchronization is needed.
+  uint32_t nc = number_workers();
+  std::vector<std::vector<uint32_t>> histograms(nc);
+  parallel_for(np, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+    histograms[c].assign(number_cells, 0);
+    for (uint32_t i = b; i < e; i++) {
+      const uint32_t *cr = &cell_ranges[6 * i];
+      glm::vec4 v0, v1, v2;
+      bool exact = test_cells(cr, cr + 3) && primitive_triangle(primitives[i], v0, v1, v2);
+      for (uint32_t z = cr[2]; z <= cr[5]; ++z) {
+        for (uint32_t y = cr[1]; y <= cr[4]; ++y) {
+          for (uint32_t x = cr[0]; x <= cr[3]; ++x) {
+            if (exact && !triangle_overlaps_cell(x, y, z, bbox.bounds[0], v0, v1, v2)) continue;
+            histograms[c][offset(x, y, z)]++;
+          }
+        }
+      }
+    }
+  });
+
+  // Turn the histograms into the offsets of every chunk inside a cell and
+  // store the number of primitives per cell.
+  parallel_for(number_cells, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      uint32_t count{0};
+      for (auto &histogram : histograms) {
+        uint32_t chunk_count = histogram[i];
+        histogram[i] = count;
+        count += chunk_count;
+      }
+      cells[i + 1] = count;
+    }
+  });
+
+  // Parallel prefix sum over the number of primitives per cell: every chunk
+  // accumulates its cells, the sums of the chunks are accumulated serially
+  // and finally added to the cells of the following chunks.
+  std::vector<uint32_t> chunk_sums(nc + 1, 0);
+  parallel_for(cells_size, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b + 1; i < e; i++) {
+      cells[i] += cells[i - 1];
+    }
+    if (e > b) chunk_sums[c + 1] = cells[e - 1];
+  });
+  for (uint32_t c = 1; c <= nc; c++) {
+    chunk_sums[c] += chunk_sums[c - 1];
+  }
+  parallel_for(cells_size, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      cells[i] += chunk_sums[c];
+    }
+  });
+
+  // Initialize the object's list array.
+  object_lists.clear();
+  object_lists.resize(cells[cells_size - 1]);
+
+  // Every chunk fills its primitives into the object lists starting at its
+  // own offset inside a cell. Like this, the primitives of a cell are
+  // sorted by their index.
+  parallel_for(np, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      const uint32_t *cr = &cell_ranges[6 * i];
+      glm::vec4 v0, v1, v2;
+      bool exact = test_cells(cr, cr + 3) && primitive_triangle(primitives[i], v0, v1, v2);
+      for (uint32_t z = cr[2]; z <= cr[5]; ++z) {
+        for (uint32_t y = cr[1]; y <= cr[4]; ++y) {
+          for (uint32_t x = cr[0]; x <= cr[3]; ++x) {
+            if (exact && !triangle_overlaps_cell(x, y, z, bbox.bounds[0], v0, v1, v2)) continue;
+            uint32_t cellIndex = offset(x, y, z);
+            object_lists[cells[cellIndex] + histograms[c][cellIndex]++] = i;
+          }
+        }
+      }
+    }
+  });
+}
+
+//==============================================================================
+void CompactGrid::compute_distances() {
+  distances.clear();
+  if (!distance_field) return;
+
+  uint32_t number_cells = this->number_cells();
+  distances.resize(number_cells);
+  for (uint32_t i = 0; i < number_cells; i++) {
+    distances[i] = (cells[i + 1] > cells[i]) ? 0 : kMaxDistance;
+  }
+
+  // A forward and a backward pass of a chamfer distance transform over all
+  // 26 neighbours of a cell yield the exact Chebyshev distance. The forward
+  // pass looks at the neighbours visited before the cell, the backward pass
+  // at the ones visited after it.
+  auto relax = [&](const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &sign) {
+    uint32_t d = distances[offset(x, y, z)];
+    if (d == 0) return;
+    for (int32_t dz = -1; dz <= 1; dz++) {
+      for (int32_t dy = -1; dy <= 1; dy++) {
+        for (int32_t dx = -1; dx <= 1; dx++) {
+          // Only neighbours on the visited side of the cell.
+          int32_t order = dz != 0 ? dz : (dy != 0 ? dy : dx);
+          if (order != sign) continue;
+
+          int32_t nx = x + dx, ny = y + dy, nz = z + dz;
+          if (nx < 0 || ny < 0 || nz < 0 ||
+              nx >= static_cast<int32_t>(resolution[0]) ||
+              ny >= static_cast<int32_t>(resolution[1]) ||
+              nz >= static_cast<int32_t>(resolution[2])) continue;
+          d = std::min(d, distances[offset(nx, ny, nz)] + 1u);
+        }
+      }
+    }
+    distances[offset(x, y, z)] = static_cast<uint8_t>(std::min(d, kMaxDistance));
+  };
+
+  auto rx = static_cast<int32_t>(resolution[0]);
+  auto ry = static_cast<int32_t>(resolution[1]);
+  auto rz = static_cast<int32_t>(resolution[2]);
+  for (int32_t z = 0; z < rz; z++) {
+    for (int32_t y = 0; y < ry; y++) {
+      for (int32_t x = 0; x < rx; x++) relax(x, y, z, -1);
+    }
+  }
+  for (int32_t z = rz - 1; z >= 0; z--) {
+    for (int32_t y = ry - 1; y >= 0; y--) {
+      for (int32_t x = rx - 1; x >= 0; x--) relax(x, y, z, 1);
+    }
+  }
+}
+
+//==============================================================================
+bool CompactGrid::closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const {
   // Scalar distance from the ray's origin to the nearest hit point of
   // the ray with the grid's bounding box.
   float_t   tBoundingBox;
   uint64_t  intersected_primitives{1};
+  uint64_t  avoided_tests{0};
 
   // Check if the ray intersect's the grid at all.
   if (!bbox.intersect(r, tBoundingBox))
     return false;
 
-  glm::vec4 deltaT, nextCrossingT;
-  uint32_t *currentCell = new uint32_t[3];
-  int32_t *step         = new int32_t[3];
-  int32_t *exit         = new int32_t[3];
-
-  traversal_initialization(deltaT, nextCrossingT, currentCell, step, exit, r,
-                           tBoundingBox, bbox.bounds[0]);
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
 
-  // Reset the intersection information.
-  ii = isect_info();
 
   // The actual traversal of the grid.
+  uint64_t steps{0};
   while (true) {
-    uint32_t ci = offset(currentCell[0], currentCell[1], currentCell[2]);
-
-    // Intersect all objects in the cell.
-    for (size_t j = cells[ci]; j < cells[ci + 1]; j++) {
-      isect_info cp;
-      if (primitives[object_lists[j]].intersect(r, cp) && cp.tn < ii.tn) {
-        ii = cp;
-        ii.ho = primitives[object_lists[j]].obj;
-      }
-      intersected_primitives++;
+    uint32_t ci = offset(gt);
+    steps++;
+
+    // Jump across the empty cells around the current cell at once.
+    if (!distances.empty() && distances[ci] > 1) {
+      if (!skip(gt, r, bbox.bounds[0], distances[ci] - 1u, hr.t)) break;
+      continue;
     }
 
-    // Find the plane with the smallest crossing.
-    size_t planeIndex{0};
-    for (size_t i = 0; i < 3; i++) {
-      if (nextCrossingT[i] < nextCrossingT[planeIndex]) {
-        planeIndex = i;
-      }
+    // Intersect all objects in the cell, which weren't tested in a previous
+    // cell.
+    intersect_cell(cells[ci], cells[ci + 1], r, mb, hr, intersected_primitives, avoided_tests);
+
+    // Advance the grid.
+    if (!advance(gt, hr.t)) break;
+  }
+
+  STAT_ADD(ti.nrpt, intersected_primitives);
+  STAT_ADD(ti.nmt, avoided_tests);
+  STAT_ADD(ti.nds, steps);
+  return hr.hit();
+}
+
+//==============================================================================
+bool CompactGrid::occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const {
+  float_t tBoundingBox;
+
+  // Check if the ray intersect's the grid at all.
+  STAT_ADD(ti.nrpt, 1);
+  if (!bbox.intersect(r, tBoundingBox) || tBoundingBox > t_max)
+    return false;
+
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
+
+  // The traversal stops with the first primitive blocking the ray or as soon
+  // as the next cell starts behind t_max.
+  while (true) {
+    uint32_t ci = offset(gt);
+    STAT_ADD(ti.nds, 1);
+
+    if (!distances.empty() && distances[ci] > 1) {
+      if (!skip(gt, r, bbox.bounds[0], distances[ci] - 1u, t_max)) break;
+      continue;
     }
 
+    if (occluded_cell(cells[ci], cells[ci + 1], r, t_max, mb, ti)) return true;
+
     // Advance the grid.
-    if (ii.tn < nextCrossingT[planeIndex]) break;
-    currentCell[planeIndex] += step[planeIndex];
-    if (currentCell[planeIndex] == exit[planeIndex]) break;
-    nextCrossingT[planeIndex] += deltaT[planeIndex];
+    if (!advance(gt, t_max)) break;
   }
 
-  ii.nrpt = intersected_primitives;
-  return (ii.ho != nullptr);
+  return false;
 }
@@ -19,10 +19,7 @@ class CompactGrid : public AccelerationStructure, public Grid {
     as_type = compact_grid;
   }
 
-  ~CompactGrid() {
-    delete[] cells;
-    delete[] object_lists;
-  };
+  ~CompactGrid() {}
 
 //==============================================================================
 // Function declarations
@@ -31,14 +28,139 @@ class CompactGrid : public AccelerationStructure, public Grid {
                             const std::vector<std::shared_ptr<Object>> &objects,
                             const uint32_t &number_primitives,
                             as_construct_info &info);
-  bool            traverse(const Ray &r, isect_info &ii) const;
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
+  bool            cache_parameters(std::vector<float_t> &p) const;
+  void            write_cache(ASCacheWriter &w) const;
+  bool            read_cache(const ASCacheReader &r, as_construct_info &info);
+
+  /**
+   * Enables skipping empty cells with a distance field, which stores the
+   * Chebyshev distance to the nearest non-empty cell for every cell.
+   */
+  inline void set_distance_field(const bool &df) { distance_field = df; }
+
+  inline const std::vector<uint8_t> & get_distances() const { return distances; }
+
+ protected:
+  /**
+   * Writes the resolution and the cell statistics into info.
+   */
+  void gather_info(as_construct_info &info) const;
+
+  /**
+   * Computes the Chebyshev distance in cells from every cell to the nearest
+   * non-empty cell, if the distance field is enabled; the distances are
+   * capped at 255.
+   */
+  void compute_distances();
+
+  /**
+   * Distributes the primitives into the cells of the grid with the current
+   * resolution. The cells store the offsets of their object lists, which
+   * are computed with a parallel prefix sum over the number of primitives
+   * per cell.
+   */
+  void fill_cells();
+
+  /**
+   * Checks that the offsets of the cells are ascending and that the object
+   * lists only refer to existing primitives; used for grids read from a
+   * cache file.
+   */
+  bool valid_cells() const;
+
+  /**
+   * Intersects the ray with the primitives in the object lists in
+   * [begin, end), which weren't tested against it before, and updates the
+   * hit record with the closest intersection.
+   * @param begin:  Start of the range in the object lists.
+   * @param end:    One past the end of the range in the object lists.
+   * @param r:      The ray.
+   * @param mb:     The mailbox of the ray.
+   * @param hr:     The closest intersection found so far.
+   * @param nrpt:   Incremented by the number of tested primitives.
+   * @param nmt:    Incremented by the number of tests avoided by mailboxing.
+   */
+  inline void intersect_cell(const uint32_t &begin,
+                             const uint32_t &end,
+                             const Ray &r,
+                             mailbox &mb,
+                             hit_record &hr,
+                             uint64_t &nrpt,
+                             uint64_t &nmt) const {
+    // The triangles are tested in packets.
+    for (uint32_t j = begin; j < end; j += kTrianglePacketWidth) {
+      uint32_t mask = TriangleBuffer::packet_mask(end - j);
+
+      for (uint32_t l = 0; l < kTrianglePacketWidth && j + l < end; l++) {
+        const uint32_t &p = object_lists[j + l];
+        if (mb.tested(p)) {
+          mask &= ~(1u << l);
+          nmt++;
+          continue;
+        }
+        nrpt++;
+
+        if (scalar_primitives && !primitives[p].in_triangle_buffer()) {
+          intersect_primitive(primitives[p], r, hr);
+        }
+      }
+
+      triangle_hit th;
+      if (mask != 0 && triangles.intersect_packet(r, j, mask, hr.t, th)) {
+        record_hit(th, primitives[object_lists[th.i]], hr);
+      }
+    }
+  }
+
+  /**
+   * Checks if any primitive in the object lists in [begin, end), which
+   * wasn't tested against the ray before, blocks it before t_max.
+   */
+  inline bool occluded_cell(const uint32_t &begin,
+                            const uint32_t &end,
+                            const Ray &r,
+                            const float_t &t_max,
+                            mailbox &mb,
+                            traversal_info &ti) const {
+    for (uint32_t j = begin; j < end; j += kTrianglePacketWidth) {
+      uint32_t mask = TriangleBuffer::packet_mask(end - j);
+
+      for (uint32_t l = 0; l < kTrianglePacketWidth && j + l < end; l++) {
+        const uint32_t &p = object_lists[j + l];
+        if (mb.tested(p)) {
+          mask &= ~(1u << l);
+          STAT_ADD(ti.nmt, 1);
+          continue;
+        }
+
+        STAT_ADD(ti.nrpt, 1);
+        if (scalar_primitives && !primitives[p].in_triangle_buffer() &&
+            occluded_primitive(primitives[p], r, t_max)) {
+          return true;
+        }
+      }
+
+      if (mask != 0 && triangles.occluded_packet(r, j, mask, t_max)) return true;
+    }
+    return false;
+  }
 
 //==============================================================================
 // Data members
 //==============================================================================
- private:
-  uint32_t  *object_lists{nullptr};
-  uint32_t  *cells{nullptr};
+ protected:
+  Buffer<uint32_t>      object_lists;
+  Buffer<uint32_t>      cells;
+  bool                  distance_field{false};
+  std::vector<uint8_t>  distances;  // Distance to the nearest non-empty
+                                    // cell per cell; empty, if the distance
+                                    // field is disabled.
 };
 
 #endif //ELUCIDO_COMPACTGRID_H
@@ -9,7 +9,7 @@ void DynamicGrid::construct(const AABBox &box,
                      const uint32_t &number_primitives,
                      as_construct_info &info) {
   // Compute primitives.
-  compute_primitives(number_primitives, objects);
+  prepare_primitives(number_primitives, objects);
 
   bbox.bounds[0] = box.bounds[0];
   bbox.bounds[1] = box.bounds[1];
@@ -20,20 +20,27 @@ void DynamicGrid::construct(const AABBox &box,
   size_t numOfCells = resolution[0] * resolution[1] * resolution[2];
   cells.assign(numOfCells, nullptr);
 
-  uint32_t *min_cell = nullptr;
-  uint32_t *max_cell = nullptr;
+  reset_mailboxes(static_cast<uint32_t>(primitives.size()), number_workers());
+
+  uint32_t min_cell[3], max_cell[3];
 
   // Iterate over primitives to insert them in the corresponding grid's cell.
-  for (auto const &primitive : primitives) {
-    min_cell = compute_primitive_bound_cell(primitive.getBB().bounds[0],
-                                            bbox.bounds[0]);
-    max_cell = compute_primitive_bound_cell(primitive.getBB().bounds[1],
-                                            bbox.bounds[0]);
+  for (uint32_t i = 0; i < primitives.size(); i++) {
+    AABBox pb = primitive_box(primitives[i]);
+    compute_primitive_bound_cell(pb.bounds[0], bbox.bounds[0], min_cell);
+    compute_primitive_bound_cell(pb.bounds[1], bbox.bounds[0], max_cell);
+
+    // With exact insertion, triangles are only added to the cells, which
+    // they overlap.
+    glm::vec4 v0, v1, v2;
+    bool exact = test_cells(min_cell, max_cell) && primitive_triangle(primitives[i], v0, v1, v2);
 
     // Iterate over corresponding grid cells and add primitive to it.
     for (uint32_t z = min_cell[2]; z <= max_cell[2]; ++z) {
       for (uint32_t y = min_cell[1]; y <= max_cell[1]; ++y) {
         for (uint32_t x = min_cell[0]; x <= max_cell[0]; ++x) {
+          if (exact && !triangle_overlaps_cell(x, y, z, bbox.bounds[0], v0, v1, v2)) continue;
+
           // Compute the cell's index.
           size_t cellIndex = offset(x, y, z);
 
@@ -41,17 +48,30 @@ void DynamicGrid::construct(const AABBox &box,
           if (cells[cellIndex] == nullptr) {
             cells[cellIndex] = std::make_shared<Cell>(Cell());
           }
-          cells[cellIndex]->insert(primitive);
+          cells[cellIndex]->insert(i);
         }
       }
     }
   }
 
+  // Store the triangles of the cells one after another in the triangle
+  // buffer.
+  uint32_t number_references{0};
+  for (auto const &cell : cells) {
+    if (cell == nullptr) continue;
+    cell->ft = number_references;
+    number_references += cell->primitives.size();
+  }
+  triangles.resize(number_references);
+
   // Iterate once more over all cells to gather statistical information
   // about the grid (e.g. number of non-empty cells, av number of primitives
   // per cell)
   for (size_t i = 0; i < resolution[0] * resolution[1] * resolution[2]; i++) {
     if (cells[i] == nullptr) continue;
+    for (uint32_t j = 0; j < cells[i]->primitives.size(); j++) {
+      set_triangle(primitives[cells[i]->primitives[j]], cells[i]->ft + j);
+    }
     info.nfc++;
     info.npnc += cells[i]->primitives.size();
   }
@@ -62,53 +82,124 @@ void DynamicGrid::construct(const AABBox &box,
 }
 
 //==============================================================================
-bool DynamicGrid::traverse(const Ray &r, isect_info &ii) const {
+bool DynamicGrid::closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const {
   // Scalar distance from the ray's origin to the nearest hit point of
   // the ray with the grid's bounding box.
   float_t   tBoundingBox;
   uint64_t  intersected_primitives{1};
+  uint64_t  avoided_tests{0};
 
   // Check if the ray intersect's the grid at all.
   if (!bbox.intersect(r, tBoundingBox))
     return false;
 
-  glm::vec4 deltaT, nextCrossingT;
-  uint32_t *currentCell = new uint32_t[3];
-  int32_t *step         = new int32_t[3];
-  int32_t *exit         = new int32_t[3];
-
-  traversal_initialization(deltaT, nextCrossingT, currentCell, step, exit, r,
-                           tBoundingBox, bbox.bounds[0]);
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
 
-  // Reset the intersection information.
-  ii = isect_info();
 
   // The actual traversal of the grid.
+  uint64_t steps{0};
   while (true) {
-    uint32_t cellIndex = offset(currentCell[0], currentCell[1], currentCell[2]);
+    uint32_t cellIndex = offset(gt);
+    steps++;
 
     // Check if there are any primitives in the current cell and if yes
     // check if the ray intersects any of the primitives in the cell.
+    // Primitives already tested in a previous cell are skipped and the
+    // triangles are tested in packets.
     if (cells[cellIndex] != nullptr) {
-      cells[cellIndex]->intersect(r, ii);
-      intersected_primitives += cells[cellIndex]->primitives.size();
+      const Cell &cell = *cells[cellIndex];
+      auto np = static_cast<uint32_t>(cell.primitives.size());
+
+      for (uint32_t j = 0; j < np; j += kTrianglePacketWidth) {
+        uint32_t mask = TriangleBuffer::packet_mask(np - j);
+
+        for (uint32_t l = 0; l < kTrianglePacketWidth && j + l < np; l++) {
+          const uint32_t &p = cell.primitives[j + l];
+          if (mb.tested(p)) {
+            mask &= ~(1u << l);
+            avoided_tests++;
+            continue;
+          }
+          intersected_primitives++;
+
+          if (scalar_primitives && !primitives[p].in_triangle_buffer()) {
+            intersect_primitive(primitives[p], r, hr);
+          }
+        }
+
+        triangle_hit th;
+        if (mask != 0 && triangles.intersect_packet(r, cell.ft + j, mask, hr.t, th)) {
+          record_hit(th, primitives[cell.primitives[th.i - cell.ft]], hr);
+        }
+      }
     }
 
-    // Find the plane with the smallest crossing.
-    size_t planeIndex{0};
-    for (size_t i = 0; i < 3; i++) {
-      if (nextCrossingT[i] < nextCrossingT[planeIndex]) {
-        planeIndex = i;
+    // Advance the grid.
+    if (!advance(gt, hr.t)) break;
+  }
+
+  STAT_ADD(ti.nrpt, intersected_primitives);
+  STAT_ADD(ti.nmt, avoided_tests);
+  STAT_ADD(ti.nds, steps);
+  return hr.hit();
+}
+
+//==============================================================================
+bool DynamicGrid::occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const {
+  float_t tBoundingBox;
+
+  // Check if the ray intersect's the grid at all.
+  STAT_ADD(ti.nrpt, 1);
+  if (!bbox.intersect(r, tBoundingBox) || tBoundingBox > t_max)
+    return false;
+
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
+
+  // The traversal stops with the first primitive blocking the ray or as soon
+  // as the next cell starts behind t_max.
+  while (true) {
+    uint32_t cellIndex = offset(gt);
+    STAT_ADD(ti.nds, 1);
+
+    if (cells[cellIndex] != nullptr) {
+      const Cell &cell = *cells[cellIndex];
+      auto np = static_cast<uint32_t>(cell.primitives.size());
+
+      for (uint32_t j = 0; j < np; j += kTrianglePacketWidth) {
+        uint32_t mask = TriangleBuffer::packet_mask(np - j);
+
+        for (uint32_t l = 0; l < kTrianglePacketWidth && j + l < np; l++) {
+          const uint32_t &p = cell.primitives[j + l];
+          if (mb.tested(p)) {
+            mask &= ~(1u << l);
+            STAT_ADD(ti.nmt, 1);
+            continue;
+          }
+
+          STAT_ADD(ti.nrpt, 1);
+          if (scalar_primitives && !primitives[p].in_triangle_buffer() &&
+              occluded_primitive(primitives[p], r, t_max)) {
+            return true;
+          }
+        }
+
+        if (mask != 0 && triangles.occluded_packet(r, cell.ft + j, mask, t_max)) {
+          return true;
+        }
       }
     }
 
     // Advance the grid.
-    if (ii.tn < nextCrossingT[planeIndex]) break;
-    currentCell[planeIndex] += step[planeIndex];
-    if (currentCell[planeIndex] == exit[planeIndex]) break;
-    nextCrossingT[planeIndex] += deltaT[planeIndex];
+    if (!advance(gt, t_max)) break;
   }
 
-  ii.nrpt = intersected_primitives;
-  return (ii.ho != nullptr);
-}
\ No newline at end of file
+  return false;
+}
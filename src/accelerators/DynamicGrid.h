@@ -20,31 +20,16 @@ struct Cell {
 //==============================================================================
 // Function declarations
 //==============================================================================
-  inline void insert(const Primitive &primitive) {
-    primitives.emplace_back(primitive);
-  }
-
-  inline bool intersect(const Ray &r, isect_info &i) const {
-    for (auto const &primitive : primitives) {
-      // Information we got from the intersection with the current object.
-      isect_info co;
-
-      if (primitive.intersect(r, co) && co.tn < i.tn) {
-        i = co;
-        i.ho = primitive.obj;
-        if (i.ho->object_type() == triangle_mesh) {
-          i.ti = primitive.tri_ind;
-        }
-      }
-    }
-
-    return (i.ho != nullptr);
+  inline void insert(const uint32_t &primitive_index) {
+    primitives.emplace_back(primitive_index);
   }
 
 //==============================================================================
 // Data members
 //==============================================================================
-  std::vector<Primitive> primitives;
+  std::vector<uint32_t> primitives;   // Indices of the overlapping primitives.
+  uint32_t              ft{0};        // Index of the cell's first triangle in
+                                      // the triangle buffer.
 };
 
 class DynamicGrid : public AccelerationStructure, public Grid {
@@ -68,7 +53,12 @@ class DynamicGrid : public AccelerationStructure, public Grid {
                             const std::vector<std::shared_ptr<Object>> &objects,
                             const uint32_t &number_primitives,
                             as_construct_info &info);
-  bool            traverse(const Ray &r, isect_info &i) const;
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
 
 //==============================================================================
 // Data members
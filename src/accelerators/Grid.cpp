@@ -3,6 +3,14 @@
 
 #include "Grid.h"
 
+#include <algorithm>
+
+namespace {
+// Cells are enlarged by this fraction of their size for the triangle-cell
+// overlap test.
+const float_t kCellMargin = 1e-4f;
+}
+
 //==============================================================================
 void Grid::compute_resolution(const AABBox &box,
                               const uint32_t &number_primitives) {
@@ -39,29 +47,37 @@ void Grid::compute_resolution(const AABBox &box,
 }
 
 //==============================================================================
-uint32_t *Grid::compute_primitive_bound_cell(const glm::vec4 &primitive_bound,
-                                             const glm::vec4 &box_bound) const {
-  uint32_t *pb = new uint32_t[3];
+void Grid::compute_primitive_bound_cell(const glm::vec4 &primitive_bound,
+                                        const glm::vec4 &box_bound,
+                                        uint32_t (&cell)[3]) const {
   glm::vec4 pcc = (primitive_bound - box_bound) / cellDimension;
 
   // X
-  pb[0] = static_cast<uint32_t>(glm::clamp(pcc.x, 0.f, 1.f * (resolution[0] - 1)));
+  cell[0] = static_cast<uint32_t>(glm::clamp(pcc.x, 0.f, 1.f * (resolution[0] - 1)));
 
   // Y
-  pb[1] = static_cast<uint32_t>(glm::clamp(pcc.y, 0.f, 1.f * (resolution[1] - 1)));
+  cell[1] = static_cast<uint32_t>(glm::clamp(pcc.y, 0.f, 1.f * (resolution[1] - 1)));
 
   // Z
-  pb[2] = static_cast<uint32_t>(glm::clamp(pcc.z, 0.f, 1.f * (resolution[2] - 1)));
+  cell[2] = static_cast<uint32_t>(glm::clamp(pcc.z, 0.f, 1.f * (resolution[2] - 1)));
+}
 
-  return pb;
+//==============================================================================
+bool Grid::triangle_overlaps_cell(const uint32_t &x,
+                                  const uint32_t &y,
+                                  const uint32_t &z,
+                                  const glm::vec4 &box_bound,
+                                  const glm::vec4 &v0,
+                                  const glm::vec4 &v1,
+                                  const glm::vec4 &v2) const {
+  glm::vec4 margin = kCellMargin * cellDimension;
+  glm::vec4 cell_min = box_bound + glm::vec4(x, y, z, 0.f) * cellDimension;
+  AABBox cell(cell_min - margin, cell_min + cellDimension + margin);
+  return cell.overlaps_triangle(v0, v1, v2);
 }
 
 //==============================================================================
-void Grid::traversal_initialization(glm::vec4 &delta_t,
-                                    glm::vec4 &next_crossing_t,
-                                    uint32_t *current_cell,
-                                    int32_t *step,
-                                    int32_t *exit,
+void Grid::traversal_initialization(grid_traversal &gt,
                                     const Ray &ray,
                                     const float_t &t_bb,
                                     const glm::vec4 &box_min_bound) const {
@@ -73,24 +89,94 @@ void Grid::traversal_initialization(glm::vec4 &delta_t,
     // and the grid's bounding box minimum bound.
     float_t rg = rgip[axis] - box_min_bound[axis];
 
-    current_cell[axis] = static_cast<uint32_t>(glm::clamp(
+    gt.current_cell[axis] = static_cast<uint32_t>(glm::clamp(
         glm::floor(rg / cellDimension[axis]),
         0.f,
         1.f * (resolution[axis] - 1)));
 
     // Ray's direction is positive in this axis.
     if (ray.dir()[axis] >= 0) {
-      delta_t[axis] = cellDimension[axis] * ray.inv_dir()[axis];
-      next_crossing_t[axis] = t_bb +
-          ((current_cell[axis] + 1) * cellDimension[axis] - rg) * ray.inv_dir()[axis];
-      step[axis] = 1;
-      exit[axis] = resolution[axis];
+      gt.delta_t[axis] = cellDimension[axis] * ray.inv_dir()[axis];
+      gt.next_crossing_t[axis] = t_bb +
+          ((gt.current_cell[axis] + 1) * cellDimension[axis] - rg) * ray.inv_dir()[axis];
+      gt.step[axis] = 1;
+      gt.exit[axis] = resolution[axis];
+    } else {
+      gt.delta_t[axis] = -cellDimension[axis] * ray.inv_dir()[axis];
+      gt.next_crossing_t[axis] = t_bb +
+          (gt.current_cell[axis] * cellDimension[axis] - rg) * ray.inv_dir()[axis];
+      gt.step[axis] = -1;
+      gt.exit[axis] = -1;
+    }
+  }
+}
+
+//==============================================================================
+bool Grid::skip(grid_traversal &gt,
+                const Ray &ray,
+                const glm::vec4 &box_min_bound,
+                const uint32_t &radius,
+                const float_t &t) const {
+  // The cells [lo, hi] per axis are empty. Find the axis, along which the
+  // ray leaves them first.
+  int32_t lo[3], hi[3];
+  float_t t_exit = infinity;
+  size_t exit_axis{0};
+  for (size_t axis = 0; axis < 3; axis++) {
+    lo[axis] = static_cast<int32_t>(gt.current_cell[axis]) - static_cast<int32_t>(radius);
+    hi[axis] = static_cast<int32_t>(gt.current_cell[axis]) + static_cast<int32_t>(radius);
+
+    int32_t plane = gt.step[axis] > 0 ? hi[axis] + 1 : lo[axis];
+    float_t ta = (box_min_bound[axis] + plane * cellDimension[axis] - ray.orig()[axis]) *
+        ray.inv_dir()[axis];
+    if (ta < t_exit) {
+      t_exit = ta;
+      exit_axis = axis;
+    }
+  }
+  if (t < t_exit) return false;
+
+  // The ray continues in the cell behind the exit plane; along the other
+  // axes the cell is kept inside the skipped cells.
+  glm::vec4 p = ray.orig() + t_exit * ray.dir();
+  for (size_t axis = 0; axis < 3; axis++) {
+    int32_t cell;
+    if (axis == exit_axis) {
+      cell = gt.step[axis] > 0 ? hi[axis] + 1 : lo[axis] - 1;
+      if (cell < 0 || cell >= static_cast<int32_t>(resolution[axis])) return false;
     } else {
-      delta_t[axis] = -cellDimension[axis] * ray.inv_dir()[axis];
-      next_crossing_t[axis] = t_bb +
-          (current_cell[axis] * cellDimension[axis] - rg) * ray.inv_dir()[axis];
-      step[axis] = -1;
-      exit[axis] = -1;
+      auto c = static_cast<int32_t>(glm::floor((p[axis] - box_min_bound[axis]) / cellDimension[axis]));
+      cell = glm::clamp(c,
+                        std::max(lo[axis], 0),
+                        std::min(hi[axis], static_cast<int32_t>(resolution[axis]) - 1));
     }
+
+    gt.current_cell[axis] = static_cast<uint32_t>(cell);
+    int32_t plane = gt.step[axis] > 0 ? cell + 1 : cell;
+    gt.next_crossing_t[axis] = (box_min_bound[axis] + plane * cellDimension[axis] - ray.orig()[axis]) *
+        ray.inv_dir()[axis];
+  }
+  return true;
+}
+
+//==============================================================================
+void Grid::reset_mailboxes(const uint32_t &number_primitives,
+                           const uint32_t &number_workers) {
+  mailboxes.resize(number_workers);
+  for (auto &mb : mailboxes) {
+    mb.lr.assign(number_primitives, 0);
+    mb.cr = 0;
+  }
+}
+
+//==============================================================================
+mailbox& Grid::ray_mailbox(const uint32_t &worker) const {
+  mailbox &mb = mailboxes[worker];
+
+  // Start over, when the ray IDs overflow.
+  if (++mb.cr == 0) {
+    std::fill(mb.lr.begin(), mb.lr.end(), 0);
+    mb.cr = 1;
   }
+  return mb;
 }
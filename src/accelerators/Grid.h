@@ -6,12 +6,49 @@
 
 #include <cstdint>
 #include <cmath>
+#include <vector>
 #include <glm/vec4.hpp>
 
 
 #include "AABBox.h"
 #include "../core/Ray.h"
 
+// State of the 3D-DDA traversal of a ray through a grid. It's kept on the
+// stack of the traversing thread, so traversing a grid doesn't allocate.
+struct grid_traversal {
+  glm::vec4 delta_t;          // Distance along the ray between two crossings
+                              // of cell planes per axis.
+  glm::vec4 next_crossing_t;  // Distance along the ray to the next crossing
+                              // of a cell plane per axis.
+  uint32_t  current_cell[3];  // The cell, in which the ray currently is.
+  int32_t   step[3];          // Direction of the traversal per axis.
+  int32_t   exit[3];          // Cell index per axis, at which the ray leaves
+                              // the grid.
+};
+
+// Mailbox of a worker, which records the last ray tested against every
+// primitive of a grid. Primitives overlapping several cells are like this
+// tested only once per ray. It's padded, so that the mailboxes of two
+// workers never share a cache line.
+struct mailbox {
+  std::vector<uint32_t> lr;     // ID of the last ray tested per primitive.
+  uint32_t              cr{0};  // ID of the current ray.
+  char                  tp[kCacheLineSize]; // Trailing padding.
+
+  /**
+   * Checks if the primitive was already tested against the current ray and
+   * marks it as tested.
+   * @param p:  The index of the primitive.
+   * @return:   True, if the primitive was already tested against the
+   *            current ray.
+   */
+  inline bool tested(const uint32_t &p) {
+    if (lr[p] == cr) return true;
+    lr[p] = cr;
+    return false;
+  }
+};
+
 class Grid {
 //==============================================================================
 // Constructors & destructors
@@ -29,6 +66,10 @@ class Grid {
     return z * resolution[0] * resolution[1] + y * resolution[0] + x;
   }
 
+  inline uint32_t number_cells() const {
+    return resolution[0] * resolution[1] * resolution[2];
+  }
+
   inline float_t  getAlpha() const { return this->alpha; }
   inline void     set_alpha(const float_t _alhpa) { this->alpha = _alhpa; }
 
@@ -36,18 +77,117 @@ class Grid {
     this->maxResolution = resolution;
   }
 
+  /**
+   * Inserts triangles only into the cells, which they actually overlap,
+   * instead of into all cells overlapped by their bounding boxes.
+   */
+  inline void     set_exact_insertion(const bool &ei) { exact_insertion = ei; }
+
   void compute_resolution(const AABBox &box, const uint32_t &number_primitives);
-  uint32_t* compute_primitive_bound_cell(const glm::vec4 & primitive_bound,
-                                         const glm::vec4 & box_bound) const;
-  void traversal_initialization(glm::vec4 &delta_t,
-                                glm::vec4 &next_crossing_t,
-                                uint32_t *current_cell,
-                                int32_t *step,
-                                int32_t *exit,
+
+  /**
+   * Computes the cell containing the bound of a primitive.
+   * @param primitive_bound:  The minimum or maximum bound of the primitive.
+   * @param box_bound:        The minimum bound of the grid.
+   * @param cell:             The cell's coordinates.
+   */
+  void compute_primitive_bound_cell(const glm::vec4 &primitive_bound,
+                                    const glm::vec4 &box_bound,
+                                    uint32_t (&cell)[3]) const;
+
+  /**
+   * Checks if a primitive overlapping the cells [min_cell, max_cell] has to
+   * be tested against each of them: only primitives spanning several cells
+   * are tested, if triangles are inserted exactly.
+   */
+  inline bool test_cells(const uint32_t *min_cell, const uint32_t *max_cell) const {
+    return exact_insertion && (min_cell[0] != max_cell[0] ||
+                               min_cell[1] != max_cell[1] ||
+                               min_cell[2] != max_cell[2]);
+  }
+
+  /**
+   * Checks if the triangle (v0, v1, v2) overlaps the cell (x, y, z). The
+   * cell is slightly enlarged, so that triangles on its boundary are never
+   * lost to rounding errors.
+   * @param box_bound:  The minimum bound of the grid.
+   */
+  bool triangle_overlaps_cell(const uint32_t &x,
+                              const uint32_t &y,
+                              const uint32_t &z,
+                              const glm::vec4 &box_bound,
+                              const glm::vec4 &v0,
+                              const glm::vec4 &v1,
+                              const glm::vec4 &v2) const;
+  /**
+   * Prepares a mailbox per worker for a newly constructed grid; has to be
+   * called during the construction.
+   * @param number_primitives:  The number of primitives in the grid.
+   * @param number_workers:     The number of workers traversing the grid.
+   */
+  void reset_mailboxes(const uint32_t &number_primitives,
+                       const uint32_t &number_workers);
+
+  /**
+   * Returns the mailbox of a worker prepared for a new ray.
+   * @param worker: The index of the worker tracing the ray; only this
+   *                worker may use the mailbox until the ray is traced.
+   */
+  mailbox& ray_mailbox(const uint32_t &worker) const;
+
+  void traversal_initialization(grid_traversal &gt,
                                 const Ray &ray,
                                 const float_t &t_bb,
                                 const glm::vec4 &box_min_bound) const;
 
+  inline uint32_t offset(const grid_traversal &gt) const {
+    return offset(gt.current_cell[0], gt.current_cell[1], gt.current_cell[2]);
+  }
+
+  /**
+   * Moves the traversal to the next cell along the ray, if the next cell
+   * starts before t.
+   * @param gt: The traversal state.
+   * @param t:  The traversal ends, if the next cell starts behind t, e.g.
+   *            the distance to the closest intersection found so far.
+   * @return:   False, if the traversal ends, true otherwise.
+   */
+  inline bool advance(grid_traversal &gt, const float_t &t) const {
+    // Find the plane with the smallest crossing.
+    size_t planeIndex{0};
+    for (size_t i = 0; i < 3; i++) {
+      if (gt.next_crossing_t[i] < gt.next_crossing_t[planeIndex]) {
+        planeIndex = i;
+      }
+    }
+
+    // Advance the grid.
+    if (t < gt.next_crossing_t[planeIndex]) return false;
+    // Stepping below cell 0 wraps around to the exit index -1.
+    gt.current_cell[planeIndex] += gt.step[planeIndex];
+    if (gt.current_cell[planeIndex] == static_cast<uint32_t>(gt.exit[planeIndex])) return false;
+    gt.next_crossing_t[planeIndex] += gt.delta_t[planeIndex];
+    return true;
+  }
+
+  /**
+   * Moves the traversal across the empty cells around the current cell: all
+   * cells within the Chebyshev distance radius of it hold no primitives, so
+   * the traversal continues with the cell, in which the ray leaves them.
+   * @param gt:             The traversal state.
+   * @param ray:            The traversing ray.
+   * @param box_min_bound:  The minimum bound of the grid.
+   * @param radius:         The radius of the empty cells in cells.
+   * @param t:              The traversal ends, if the next cell starts
+   *                        behind t.
+   * @return:               False, if the traversal ends, true otherwise.
+   */
+  bool skip(grid_traversal &gt,
+            const Ray &ray,
+            const glm::vec4 &box_min_bound,
+            const uint32_t &radius,
+            const float_t &t) const;
+
 //==============================================================================
 // Data members
 //==============================================================================
@@ -55,7 +195,9 @@ class Grid {
   uint32_t                              resolution[3]{};
   uint32_t                              maxResolution{64};
   float_t                               alpha{3.f};
+  bool                                  exact_insertion{false};
   glm::vec4                             cellDimension{0.f};
+  mutable std::vector<mailbox>          mailboxes;  // Mailbox per worker.
 };
 
 #endif //ELUCIDO_GRID_H
@@ -0,0 +1,305 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "HierarchicalGrid.h"
+
+#include <algorithm>
+
+namespace {
+const uint32_t kNoSubGrid = 0xFFFFFFFFu; // Marks top-level cells without a sub-grid.
+
+/**
+ * Distance along the ray to the point, where it enters the box. The ray is
+ * known to intersect the box, so only the near planes of the slabs are
+ * considered.
+ */
+inline float_t entry_distance(const Ray &r, const AABBox &box) {
+  float_t t = -infinity;
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t ta = (box.bounds[r.sign()[a]][a] - r.orig()[a]) * r.inv_dir()[a];
+    if (ta > t) t = ta;
+  }
+  return t;
+}
+}
+
+//==============================================================================
+void HierarchicalGrid::construct(const AABBox &box,
+                                 const std::vector<std::shared_ptr<Object>> &objects,
+                                 const uint32_t &number_primitives,
+                                 as_construct_info &info) {
+  start_construction();
+
+  // Compute primitives.
+  prepare_primitives(number_primitives, objects);
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  compute_resolution(bbox, primitives.size());
+
+  auto np = static_cast<uint32_t>(primitives.size());
+  reset_mailboxes(np, number_workers());
+
+  // Build the top level like a compact grid; the refined cells aren't
+  // empty, so the distance field stays valid.
+  fill_cells();
+  compute_distances();
+
+  // Refine the overloaded cells; the sub-grids are built in parallel.
+  uint32_t number_cells = this->number_cells();
+  refined.assign(number_cells, kNoSubGrid);
+  sub_grids.clear();
+  sub_cells.clear();
+  for (uint32_t ci = 0; ci < number_cells; ci++) {
+    if (cells[ci + 1] - cells[ci] > max_primitives) {
+      refined[ci] = static_cast<uint32_t>(sub_grids.size());
+      sub_grids.emplace_back();
+    }
+  }
+
+  std::vector<std::vector<uint32_t>> sc(sub_grids.size());
+  std::vector<std::vector<uint32_t>> ol(sub_grids.size());
+  for (uint32_t ci = 0; ci < number_cells; ci++) {
+    if (refined[ci] == kNoSubGrid) continue;
+    uint32_t si = refined[ci];
+    submit_construction_task([this, ci, si, &sc, &ol]() {
+      build_sub_grid(ci, sub_grids[si], sc[si], ol[si]);
+    });
+  }
+  wait_construction_tasks();
+
+  // Gather the object lists of both levels in a single array: the lists of
+  // the top-level cells, which aren't refined, come first and are followed
+  // by the lists of the sub-grids.
+  Buffer<uint32_t> top_cells;
+  top_cells.resize(number_cells + 1);
+  top_cells[0] = 0;
+  for (uint32_t ci = 0; ci < number_cells; ci++) {
+    uint32_t count = (refined[ci] == kNoSubGrid) ? cells[ci + 1] - cells[ci] : 0;
+    top_cells[ci + 1] = top_cells[ci] + count;
+  }
+
+  uint32_t number_references = top_cells[number_cells];
+  size_t number_sub_cells{0};
+  for (uint32_t si = 0; si < sub_grids.size(); si++) {
+    number_references += static_cast<uint32_t>(ol[si].size());
+    number_sub_cells  += sc[si].size();
+  }
+
+  Buffer<uint32_t> lists;
+  lists.resize(number_references);
+  for (uint32_t ci = 0; ci < number_cells; ci++) {
+    if (refined[ci] != kNoSubGrid) continue;
+    std::copy(object_lists.begin() + cells[ci],
+              object_lists.begin() + cells[ci + 1],
+              lists.begin() + top_cells[ci]);
+  }
+
+  uint32_t base = top_cells[number_cells];
+  sub_cells.reserve(number_sub_cells);
+  for (uint32_t si = 0; si < sub_grids.size(); si++) {
+    sub_grids[si].co = static_cast<uint32_t>(sub_cells.size());
+    for (auto const &c : sc[si]) sub_cells.push_back(base + c);
+    std::copy(ol[si].begin(), ol[si].end(), lists.begin() + base);
+    base += static_cast<uint32_t>(ol[si].size());
+  }
+
+  cells        = std::move(top_cells);
+  object_lists = std::move(lists);
+
+  // The triangles are stored in the order of the object lists, so that the
+  // triangles of a cell are adjacent on both levels.
+  fill_triangle_buffer(object_lists.data(), number_references);
+
+  // Gather statistical information over the cells, which hold primitives,
+  // of both levels.
+  auto count_cell = [&info](const uint32_t &number_primitives_in_cell) {
+    if (number_primitives_in_cell > 0) {
+      info.nfc++;
+      info.npnc += number_primitives_in_cell;
+    }
+  };
+  for (uint32_t ci = 0; ci < number_cells; ci++) {
+    count_cell(cells[ci + 1] - cells[ci]);
+  }
+  for (auto const &sg : sub_grids) {
+    for (uint32_t i = sg.co; i < sg.co + sg.g.number_cells(); i++) {
+      count_cell(sub_cells[i + 1] - sub_cells[i]);
+    }
+  }
+  info.npnc /= (1.f * info.nfc);
+  info.r[0] = resolution[0];
+  info.r[1] = resolution[1];
+  info.r[2] = resolution[2];
+  info.nsg  = static_cast<uint32_t>(sub_grids.size());
+
+  finish_construction(info);
+}
+
+//==============================================================================
+void HierarchicalGrid::build_sub_grid(const uint32_t &ci,
+                                      sub_grid &sg,
+                                      std::vector<uint32_t> &sc,
+                                      std::vector<uint32_t> &ol) const {
+  // The bounding box of the refined cell.
+  uint32_t x = ci % resolution[0];
+  uint32_t y = (ci / resolution[0]) % resolution[1];
+  uint32_t z = ci / (resolution[0] * resolution[1]);
+  sg.box.bounds[0] = bbox.bounds[0] + glm::vec4(x, y, z, 0.f) * cellDimension;
+  sg.box.bounds[1] = bbox.bounds[0] + glm::vec4(x + 1, y + 1, z + 1, 0.f) * cellDimension;
+
+  // The resolution follows the density of the primitives inside the cell.
+  uint32_t begin = cells[ci];
+  uint32_t end   = cells[ci + 1];
+  sg.g.set_alpha(alpha);
+  sg.g.set_max_res(maxResolution);
+  sg.g.set_exact_insertion(exact_insertion);
+  sg.g.compute_resolution(sg.box, end - begin);
+
+  // Count the primitives per cell, turn the counts into offsets and fill
+  // the object lists like for the top level.
+  uint32_t number_cells = sg.g.number_cells();
+  std::vector<uint32_t> cell_ranges(6 * static_cast<size_t>(end - begin));
+  sc.assign(number_cells + 1, 0);
+  for (uint32_t j = begin; j < end; j++) {
+    uint32_t *cr = &cell_ranges[6 * (j - begin)];
+    uint32_t min_cell[3], max_cell[3];
+    AABBox pb = primitive_box(primitives[object_lists[j]]);
+    sg.g.compute_primitive_bound_cell(pb.bounds[0], sg.box.bounds[0], min_cell);
+    sg.g.compute_primitive_bound_cell(pb.bounds[1], sg.box.bounds[0], max_cell);
+    std::copy(min_cell, min_cell + 3, cr);
+    std::copy(max_cell, max_cell + 3, cr + 3);
+
+    glm::vec4 v0, v1, v2;
+    bool exact = sg.g.test_cells(cr, cr + 3) &&
+        primitive_triangle(primitives[object_lists[j]], v0, v1, v2);
+    for (uint32_t cz = cr[2]; cz <= cr[5]; ++cz) {
+      for (uint32_t cy = cr[1]; cy <= cr[4]; ++cy) {
+        for (uint32_t cx = cr[0]; cx <= cr[3]; ++cx) {
+          if (exact && !sg.g.triangle_overlaps_cell(cx, cy, cz, sg.box.bounds[0], v0, v1, v2)) continue;
+          sc[sg.g.offset(cx, cy, cz) + 1]++;
+        }
+      }
+    }
+  }
+  for (uint32_t i = 1; i <= number_cells; i++) {
+    sc[i] += sc[i - 1];
+  }
+
+  ol.resize(sc[number_cells]);
+  std::vector<uint32_t> fill(sc.begin(), sc.end() - 1);
+  for (uint32_t j = begin; j < end; j++) {
+    const uint32_t *cr = &cell_ranges[6 * (j - begin)];
+    glm::vec4 v0, v1, v2;
+    bool exact = sg.g.test_cells(cr, cr + 3) &&
+        primitive_triangle(primitives[object_lists[j]], v0, v1, v2);
+    for (uint32_t cz = cr[2]; cz <= cr[5]; ++cz) {
+      for (uint32_t cy = cr[1]; cy <= cr[4]; ++cy) {
+        for (uint32_t cx = cr[0]; cx <= cr[3]; ++cx) {
+          if (exact && !sg.g.triangle_overlaps_cell(cx, cy, cz, sg.box.bounds[0], v0, v1, v2)) continue;
+          ol[fill[sg.g.offset(cx, cy, cz)]++] = object_lists[j];
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+bool HierarchicalGrid::closest_hit(const Ray &r,
+                                   hit_record &hr,
+                                   traversal_info &ti) const {
+  float_t   tBoundingBox;
+  uint64_t  intersected_primitives{1};
+  uint64_t  avoided_tests{0};
+
+  // Check if the ray intersect's the grid at all.
+  if (!bbox.intersect(r, tBoundingBox))
+    return false;
+
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
+
+  uint64_t steps{0};
+  while (true) {
+    uint32_t ci = offset(gt);
+    steps++;
+
+    // Jump across the empty cells around the current cell at once.
+    if (!distances.empty() && distances[ci] > 1) {
+      if (!skip(gt, r, bbox.bounds[0], distances[ci] - 1u, hr.t)) break;
+      continue;
+    }
+
+    if (refined[ci] == kNoSubGrid) {
+      intersect_cell(cells[ci], cells[ci + 1], r, mb, hr, intersected_primitives, avoided_tests);
+    } else {
+      // Traverse the sub-grid from the point, where the ray enters the cell.
+      const sub_grid &sg = sub_grids[refined[ci]];
+      grid_traversal st;
+      sg.g.traversal_initialization(st, r, entry_distance(r, sg.box), sg.box.bounds[0]);
+
+      while (true) {
+        uint32_t sci = sg.co + sg.g.offset(st);
+        intersect_cell(sub_cells[sci], sub_cells[sci + 1], r, mb, hr, intersected_primitives, avoided_tests);
+        if (!sg.g.advance(st, hr.t)) break;
+        steps++;
+      }
+    }
+
+    // Advance the grid.
+    if (!advance(gt, hr.t)) break;
+  }
+
+  STAT_ADD(ti.nrpt, intersected_primitives);
+  STAT_ADD(ti.nmt, avoided_tests);
+  STAT_ADD(ti.nds, steps);
+  return hr.hit();
+}
+
+//==============================================================================
+bool HierarchicalGrid::occluded(const Ray &r,
+                                const float_t &t_max,
+                                traversal_info &ti) const {
+  float_t tBoundingBox;
+
+  // Check if the ray intersect's the grid at all.
+  STAT_ADD(ti.nrpt, 1);
+  if (!bbox.intersect(r, tBoundingBox) || tBoundingBox > t_max)
+    return false;
+
+  grid_traversal gt;
+  traversal_initialization(gt, r, tBoundingBox, bbox.bounds[0]);
+  mailbox &mb = ray_mailbox(ti.w);
+
+  while (true) {
+    uint32_t ci = offset(gt);
+    STAT_ADD(ti.nds, 1);
+
+    if (!distances.empty() && distances[ci] > 1) {
+      if (!skip(gt, r, bbox.bounds[0], distances[ci] - 1u, t_max)) break;
+      continue;
+    }
+
+    if (refined[ci] == kNoSubGrid) {
+      if (occluded_cell(cells[ci], cells[ci + 1], r, t_max, mb, ti)) return true;
+    } else {
+      const sub_grid &sg = sub_grids[refined[ci]];
+      grid_traversal st;
+      sg.g.traversal_initialization(st, r, entry_distance(r, sg.box), sg.box.bounds[0]);
+
+      while (true) {
+        uint32_t sci = sg.co + sg.g.offset(st);
+        if (occluded_cell(sub_cells[sci], sub_cells[sci + 1], r, t_max, mb, ti)) return true;
+        if (!sg.g.advance(st, t_max)) break;
+        STAT_ADD(ti.nds, 1);
+      }
+    }
+
+    // Advance the grid.
+    if (!advance(gt, t_max)) break;
+  }
+
+  return false;
+}
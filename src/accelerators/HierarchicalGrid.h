@@ -0,0 +1,90 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_HIERARCHICALGRID_H
+#define ELUCIDO_HIERARCHICALGRID_H
+
+#include <vector>
+
+#include "CompactGrid.h"
+
+// A grid refining a single cell of the top-level grid.
+struct sub_grid {
+  Grid      g;        // Resolution and cell dimensions of the sub-grid.
+  AABBox    box;      // Bounding box of the refined cell.
+  uint32_t  co{0};    // Offset of the sub-grid's first cell in the cells
+                      // of all sub-grids.
+};
+
+/**
+ * A two-level grid. The top level is a compact grid, whose resolution is
+ * computed for the whole scene; every cell with more than max_primitives
+ * primitives gets its own sub-grid with a resolution computed for the
+ * density inside the cell. Both levels store their cells in the compact
+ * grid's layout: the cells hold offsets into a single array of object
+ * lists. Rays traverse a sub-grid with a nested 3D-DDA, whenever the
+ * traversal of the top level enters a refined cell.
+ */
+class HierarchicalGrid : public CompactGrid {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  HierarchicalGrid() :
+      CompactGrid()
+  {
+    as_type = hierarchical_grid;
+  }
+
+  ~HierarchicalGrid() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  void            construct(const AABBox &box,
+                            const std::vector<std::shared_ptr<Object>> &objects,
+                            const uint32_t &number_primitives,
+                            as_construct_info &info);
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
+
+  // The sub-grids aren't stored in the compact grid's cache format.
+  bool            cache_parameters(std::vector<float_t> &) const { return false; }
+
+  inline void set_max_primitives(const uint32_t &mp) { max_primitives = mp; }
+
+  inline const std::vector<sub_grid> & get_sub_grids() const { return sub_grids; }
+
+ private:
+  /**
+   * Builds the sub-grid over the primitives of the top-level cell ci.
+   * @param ci:     The index of the refined cell.
+   * @param sg:     The sub-grid; its cell offset is not set.
+   * @param sc:     The offsets of the sub-grid's cells into its object
+   *                lists; one past the last cell holds their size.
+   * @param ol:     The object lists of the sub-grid's cells.
+   */
+  void build_sub_grid(const uint32_t &ci,
+                      sub_grid &sg,
+                      std::vector<uint32_t> &sc,
+                      std::vector<uint32_t> &ol) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  std::vector<uint32_t> refined;              // Sub-grid per top-level cell;
+                                              // kNoSubGrid for cells, which
+                                              // aren't refined.
+  std::vector<sub_grid> sub_grids;
+  std::vector<uint32_t> sub_cells;            // Offsets of the sub-grids'
+                                              // cells into the object lists.
+  uint32_t              max_primitives{16};   // Cells with more primitives
+                                              // are refined.
+};
+
+#endif //ELUCIDO_HIERARCHICALGRID_H
@@ -0,0 +1,438 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "KDtree.h"
+#include <algorithm>
+
+#include "ASCache.h"
+
+namespace {
+const uint32_t kMinTaskPrimitives = 4096; // Smaller subtrees are not built in parallel.
+const uint32_t kTasksPerWorker    = 4;    // Subtrees built in parallel per worker.
+
+// A node, which still has to be visited, and the part of the ray inside it.
+struct stack_entry {
+  uint32_t  node;
+  float_t   t_min;
+  float_t   t_max;
+};
+
+/**
+ * Descends from the interior node into its child, which the ray passes
+ * first within [t_min, t_max]. If the ray passes both children, the second
+ * one is pushed onto the stack and t_max is clipped to the node's plane.
+ */
+inline uint32_t descend(const KDNode &node,
+                        const glm::vec4 &o,
+                        const glm::vec4 &id,
+                        float_t &t_min,
+                        float_t &t_max,
+                        stack_entry *stack,
+                        uint32_t &sp) {
+  uint32_t a = node.axis();
+  float_t split = node.split_position();
+  float_t t_plane = (split - o[a]) * id[a];
+  bool left_first = o[a] < split || (o[a] == split && id[a] <= 0.f);
+  uint32_t first  = left_first ? node.left_child() : node.right_child();
+  uint32_t second = left_first ? node.right_child() : node.left_child();
+
+  // The plane lies behind the ray's part inside the node or behind its
+  // origin; only the first child is passed.
+  if (t_plane > t_max || !(t_plane > 0.f)) return first;
+  // The plane lies before the ray's part inside the node.
+  if (t_plane < t_min) return second;
+
+  stack[sp++] = {second, t_plane, t_max};
+  t_max = t_plane;
+  return first;
+}
+}
+
+//==============================================================================
+void KDtree::construct(const AABBox &box,
+                       const std::vector<std::shared_ptr<Object>> &objects,
+                       const uint32_t &number_primitives,
+                       as_construct_info &info) {
+  start_construction();
+
+  // Clear existing nodes.
+  nodes.clear();
+  leaf_primitives.clear();
+  subtrees.clear();
+
+  // Compute primitives.
+  prepare_primitives(number_primitives, objects);
+  auto n = static_cast<uint32_t>(primitives.size());
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  // Compute maximum tree depth according to formula:
+  //  8 + 1.3 * log(N), where N is # of primitives.
+  depth_limit = max_tree_depth;
+  if (depth_limit <= 0) {
+    depth_limit = static_cast<uint32_t>(8.f + 1.3f * glm::log(std::max(n, 1u)));
+  }
+  depth_limit = std::min(depth_limit, kStackSize - 1);
+
+  // The top of the tree is built serially, until the subtrees are small
+  // enough to keep all workers busy.
+  spawn_size = std::max(kMinTaskPrimitives, n / (kTasksPerWorker * number_workers()));
+
+  // The bounding boxes of the primitives are computed once.
+  bounds.resize(n);
+  parallel_for(n, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) bounds[i] = primitive_box(primitives[i]);
+  });
+
+  // Primitives overlapping a splitting plane are appended once more to the
+  // indices, so some room is reserved up front.
+  std::vector<uint32_t> indices(n);
+  for (uint32_t i = 0; i < n; i++) indices[i] = i;
+  indices.reserve(2 * indices.size());
+
+  // Construct tree recursively.
+  build_tree root;
+  build(indices, 0, bbox, 0, root, number_workers() > 1);
+  wait_construction_tasks();
+  std::vector<AABBox>().swap(bounds);
+
+  // Pack the tree together with the subtrees built in parallel into one
+  // array of nodes.
+  size_t number_nodes = root.nodes.size();
+  size_t number_references = root.references.size();
+  for (auto const &st : subtrees) {
+    number_nodes += st.nodes.size() - 1;
+    number_references += st.references.size();
+  }
+  nodes.reserve(number_nodes);
+  leaf_primitives.reserve(number_references);
+
+  nodes.emplace_back();
+  flatten(root, 0, 0);
+  subtrees.clear();
+
+  // Store the triangles of the leaves in the same order in the triangle
+  // buffer.
+  fill_triangle_buffer(leaf_primitives.data(), static_cast<uint32_t>(leaf_primitives.size()));
+
+  gather_info(info);
+  finish_construction(info);
+}
+
+//==============================================================================
+void KDtree::gather_info(as_construct_info &info) const {
+  uint32_t number_leaves{0};
+  for (auto const &node : nodes) {
+    if (node.leaf()) number_leaves++;
+  }
+  auto nr = static_cast<uint32_t>(leaf_primitives.size());
+  info.nn  = static_cast<uint32_t>(nodes.size());
+  info.nl  = number_leaves;
+  info.npl = number_leaves > 0 ? static_cast<float_t>(nr) / number_leaves : 0.f;
+}
+
+//==============================================================================
+bool KDtree::cache_parameters(std::vector<float_t> &p) const {
+  p.push_back(static_cast<float_t>(max_tree_depth));
+  p.push_back(static_cast<float_t>(max_primitives));
+  return true;
+}
+
+//==============================================================================
+void KDtree::write_cache(ASCacheWriter &w) const {
+  w.add(nodes.data(), nodes.size());
+  w.add(leaf_primitives.data(), leaf_primitives.size());
+}
+
+//==============================================================================
+bool KDtree::read_cache(const ASCacheReader &r, as_construct_info &info) {
+  if (r.number_sections() != 2 ||
+      !r.view(0, nodes) || nodes.empty() ||
+      !r.view(1, leaf_primitives) || !valid_tree()) {
+    nodes.clear();
+    leaf_primitives.clear();
+    return false;
+  }
+
+  fill_triangle_buffer(leaf_primitives.data(), static_cast<uint32_t>(leaf_primitives.size()));
+  gather_info(info);
+  return true;
+}
+
+//==============================================================================
+bool KDtree::valid_tree() const {
+  auto nn = static_cast<uint64_t>(nodes.size());
+  auto nr = static_cast<uint64_t>(leaf_primitives.size());
+
+  // Children follow their parents, so a node's depth is known before its
+  // children are checked.
+  std::vector<uint32_t> depth(nodes.size(), 0);
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    const KDNode &node = nodes[i];
+    if (node.leaf()) {
+      if (static_cast<uint64_t>(node.first_primitive()) + node.primitives_size() > nr) return false;
+      continue;
+    }
+    if (node.left_child() <= i || static_cast<uint64_t>(node.right_child()) >= nn ||
+        depth[i] + 1 >= kStackSize) {
+      return false;
+    }
+    for (auto const &c : {node.left_child(), node.right_child()}) {
+      depth[c] = std::max(depth[c], depth[i] + 1);
+    }
+  }
+
+  for (auto const &p : leaf_primitives) {
+    if (p >= primitives.size()) return false;
+  }
+  return true;
+}
+
+//==============================================================================
+uint32_t KDtree::build(std::vector<uint32_t> &indices,
+                       const uint32_t &begin,
+                       const AABBox &node_box,
+                       const uint32_t &depth,
+                       build_tree &out,
+                       const bool &spawn) {
+  auto node_index = static_cast<uint32_t>(out.nodes.size());
+  auto end = static_cast<uint32_t>(indices.size());
+  uint32_t axis{0};
+  float_t position{0.f};
+  uint32_t le{end}, oe{end};
+
+  bool split = end - begin > max_primitives && depth < depth_limit &&
+               find_split(indices, begin, end, node_box, axis, position);
+
+  if (split) {
+    // Partition the range in place into the primitives on the left side of
+    // the plane, the ones overlapping it and the ones on its right side.
+    // Primitives lying in the plane belong to the left side.
+    auto left_end = std::partition(indices.begin() + begin, indices.end(),
+                                   [&](const uint32_t &p) {
+      return bounds[p].bounds[1][axis] <= position;
+    });
+    auto overlap_end = std::partition(left_end, indices.end(),
+                                      [&](const uint32_t &p) {
+      return bounds[p].bounds[0][axis] < position;
+    });
+    le = static_cast<uint32_t>(left_end - indices.begin());
+    oe = static_cast<uint32_t>(overlap_end - indices.begin());
+
+    // A plane overlapping all primitives separates nothing.
+    split = le > begin || oe < end;
+  }
+
+  // Initialize leaf node, if termination criteria are met or no useful
+  // splitting plane is found.
+  if (!split) {
+    build_node node;
+    node.first = static_cast<uint32_t>(out.references.size());
+    node.np    = end - begin;
+    out.references.insert(out.references.end(),
+                          indices.begin() + begin, indices.end());
+    indices.resize(begin);
+    out.nodes.push_back(node);
+    return node_index;
+  }
+
+  // The overlapping primitives are copied behind the right side, so that
+  // both children find their primitives in a contiguous range: the right
+  // child is built over [oe, end) and the copies first, afterwards the left
+  // child over [begin, oe).
+  indices.resize(end + (oe - le));
+  std::copy(indices.begin() + le, indices.begin() + oe, indices.begin() + end);
+
+  // Initialize interior node.
+  build_node node;
+  node.axis  = axis;
+  node.split = position;
+  out.nodes.push_back(node);
+
+  AABBox lbb = node_box, rbb = node_box;
+  lbb.bounds[1][axis] = position;
+  rbb.bounds[0][axis] = position;
+
+  uint32_t right = build_child(indices, oe, rbb, depth + 1, out, spawn);
+  uint32_t left  = build_child(indices, begin, lbb, depth + 1, out, spawn);
+  out.nodes[node_index].left  = left;
+  out.nodes[node_index].right = right;
+  return node_index;
+}
+
+//==============================================================================
+uint32_t KDtree::build_child(std::vector<uint32_t> &indices,
+                             const uint32_t &begin,
+                             const AABBox &node_box,
+                             const uint32_t &depth,
+                             build_tree &out,
+                             const bool &spawn) {
+  // Build the subtree right away.
+  if (!spawn || indices.size() - begin > spawn_size) {
+    return build(indices, begin, node_box, depth, out, spawn);
+  }
+
+  // Hand the subtree over to a construction task, which partitions its own
+  // copy of the range. The subtree is referred to by a placeholder node.
+  build_node node;
+  node.axis  = kSubtreeFlag;
+  node.first = static_cast<uint32_t>(subtrees.size());
+  subtrees.emplace_back();
+  build_tree *st = &subtrees.back();
+
+  auto si = std::make_shared<std::vector<uint32_t>>(indices.begin() + begin,
+                                                    indices.end());
+  indices.resize(begin);
+  submit_construction_task([this, st, si, node_box, depth]() {
+    build(*si, 0, node_box, depth, *st, false);
+  });
+
+  out.nodes.push_back(node);
+  return static_cast<uint32_t>(out.nodes.size() - 1);
+}
+
+//==============================================================================
+void KDtree::flatten(const build_tree &t, const uint32_t &ni, const uint32_t &n) {
+  const build_node &bn = t.nodes[ni];
+
+  if (bn.axis == kSubtreeFlag) {
+    flatten(subtrees[bn.first], 0, n);
+    return;
+  }
+
+  if (bn.axis == KDNode::kLeafFlag) {
+    nodes[n].initialize_leaf(static_cast<uint32_t>(leaf_primitives.size()), bn.np);
+    leaf_primitives.insert(leaf_primitives.end(),
+                           t.references.begin() + bn.first,
+                           t.references.begin() + bn.first + bn.np);
+    return;
+  }
+
+  // Both children are allocated next to each other before descending.
+  auto children = static_cast<uint32_t>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  nodes[n].initialize_interior(bn.axis, bn.split, children);
+  flatten(t, bn.left, children);
+  flatten(t, bn.right, children + 1);
+}
+
+//==============================================================================
+bool KDtree::closest_hit(const Ray &r,
+                         hit_record &hr,
+                         traversal_info &ti) const {
+  uint64_t  intersected_primitives{0};
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  // Clip the ray to the tree's bounding box.
+  float_t t_min, t_max;
+  if (nodes.empty() || !clip_ray(bbox, o, id, hr.t, t_min, t_max))
+    return false;
+
+  stack_entry stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  // The children are visited front to back along the ray; the part of the
+  // ray inside a node is split at the node's plane. The traversal stops as
+  // soon as the closest intersection lies before the next node.
+  while (hr.t >= t_min) {
+    const KDNode &node = nodes[cn];
+
+    if (!node.leaf()) {
+      cn = descend(node, o, id, t_min, t_max, stack, sp);
+      continue;
+    }
+
+    intersect_leaf(node, r, hr);
+    intersected_primitives += node.primitives_size();
+
+    if (sp == 0) break;
+    const stack_entry &e = stack[--sp];
+    cn    = e.node;
+    t_min = e.t_min;
+    t_max = e.t_max;
+  }
+
+  STAT_ADD(ti.nrpt, intersected_primitives);
+  return hr.hit();
+}
+
+//==============================================================================
+bool KDtree::occluded(const Ray &r,
+                      const float_t &t_max,
+                      traversal_info &ti) const {
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  // Nodes behind t_max could not contain an occluder.
+  float_t t0, t1;
+  if (nodes.empty() || !clip_ray(bbox, o, id, t_max, t0, t1))
+    return false;
+
+  stack_entry stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  while (true) {
+    const KDNode &node = nodes[cn];
+
+    if (!node.leaf()) {
+      cn = descend(node, o, id, t0, t1, stack, sp);
+      continue;
+    }
+
+    // Any primitive blocking the ray terminates the traversal.
+    if (occluded_leaf(node, r, t_max, ti)) return true;
+
+    if (sp == 0) break;
+    const stack_entry &e = stack[--sp];
+    cn = e.node;
+    t0 = e.t_min;
+    t1 = e.t_max;
+  }
+
+  return false;
+}
+
+//==============================================================================
+bool KDtree::intersect_leaf(const KDNode &node,
+                            const Ray &r,
+                            hit_record &hr) const {
+  uint32_t ft = node.first_primitive();
+  uint32_t lt = ft + node.primitives_size();
+
+  if (scalar_primitives) {
+    for (uint32_t i = ft; i < lt; i++) {
+      const PrimitiveRef &p = primitives[leaf_primitives[i]];
+      if (!p.in_triangle_buffer()) intersect_primitive(p, r, hr);
+    }
+  }
+
+  triangle_hit th;
+  if (triangles.intersect_range(r, ft, lt, hr.t, th)) {
+    record_hit(th, primitives[leaf_primitives[th.i]], hr);
+  }
+
+  return hr.hit();
+}
+
+//==============================================================================
+bool KDtree::occluded_leaf(const KDNode &node,
+                           const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const {
+  uint32_t ft = node.first_primitive();
+  uint32_t lt = ft + node.primitives_size();
+
+  STAT_ADD(ti.nrpt, node.primitives_size());
+  if (scalar_primitives) {
+    for (uint32_t i = ft; i < lt; i++) {
+      const PrimitiveRef &p = primitives[leaf_primitives[i]];
+      if (!p.in_triangle_buffer() && occluded_primitive(p, r, t_max)) return true;
+    }
+  }
+
+  return triangles.occluded_range(r, ft, lt, t_max);
+}
@@ -0,0 +1,255 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_KDTREE_H
+#define ELUCIDO_KDTREE_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "AccelerationStructure.h"
+#include "AABBox.h"
+
+/**
+ * A node of a kd-tree packed into 8 bytes. The two low bits of flags hold
+ * the split axis of an interior node or 3 for a leaf; the remaining bits
+ * hold the index of an interior node's children, which are stored next to
+ * each other, or the start of a leaf's range in the tree's primitive index
+ * array.
+ */
+struct KDNode {
+//==============================================================================
+// Function declarations
+//==============================================================================
+  inline void initialize_leaf(const uint32_t &first, const uint32_t &n) {
+    np    = n;
+    flags = (first << 2) | kLeafFlag;
+  }
+
+  inline void initialize_interior(const uint32_t &axis,
+                                  const float_t &position,
+                                  const uint32_t &children) {
+    split = position;
+    flags = (children << 2) | axis;
+  }
+
+  inline bool leaf() const { return (flags & 3u) == kLeafFlag; }
+  inline uint32_t axis() const { return flags & 3u; }
+  inline float_t split_position() const { return split; }
+
+  // The left child is stored at the returned index, the right child next
+  // to it.
+  inline uint32_t left_child() const { return flags >> 2; }
+  inline uint32_t right_child() const { return (flags >> 2) + 1; }
+
+  // The leaf's primitives are stored from the returned index on in the
+  // tree's primitive index array and in its triangle buffer.
+  inline uint32_t first_primitive() const { return flags >> 2; }
+  inline uint32_t primitives_size() const { return np; }
+
+  static const uint32_t kLeafFlag = 3;
+
+//==============================================================================
+// Data members
+//==============================================================================
+  union {
+    float_t   split;  // Interior: position of the splitting plane.
+    uint32_t  np;     // Leaf: number of primitives.
+  };
+  uint32_t    flags;  // Axis or leaf flag and the index of the children
+                      // or of the first primitive.
+};
+
+static_assert(sizeof(KDNode) == 8, "KDNode should be 8 bytes large.");
+
+/**
+ * Slab test of a ray with a bounding box in the interval [0, t_max].
+ * @param t_entry:  The distance at which the ray enters the box.
+ * @param t_exit:   The distance at which the ray leaves the box; at most
+ *                  t_max.
+ */
+inline bool clip_ray(const AABBox &b,
+                     const glm::vec4 &o,
+                     const glm::vec4 &id,
+                     const float_t &t_max,
+                     float_t &t_entry,
+                     float_t &t_exit) {
+  float_t tmin = 0.f, tmax = t_max;
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t t0 = (b.bounds[0][a] - o[a]) * id[a];
+    float_t t1 = (b.bounds[1][a] - o[a]) * id[a];
+    if (id[a] < 0.f) std::swap(t0, t1);
+    tmin = t0 > tmin ? t0 : tmin;
+    tmax = t1 < tmax ? t1 : tmax;
+    if (tmin > tmax) return false;
+  }
+  t_entry = tmin;
+  t_exit  = tmax;
+  return true;
+}
+
+/**
+ * A kd-tree, whose nodes are split by axis-aligned planes. Primitives
+ * overlapping a splitting plane are referenced by both children. The tree
+ * is built over a single array of primitive indices, which is partitioned
+ * in place; the trees differ only in how they choose the splitting planes.
+ */
+class KDtree : public AccelerationStructure {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  KDtree() :
+    AccelerationStructure(),
+    nodes()
+  {}
+
+  virtual ~KDtree() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  void            construct(const AABBox &box,
+                            const std::vector<std::shared_ptr<Object>> &objects,
+                            const uint32_t &number_primitives,
+                            as_construct_info &info);
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
+
+  inline void set_max_depth(const uint32_t &d) { max_tree_depth = d; }
+  inline void set_max_primitives(const uint32_t &mp) { max_primitives = mp; }
+
+  bool            cache_parameters(std::vector<float_t> &p) const;
+  void            write_cache(ASCacheWriter &w) const;
+  bool            read_cache(const ASCacheReader &r, as_construct_info &info);
+
+  inline const Buffer<KDNode> & get_nodes() const { return nodes; }
+  inline const Buffer<uint32_t> & get_leaf_primitives() const {
+    return leaf_primitives;
+  }
+
+  // The traversals push at most one node per level onto their stacks.
+  static const uint32_t kStackSize = 64;
+
+ protected:
+  /**
+   * Writes the number of nodes and leaves into info.
+   */
+  void gather_info(as_construct_info &info) const;
+
+  /**
+   * Chooses the splitting plane for the primitives with indices in
+   * [begin, end), which overlap the region node_box.
+   * @param indices:  The primitive indices.
+   * @param axis:     The axis perpendicular to the splitting plane.
+   * @param position: The position of the splitting plane along the axis.
+   * @return:         False, if the node should become a leaf.
+   */
+  virtual bool find_split(const std::vector<uint32_t> &indices,
+                          const uint32_t &begin,
+                          const uint32_t &end,
+                          const AABBox &node_box,
+                          uint32_t &axis,
+                          float_t &position) const = 0;
+
+ private:
+  // A node of the tree during the construction.
+  struct build_node {
+    uint32_t  axis{KDNode::kLeafFlag};  // Split axis; kLeafFlag for leaves,
+                                        // kSubtreeFlag for subtrees built
+                                        // in parallel.
+    float_t   split{0.f};               // Position of the splitting plane.
+    uint32_t  left{0};                  // Interior: index of the left child.
+    uint32_t  right{0};                 // Interior: index of the right child.
+    uint32_t  first{0};                 // Leaf: start of the range in the
+                                        // references; subtree: its index.
+    uint32_t  np{0};                    // Leaf: number of primitives.
+  };
+
+  // The nodes and the leaves' primitive indices of a (sub)tree.
+  struct build_tree {
+    std::vector<build_node> nodes;
+    std::vector<uint32_t>   references;
+  };
+
+  static const uint32_t kSubtreeFlag = 4;
+
+  /**
+   * Builds the subtree over the primitives, whose indices are stored from
+   * begin to the end of the indices, and appends it to out. The range is
+   * partitioned in place; primitives overlapping the splitting plane are
+   * appended a second time for the right child. The range is removed from
+   * the indices before returning.
+   * @param indices:  The primitive indices; the range is at their end.
+   * @param begin:    Start of the range in the primitive indices.
+   * @param node_box: The region of space covered by the node.
+   * @param depth:    The depth of the node in the tree.
+   * @param out:      The subtree is appended to out.
+   * @param spawn:    Build small enough subtrees in parallel.
+   * @return:         The index of the subtree's root node in out.
+   */
+  uint32_t build(std::vector<uint32_t> &indices,
+                 const uint32_t &begin,
+                 const AABBox &node_box,
+                 const uint32_t &depth,
+                 build_tree &out,
+                 const bool &spawn);
+
+  /**
+   * Builds a subtree either right away or by a construction task; see
+   * build.
+   */
+  uint32_t build_child(std::vector<uint32_t> &indices,
+                       const uint32_t &begin,
+                       const AABBox &node_box,
+                       const uint32_t &depth,
+                       build_tree &out,
+                       const bool &spawn);
+
+  /**
+   * Checks that the children of every node are stored after it, that the
+   * tree isn't deeper than the traversal stacks and that the leaves only
+   * refer to existing primitives; used for trees read from a cache file.
+   */
+  bool valid_tree() const;
+
+  /**
+   * Packs the subtree of the node ni of t into the node n and appends the
+   * packed descendants and the leaves' primitive indices.
+   */
+  void flatten(const build_tree &t, const uint32_t &ni, const uint32_t &n);
+
+  /**
+   * Intersects the ray with the primitives of the leaf node.
+   */
+  bool intersect_leaf(const KDNode &node, const Ray &r, hit_record &hr) const;
+  bool occluded_leaf(const KDNode &node,
+                     const Ray &r,
+                     const float_t &t_max,
+                     traversal_info &ti) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ protected:
+  std::vector<AABBox>     bounds;               // Bounding boxes of the primitives;
+                                                // only used during the construction.
+  uint32_t                max_tree_depth{0};
+  uint32_t                max_primitives{10};
+
+ private:
+  Buffer<KDNode>          nodes;                // Siblings are stored next to each other.
+  Buffer<uint32_t>        leaf_primitives;      // Primitive indices of all leaves.
+  std::deque<build_tree>  subtrees;             // Subtrees built by construction tasks.
+  uint32_t                spawn_size{0};        // Subtrees with at most spawn_size
+                                                // primitives are built in parallel.
+  uint32_t                depth_limit{0};       // Depth limit of the current construction.
+};
+
+#endif //ELUCIDO_KDTREE_H
@@ -2,152 +2,58 @@
 // Author: Haralambi Todorov <harrytodorov@gmail.com>
 
 #include "KDtreeMidpoint.h"
-#include <deque>
 
-//==============================================================================
-bool KDtreeMidpoint::traverse(const Ray &r, isect_info &ii) const {
-  // Scalar distance from the ray's origin to the nearest hit point of
-  // the ray with the tree.
-  float_t   tBoundingBox;
-  uint64_t  intersected_primitives{0};
-
-  // Check if the ray intersect's the tree at all.
-  if (!bbox.intersect(r, tBoundingBox))
-    return false;
-
-  // Reset the intersection information.
-  ii = isect_info();
-
-  // Initially put just the root node of the tree.
-  std::deque<uint32_t> nodes_to_intersect = {0};
-
-  bool intersected = false;
-
-  while (!nodes_to_intersect.empty()) {
-    uint32_t cn = nodes_to_intersect.front();
-    nodes_to_intersect.pop_front();
-
-    // Process leaf node.
-    if (nodes[cn]->leaf()) {
-      if (nodes[cn]->intersect(r, ii)) {
-        intersected = true;
-      }
-      intersected_primitives += nodes[cn]->primitives_size();
-    // Process interior node.
-    } else {
-      if (nodes[cn]->box().intersect(r)) {
-        nodes_to_intersect.push_back(nodes[cn]->left_child());
-        nodes_to_intersect.push_back(nodes[cn]->right_child());
-      }
-    }
-  }
-
-  ii.nrpt = intersected_primitives;
-  return intersected;
-}
-
-//==============================================================================
-void KDtreeMidpoint::construct(const AABBox &box,
-                       const std::vector<std::shared_ptr<Object>> &objects,
-                       const uint32_t &number_primitives,
-                       as_construct_info &info) {
-
-  // Compute primitives.
-  compute_primitives(number_primitives, objects);
-
-  bbox.bounds[0] = box.bounds[0];
-  bbox.bounds[1] = box.bounds[1];
-
-  // Compute maximum tree depth according to formula:
-  //  8 + 1.3 * log(N), where N is # of primitives.
-  if (max_tree_depth <= 0) {
-    max_tree_depth = static_cast<uint32_t>(8.f +
-        1.3f * glm::log(number_primitives));
-  }
-
-  // Clear existing nodes.
-  if (!nodes.empty()) {
-    nodes.clear();
-    next_free_position = 0;
-  }
-
-  // Reserve space for nodes.
-  auto max_number_nodes = static_cast<size_t>(glm::pow(2, max_tree_depth + 1));
-  nodes.reserve(max_number_nodes - 1);
-
-  // Construct tree recursively.
-  build_node(primitives, bbox, 0);
-
-  // Free unused space for nodes.
-  nodes.shrink_to_fit();
+namespace {
+const float_t kEmptyRatio = 0.1f;
 }
 
 //==============================================================================
-void KDtreeMidpoint::build_node(const std::vector<Primitive> &overlapping_primitives,
-                                const AABBox &overlapping_box,
-                                const uint32_t &depth) {
-  // Initialize leaf node, if termination criteria are met.
-  if (overlapping_primitives.size() <= max_primitves ||
-      depth == max_tree_depth) {
-    std::unique_ptr<KDNode> node(new KDNode());
-    node->initialize_leaf(overlapping_primitives);
-    nodes.push_back(std::move(node));
-    next_free_position++;
-    return;
-  }
-
-  // Compute midpoint of overlapping primitives.
+bool KDtreeMidpoint::find_split(const std::vector<uint32_t> &indices,
+                                const uint32_t &begin,
+                                const uint32_t &end,
+                                const AABBox &node_box,
+                                uint32_t &axis,
+                                float_t &position) const {
+  // Compute midpoint and the bounding box of the overlapping primitives
+  // inside the node.
   glm::vec4 midpoint{0.f};
-  for (auto const &primitive : overlapping_primitives) {
-    midpoint += primitive.centroid();
-  }
-  midpoint /= static_cast<float_t>(overlapping_primitives.size());
-
-  std::vector<Primitive> opl;
-  std::vector<Primitive> opr;
-  Axis split_axis = overlapping_box.longestAxis();
-
-  // Classify primitives with respect to split axis.
-  for (auto const &p : overlapping_primitives) {
-    switch (split_axis) {
-      case Axis::X :
-        (midpoint.x >= p.centroid().x) ? opr.push_back(p) : opl.push_back(p);
-        break;
-
-      case Axis::Y :
-        (midpoint.y >= p.centroid().y) ? opr.push_back(p) : opl.push_back(p);
-        break;
-
-      case Axis::Z :
-        (midpoint.z >= p.centroid().z) ? opr.push_back(p) : opl.push_back(p);
-        break;
-
-      default: break;
+  AABBox overlapping_box;
+  for (uint32_t i = begin; i < end; i++) {
+    midpoint += primitive_centroid(primitives[indices[i]]);
+    const AABBox &pb = bounds[indices[i]];
+    overlapping_box.extend_by(glm::max(pb.bounds[0], node_box.bounds[0]));
+    overlapping_box.extend_by(glm::min(pb.bounds[1], node_box.bounds[1]));
+  }
+  midpoint /= static_cast<float_t>(end - begin);
+
+  // Cut off large empty parts of the node first.
+  glm::vec4 extent = node_box.bounds[1] - node_box.bounds[0];
+  for (uint32_t a = 0; a < 3; a++) {
+    if (overlapping_box.bounds[0][a] - node_box.bounds[0][a] > kEmptyRatio * extent[a]) {
+      axis     = a;
+      position = overlapping_box.bounds[0][a];
+      return true;
+    }
+    if (node_box.bounds[1][a] - overlapping_box.bounds[1][a] > kEmptyRatio * extent[a]) {
+      axis     = a;
+      position = overlapping_box.bounds[1][a];
+      return true;
     }
   }
 
-  // Initialize interior node.
-  std::unique_ptr<KDNode> node(new KDNode());
-  node->initialize_interior(overlapping_box);
-  nodes.push_back(std::move(node));
-  uint32_t parent_node_position = next_free_position;
-  next_free_position++;
+  axis     = static_cast<uint32_t>(node_box.longestAxis());
+  position = midpoint[axis];
 
-  // Compute bounding box for left child and recursively initialize the node.
-  AABBox lbb;
-  for (auto const &p : opl) {
-    lbb.extend_by(p.getBB().bounds[0]);
-    lbb.extend_by(p.getBB().bounds[1]);
-  }
-  nodes[parent_node_position]->set_left_child(next_free_position);
-  build_node(opl, lbb, depth + 1);
+  // A plane on the node's border doesn't split it.
+  if (!(position > node_box.bounds[0][axis] &&
+        position < node_box.bounds[1][axis])) return false;
 
-  // Compute bounding box for right child and recursively initialize the node.
-  AABBox rbb;
-  for (auto const &p : opr) {
-    rbb.extend_by(p.getBB().bounds[0]);
-    rbb.extend_by(p.getBB().bounds[1]);
+  // Splitting pays off only, if both children lose some of the primitives.
+  uint32_t nl{0}, nr{0};
+  for (uint32_t i = begin; i < end; i++) {
+    const AABBox &pb = bounds[indices[i]];
+    if (pb.bounds[1][axis] <= position) nl++;
+    else if (pb.bounds[0][axis] >= position) nr++;
   }
-  nodes[parent_node_position]->set_right_child(next_free_position);
-  build_node(opr, rbb, depth + 1);
+  return nl > 0 && nr > 0;
 }
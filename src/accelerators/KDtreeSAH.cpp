@@ -0,0 +1,81 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "KDtreeSAH.h"
+#include <algorithm>
+
+namespace {
+const uint32_t kNumberBins  = 32;   // Number of bins per axis for the SAH.
+const float_t  kEmptyBonus  = 0.2f; // Discount for splits cutting off empty space.
+
+inline float_t surface_area(const glm::vec4 &e) {
+  return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+inline uint32_t bin_index(const float_t &c,
+                          const float_t &cmin,
+                          const float_t &inv_bin_size) {
+  float_t b = (c - cmin) * inv_bin_size;
+  if (!(b > 0.f)) return 0;
+  return std::min(static_cast<uint32_t>(b), kNumberBins - 1);
+}
+}
+
+//==============================================================================
+bool KDtreeSAH::find_split(const std::vector<uint32_t> &indices,
+                           const uint32_t &begin,
+                           const uint32_t &end,
+                           const AABBox &node_box,
+                           uint32_t &axis,
+                           float_t &position) const {
+  glm::vec4 extent = node_box.bounds[1] - node_box.bounds[0];
+  float_t node_area = surface_area(extent);
+  if (!(node_area > 0.f)) return false;
+
+  uint32_t n = end - begin;
+  float_t inv_node_area = 1.f / node_area;
+  float_t best_cost = intersection_cost * n;
+  bool found{false};
+
+  for (uint32_t a = 0; a < 3; a++) {
+    if (!(extent[a] > 0.f)) continue;
+
+    // Count the primitives starting and ending in every bin.
+    uint32_t starts[kNumberBins] = {0};
+    uint32_t ends[kNumberBins]   = {0};
+    float_t cmin = node_box.bounds[0][a];
+    float_t inv_bin_size = kNumberBins / extent[a];
+    for (uint32_t i = begin; i < end; i++) {
+      const AABBox &pb = bounds[indices[i]];
+      starts[bin_index(pb.bounds[0][a], cmin, inv_bin_size)]++;
+      ends[bin_index(pb.bounds[1][a], cmin, inv_bin_size)]++;
+    }
+
+    // Sweep the planes between the bins. Primitives starting left of the
+    // plane are in the left child, the ones ending right of it in the right
+    // child.
+    uint32_t nl{0}, nr{n};
+    for (uint32_t k = 1; k < kNumberBins; k++) {
+      nl += starts[k - 1];
+      nr -= ends[k - 1];
+
+      float_t p = cmin + k * extent[a] / kNumberBins;
+      glm::vec4 le = extent, re = extent;
+      le[a] = p - cmin;
+      re[a] = node_box.bounds[1][a] - p;
+
+      float_t cost = traversal_cost + intersection_cost *
+          (surface_area(le) * nl + surface_area(re) * nr) * inv_node_area;
+      if (nl == 0 || nr == 0) cost *= 1.f - kEmptyBonus;
+
+      if (cost < best_cost) {
+        best_cost = cost;
+        axis      = a;
+        position  = p;
+        found     = true;
+      }
+    }
+  }
+
+  return found;
+}
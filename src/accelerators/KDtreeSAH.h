@@ -0,0 +1,61 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_KDTREESAH_H
+#define ELUCIDO_KDTREESAH_H
+
+#include <vector>
+
+#include "KDtree.h"
+
+/**
+ * A kd-tree, whose splitting planes are chosen with the binned surface area
+ * heuristic.
+ */
+class KDtreeSAH : public KDtree {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  KDtreeSAH() :
+    KDtree()
+  {
+    as_type = kdtree_sah;
+  }
+
+  ~KDtreeSAH() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  inline void set_traversal_cost(const float_t &c) { traversal_cost = c; }
+  inline void set_intersection_cost(const float_t &c) { intersection_cost = c; }
+
+  inline bool cache_parameters(std::vector<float_t> &p) const {
+    p.push_back(traversal_cost);
+    p.push_back(intersection_cost);
+    return KDtree::cache_parameters(p);
+  }
+
+ protected:
+  /**
+   * Finds the splitting plane with the lowest cost for the primitives with
+   * indices in [begin, end).
+   * @return: False, if no split is cheaper than creating a leaf.
+   */
+  bool find_split(const std::vector<uint32_t> &indices,
+                  const uint32_t &begin,
+                  const uint32_t &end,
+                  const AABBox &node_box,
+                  uint32_t &axis,
+                  float_t &position) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  float_t traversal_cost{1.f};    // Cost of traversing a node.
+  float_t intersection_cost{2.f}; // Cost of intersecting a primitive.
+};
+
+#endif //ELUCIDO_KDTREESAH_H
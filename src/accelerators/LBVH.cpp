@@ -0,0 +1,232 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "LBVH.h"
+
+#include <algorithm>
+
+namespace {
+const uint32_t kMortonBits        = 10;   // Bits per axis of the Morton codes.
+const uint32_t kRadixBits         = 10;   // Bits sorted per pass of the radix sort.
+const uint32_t kRadixPasses       = 3;    // Passes needed to sort 30-bit codes.
+const uint32_t kNumberBuckets     = 1u << kRadixBits;
+const uint32_t kMaxLeafPrimitives = 255;  // Leaves never hold more primitives.
+
+/**
+ * Spreads the lower 10 bits of v, so that two zero bits follow each of them.
+ */
+inline uint32_t expand_bits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+/**
+ * Computes the 30-bit Morton code of a point given in coordinates
+ * normalized to [0, 1]; the x-coordinate ends up in the most significant
+ * bit of every triple.
+ */
+inline uint32_t morton_code(const glm::vec4 &p) {
+  const float_t cells = static_cast<float_t>(1u << kMortonBits);
+  uint32_t code{0};
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t c = std::min(std::max(p[a] * cells, 0.f), cells - 1.f);
+    code |= expand_bits(static_cast<uint32_t>(c)) << (2 - a);
+  }
+  return code;
+}
+
+inline uint32_t code_of(const uint64_t &key) {
+  return static_cast<uint32_t>(key >> 32);
+}
+
+inline uint32_t index_of(const uint64_t &key) {
+  return static_cast<uint32_t>(key & 0xFFFFFFFFu);
+}
+}
+
+//==============================================================================
+void LBVH::construct(const AABBox &box,
+                     const std::vector<std::shared_ptr<Object>> &objects,
+                     const uint32_t &number_primitives,
+                     as_construct_info &info) {
+  start_construction();
+
+  // Compute primitives.
+  prepare_primitives(number_primitives, objects);
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  nodes.clear();
+  if (primitives.empty()) {
+    triangles.resize(0);
+    built_node_area = 0.f;
+    gather_info(info);
+    finish_construction(info);
+    return;
+  }
+
+  // Bounding boxes and centroids are computed once for all primitives; the
+  // bounds of the centroids are reduced per chunk.
+  auto np = static_cast<uint32_t>(primitives.size());
+  std::vector<AABBox> bounds(np);
+  std::vector<glm::vec4> centroids(np);
+  std::vector<AABBox> chunk_bounds(number_workers());
+  parallel_for(np, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      bounds[i]    = primitive_box(primitives[i]);
+      centroids[i] = primitive_centroid(primitives[i]);
+      chunk_bounds[c].extend_by(centroids[i]);
+    }
+  });
+
+  AABBox centroid_box;
+  for (auto const &cb : chunk_bounds) {
+    centroid_box.extend_by(cb.bounds[0]);
+    centroid_box.extend_by(cb.bounds[1]);
+  }
+
+  // Quantize the centroids inside their bounds; flat axes get a zero code.
+  glm::vec4 cmin = centroid_box.bounds[0];
+  glm::vec4 inv_extent(0.f);
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t extent = centroid_box.bounds[1][a] - cmin[a];
+    if (extent > 0.f) inv_extent[a] = 1.f / extent;
+  }
+
+  std::vector<uint64_t> keys(np);
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      uint64_t code = morton_code((centroids[i] - cmin) * inv_extent);
+      keys[i] = (code << 32) | i;
+    }
+  });
+
+  sort_keys(keys);
+
+  // A binary tree with N leaves has 2N - 1 nodes.
+  nodes.reserve(2 * np - 1);
+  emit_node(keys, bounds, 0, np);
+  nodes.shrink_to_fit();
+
+  // Reorder the primitives along the curve, so that the primitives of each
+  // leaf are consecutive; the triangle buffer is stored in the same order.
+  std::vector<PrimitiveRef> ordered_primitives(np);
+  triangles.resize(np);
+  parallel_for(np, [&](const uint32_t &, const uint32_t &b, const uint32_t &e) {
+    for (uint32_t i = b; i < e; i++) {
+      ordered_primitives[i] = primitives[index_of(keys[i])];
+      set_triangle(ordered_primitives[i], i);
+    }
+  });
+  primitives.swap(ordered_primitives);
+
+  built_node_area = node_area();
+  gather_info(info);
+
+  finish_construction(info);
+}
+
+//==============================================================================
+void LBVH::sort_keys(std::vector<uint64_t> &keys) {
+  auto n  = static_cast<uint32_t>(keys.size());
+  uint32_t nc = number_workers();
+
+  std::vector<uint64_t> sorted(n);
+  std::vector<uint32_t> offsets(nc * kNumberBuckets);
+
+  for (uint32_t pass = 0; pass < kRadixPasses; pass++) {
+    uint32_t shift = 32 + pass * kRadixBits;
+    auto digit = [shift](const uint64_t &key) {
+      return static_cast<uint32_t>(key >> shift) & (kNumberBuckets - 1);
+    };
+
+    // Count the digits per chunk.
+    std::fill(offsets.begin(), offsets.end(), 0);
+    parallel_for(n, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+      uint32_t *count = &offsets[c * kNumberBuckets];
+      for (uint32_t i = b; i < e; i++) count[digit(keys[i])]++;
+    });
+
+    // Every chunk scatters its keys of a bucket behind the ones of the
+    // previous chunks, which keeps the sort stable.
+    uint32_t sum{0};
+    for (uint32_t d = 0; d < kNumberBuckets; d++) {
+      for (uint32_t c = 0; c < nc; c++) {
+        uint32_t count = offsets[c * kNumberBuckets + d];
+        offsets[c * kNumberBuckets + d] = sum;
+        sum += count;
+      }
+    }
+
+    parallel_for(n, [&](const uint32_t &c, const uint32_t &b, const uint32_t &e) {
+      uint32_t *offset = &offsets[c * kNumberBuckets];
+      for (uint32_t i = b; i < e; i++) sorted[offset[digit(keys[i])]++] = keys[i];
+    });
+    keys.swap(sorted);
+  }
+}
+
+//==============================================================================
+uint32_t LBVH::emit_node(const std::vector<uint64_t> &keys,
+                         const std::vector<AABBox> &bounds,
+                         const uint32_t &begin,
+                         const uint32_t &end) {
+  auto node_index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+
+  uint32_t n = end - begin;
+  if (n <= std::min(max_primitives, kMaxLeafPrimitives)) {
+    AABBox leaf_box;
+    for (uint32_t i = begin; i < end; i++) {
+      leaf_box.extend_by(bounds[index_of(keys[i])].bounds[0]);
+      leaf_box.extend_by(bounds[index_of(keys[i])].bounds[1]);
+    }
+    for (uint32_t a = 0; a < 3; a++) {
+      nodes[node_index].bmin[a] = leaf_box.bounds[0][a];
+      nodes[node_index].bmax[a] = leaf_box.bounds[1][a];
+    }
+    nodes[node_index].offset = begin;
+    nodes[node_index].np     = static_cast<uint16_t>(n);
+    return node_index;
+  }
+
+  // The codes in the range share all bits above the highest differing bit
+  // of its first and last code, so the range is split where this bit is
+  // set for the first time. Every third bit of a code belongs to the same
+  // axis, starting with x at the most significant one.
+  uint32_t first = code_of(keys[begin]);
+  uint32_t last  = code_of(keys[end - 1]);
+  uint32_t mid   = begin + n / 2;
+  uint32_t axis  = 0;
+  if (first != last) {
+    auto bit = static_cast<uint32_t>(31 - __builtin_clz(first ^ last));
+    uint32_t mask = 1u << bit;
+    mid = static_cast<uint32_t>(
+        std::partition_point(keys.begin() + begin,
+                             keys.begin() + end,
+                             [mask](const uint64_t &key) {
+                               return (code_of(key) & mask) == 0;
+                             }) - keys.begin());
+    axis = 2 - bit % 3;
+  }
+
+  // The first child follows its parent directly.
+  nodes[node_index].np   = 0;
+  nodes[node_index].axis = static_cast<uint8_t>(axis);
+  emit_node(keys, bounds, begin, mid);
+  uint32_t second_child = emit_node(keys, bounds, mid, end);
+
+  BVHNode &node = nodes[node_index];
+  const BVHNode &first_node = nodes[node_index + 1];
+  const BVHNode &second_node = nodes[second_child];
+  node.offset = second_child;
+  for (uint32_t a = 0; a < 3; a++) {
+    node.bmin[a] = std::min(first_node.bmin[a], second_node.bmin[a]);
+    node.bmax[a] = std::max(first_node.bmax[a], second_node.bmax[a]);
+  }
+  return node_index;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_LBVH_H
+#define ELUCIDO_LBVH_H
+
+#include <vector>
+
+#include "BVH.h"
+
+/**
+ * A linear bounding volume hierarchy. The primitives are sorted along a
+ * Z-order curve by the 30-bit Morton codes of their centroids and the
+ * hierarchy is emitted in a single pass over the sorted codes, splitting
+ * every range where its codes first differ. The construction is much faster
+ * than the one with the surface area heuristic at the cost of a worse tree;
+ * traversal, refitting and the node layout are the ones of the BVH.
+ */
+class LBVH : public BVH {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  LBVH() : BVH() {
+    as_type = lbvh;
+  }
+
+  ~LBVH() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  void            construct(const AABBox &box,
+                            const std::vector<std::shared_ptr<Object>> &objects,
+                            const uint32_t &number_primitives,
+                            as_construct_info &info);
+
+ private:
+  /**
+   * Sorts the keys by their upper 32 bits, which hold the Morton code of a
+   * primitive; the lower 32 bits hold the primitive's index. The keys are
+   * sorted with a parallel least significant digit radix sort, which is
+   * stable, so primitives with the same code keep their order.
+   * @param keys: The keys to sort.
+   */
+  void sort_keys(std::vector<uint64_t> &keys);
+
+  /**
+   * Appends the subtree over the sorted keys in [begin, end) to the node
+   * array in depth-first order. The range is split at its highest differing
+   * bit of the Morton codes, or in the middle, if all codes are equal.
+   * @param keys:   The sorted keys of the primitives.
+   * @param bounds: Bounding boxes of the primitives by their index.
+   * @param begin:  Start of the range in the keys.
+   * @param end:    One past the end of the range in the keys.
+   * @return:       The index of the subtree's root node.
+   */
+  uint32_t emit_node(const std::vector<uint64_t> &keys,
+                     const std::vector<AABBox> &bounds,
+                     const uint32_t &begin,
+                     const uint32_t &end);
+};
+
+#endif //ELUCIDO_LBVH_H
@@ -0,0 +1,282 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "TwoLevel.h"
+
+#include <algorithm>
+
+namespace {
+const uint32_t kStackSize = 64; // Bounds the depth of the top-level tree.
+
+/**
+ * Slab test of a ray with the bounding box of a node in the interval
+ * [0, t_max].
+ */
+inline bool intersect_node(const BVHNode &n,
+                           const glm::vec4 &o,
+                           const glm::vec4 &id,
+                           const float_t &t_max) {
+  float_t tmin = 0.f, tmax = t_max;
+  for (uint32_t a = 0; a < 3; a++) {
+    float_t t0 = (n.bmin[a] - o[a]) * id[a];
+    float_t t1 = (n.bmax[a] - o[a]) * id[a];
+    if (id[a] < 0.f) std::swap(t0, t1);
+    tmin = t0 > tmin ? t0 : tmin;
+    tmax = t1 < tmax ? t1 : tmax;
+    if (tmin > tmax) return false;
+  }
+  return true;
+}
+}
+
+//==============================================================================
+void TwoLevel::construct(const AABBox &box,
+                         const std::vector<std::shared_ptr<Object>> &objects,
+                         const uint32_t &,
+                         as_construct_info &info) {
+  start_construction();
+
+  bbox.bounds[0] = box.bounds[0];
+  bbox.bounds[1] = box.bounds[1];
+
+  // The objects are referred to by the instances; the triangles of the
+  // meshes are only stored by the bottom-level hierarchies.
+  object_table = objects;
+  primitives.clear();
+  instances.clear();
+  nodes.clear();
+
+  // Drop the hierarchies of meshes, which were removed from the scene.
+  std::unordered_map<const void *, bottom_level> used;
+  uint32_t number_built{0};
+
+  for (uint32_t oi = 0; oi < objects.size(); oi++) {
+    instance in;
+    in.p = PrimitiveRef(objects[oi]->object_type(), oi, 0);
+
+    if (objects[oi]->object_type() != triangle_mesh) {
+      in.box = objects[oi]->bounding_box();
+      instances.push_back(in);
+      continue;
+    }
+
+    auto mesh = std::static_pointer_cast<TriangleMesh>(objects[oi]);
+    if (mesh->nt == 0) continue;
+
+    // The hierarchy of a mesh is built in the space of its vertices and
+    // reused, as long as the mesh is only transformed; the placements of an
+    // instanced mesh share one hierarchy.
+    const void *key = mesh->geometry_key();
+    auto bl = bottom_levels.find(key);
+    if (bl == bottom_levels.end() || bl->second.nt != mesh->nt) {
+      bottom_level b;
+      b.bvh = std::make_shared<BVH>();
+      b.bvh->set_thread_pool(thread_pool);
+      if (max_primitives != 0) b.bvh->set_max_primitives(max_primitives);
+
+      // The vertices of an instanced mesh are in the space of the shared
+      // asset; the hierarchy is built over an unplaced copy of the mesh.
+      b.mesh = objects[oi];
+      if (mesh->ins) {
+        auto local = std::make_shared<TriangleMesh>(*mesh);
+        local->set_placement(glm::mat4(1.f));
+        b.mesh = local;
+      } else {
+        b.gt = mesh->gt;
+      }
+
+      as_construct_info bi;
+      b.bvh->construct(b.mesh->bounding_box(), {b.mesh}, mesh->nt, bi);
+      b.nt = mesh->nt;
+      bottom_levels[key] = b;
+      bl = bottom_levels.find(key);
+      number_built++;
+    }
+    used.insert(*bl);
+
+    // The mesh's transformations since the construction of its hierarchy
+    // move the hierarchy into world space.
+    const bottom_level &b = bl->second;
+    glm::mat4 otw = mesh->gt * glm::inverse(b.gt);
+    const BVHNode &root = b.bvh->get_nodes()[0];
+
+    in.wto  = glm::inverse(otw);
+    in.blas = b.bvh.get();
+    in.box  = AABBox(glm::vec4(root.bmin[0], root.bmin[1], root.bmin[2], 1.f),
+                     glm::vec4(root.bmax[0], root.bmax[1], root.bmax[2], 1.f)).transformed(otw);
+    in.fp   = glm::determinant(glm::mat3(otw)) < 0.f;
+    instances.push_back(in);
+  }
+  bottom_levels.swap(used);
+
+  // Build the top level over the instances.
+  if (!instances.empty()) {
+    nodes.reserve(2 * instances.size() - 1);
+    build_node(0, static_cast<uint32_t>(instances.size()));
+  }
+
+  info.nn  = static_cast<uint32_t>(nodes.size());
+  info.nl  = static_cast<uint32_t>(instances.size());
+  info.npl = 1.f;
+  info.ni  = static_cast<uint32_t>(instances.size());
+  info.nb  = number_built;
+
+  finish_construction(info);
+}
+
+//==============================================================================
+uint32_t TwoLevel::build_node(const uint32_t &begin, const uint32_t &end) {
+  auto node_index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+
+  AABBox node_box, centroid_box;
+  for (uint32_t i = begin; i < end; i++) {
+    node_box.extend_by(instances[i].box.bounds[0]);
+    node_box.extend_by(instances[i].box.bounds[1]);
+    centroid_box.extend_by(0.5f * (instances[i].box.bounds[0] +
+                                   instances[i].box.bounds[1]));
+  }
+  for (uint32_t a = 0; a < 3; a++) {
+    nodes[node_index].bmin[a] = node_box.bounds[0][a];
+    nodes[node_index].bmax[a] = node_box.bounds[1][a];
+  }
+
+  if (end - begin == 1) {
+    nodes[node_index].offset = begin;
+    nodes[node_index].np     = 1;
+    return node_index;
+  }
+
+  auto axis = static_cast<uint32_t>(centroid_box.longestAxis());
+  uint32_t mid = begin + (end - begin) / 2;
+  std::nth_element(instances.begin() + begin,
+                   instances.begin() + mid,
+                   instances.begin() + end,
+                   [&](const instance &a, const instance &b) {
+                     return a.box.bounds[0][axis] + a.box.bounds[1][axis] <
+                            b.box.bounds[0][axis] + b.box.bounds[1][axis];
+                   });
+
+  // The first child follows its parent directly.
+  nodes[node_index].np   = 0;
+  nodes[node_index].axis = static_cast<uint8_t>(axis);
+  build_node(begin, mid);
+  uint32_t second_child = build_node(mid, end);
+  nodes[node_index].offset = second_child;
+  return node_index;
+}
+
+//==============================================================================
+void TwoLevel::intersect_instance(const instance &in,
+                                  const Ray &r,
+                                  hit_record &hr,
+                                  traversal_info &ti) const {
+  if (in.blas == nullptr) {
+    STAT_ADD(ti.nrpt, 1);
+    intersect_primitive(in.p, r, hr);
+    return;
+  }
+
+  hit_record lr;
+  lr.t = hr.t;
+  if (!in.blas->closest_hit(r.transformed(in.wto), lr, ti)) return;
+
+  // The bottom-level hierarchy refers to the mesh as its only object.
+  hr.t  = lr.t;
+  hr.u  = lr.u;
+  hr.v  = lr.v;
+  hr.fp = lr.fp != in.fp;
+  hr.p  = PrimitiveRef(triangle_mesh, in.p.oi, lr.p.ti);
+}
+
+//==============================================================================
+bool TwoLevel::occluded_instance(const instance &in,
+                                 const Ray &r,
+                                 const float_t &t_max,
+                                 traversal_info &ti) const {
+  if (in.blas == nullptr) {
+    STAT_ADD(ti.nrpt, 1);
+    return occluded_primitive(in.p, r, t_max);
+  }
+
+  return in.blas->occluded(r.transformed(in.wto), t_max, ti);
+}
+
+//==============================================================================
+bool TwoLevel::closest_hit(const Ray &r,
+                           hit_record &hr,
+                           traversal_info &ti) const {
+  if (nodes.empty()) return false;
+
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  uint32_t stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  while (true) {
+    const BVHNode &node = nodes[cn];
+
+    // Instances entered behind the closest intersection found so far are
+    // skipped.
+    if (intersect_node(node, o, id, hr.t)) {
+      if (node.np > 0) {
+        intersect_instance(instances[node.offset], r, hr, ti);
+      } else {
+        // Visit the child closer to the ray's origin first.
+        if (r.sign()[node.axis]) {
+          stack[sp++] = cn + 1;
+          cn = node.offset;
+        } else {
+          stack[sp++] = node.offset;
+          cn = cn + 1;
+        }
+        continue;
+      }
+    }
+
+    if (sp == 0) break;
+    cn = stack[--sp];
+  }
+
+  return hr.hit();
+}
+
+//==============================================================================
+bool TwoLevel::occluded(const Ray &r,
+                        const float_t &t_max,
+                        traversal_info &ti) const {
+  if (nodes.empty()) return false;
+
+  glm::vec4 o  = r.orig();
+  glm::vec4 id = r.inv_dir();
+
+  uint32_t stack[kStackSize];
+  uint32_t sp{0};
+  uint32_t cn{0};
+
+  while (true) {
+    const BVHNode &node = nodes[cn];
+
+    if (intersect_node(node, o, id, t_max)) {
+      if (node.np > 0) {
+        if (occluded_instance(instances[node.offset], r, t_max, ti)) return true;
+      } else {
+        if (r.sign()[node.axis]) {
+          stack[sp++] = cn + 1;
+          cn = node.offset;
+        } else {
+          stack[sp++] = node.offset;
+          cn = cn + 1;
+        }
+        continue;
+      }
+    }
+
+    if (sp == 0) break;
+    cn = stack[--sp];
+  }
+
+  return false;
+}
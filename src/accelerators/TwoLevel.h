@@ -0,0 +1,119 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_TWOLEVEL_H
+#define ELUCIDO_TWOLEVEL_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "AccelerationStructure.h"
+#include "BVH.h"
+
+/**
+ * An object placed in the scene by the two-level structure. Triangle meshes
+ * are intersected through their bottom-level hierarchy in the space, in
+ * which it was built; all other objects are intersected directly.
+ */
+struct instance {
+  glm::mat4     wto{1.f};       // Transform from world space into the space
+                                // of the bottom-level hierarchy.
+  AABBox        box{};          // Bounding box in world space.
+  const BVH    *blas{nullptr};  // Bottom-level hierarchy; nullptr for
+                                // objects intersected directly.
+  PrimitiveRef  p{};            // The object as a primitive.
+  bool          fp{false};      // The transform mirrors the object, which
+                                // flips the orientation of its triangles.
+};
+
+/**
+ * A two-level acceleration structure. Every triangle mesh gets its own
+ * bounding volume hierarchy, which is built once and reused as long as the
+ * mesh is only transformed. The placements of an instanced mesh share one
+ * hierarchy. The top level is a small hierarchy over the instances of the
+ * objects, which is rebuilt for every frame. Rays are transformed into the
+ * space of a bottom-level hierarchy without normalizing their direction, so
+ * distances along the ray and barycentric coordinates are the same in both
+ * spaces.
+ */
+class TwoLevel : public AccelerationStructure {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  TwoLevel() :
+      AccelerationStructure(),
+      nodes()
+  {
+    as_type = two_level;
+  }
+
+  ~TwoLevel() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  void            construct(const AABBox &box,
+                            const std::vector<std::shared_ptr<Object>> &objects,
+                            const uint32_t &number_primitives,
+                            as_construct_info &info);
+  bool            closest_hit(const Ray &r,
+                              hit_record &hr,
+                              traversal_info &ti) const;
+  bool            occluded(const Ray &r,
+                           const float_t &t_max,
+                           traversal_info &ti) const;
+
+  inline void set_max_primitives(const uint32_t &mp) { max_primitives = mp; }
+
+  inline const std::vector<instance> & get_instances() const { return instances; }
+
+ private:
+  // The bottom-level hierarchy of a triangle mesh.
+  struct bottom_level {
+    std::shared_ptr<BVH>    bvh;      // Built over the mesh's vertices at the
+                                      // time of the construction.
+    std::shared_ptr<Object> mesh;     // The mesh the hierarchy refers to; it
+                                      // keeps the geometry alive.
+    glm::mat4               gt{1.f};  // The transformations applied to the
+                                      // vertices at the time of the
+                                      // construction.
+    uint32_t                nt{0};    // Number of triangles of the mesh.
+  };
+
+  /**
+   * Builds the top-level subtree over the instances in [begin, end) and
+   * appends its nodes in depth-first order; the instances are split at the
+   * median of their centroids along the longest axis.
+   * @return: The index of the subtree's root node.
+   */
+  uint32_t build_node(const uint32_t &begin, const uint32_t &end);
+
+  /**
+   * Intersects the ray with the instance and updates the hit record, if
+   * the intersection is closer than hr.t.
+   */
+  void intersect_instance(const instance &in,
+                          const Ray &r,
+                          hit_record &hr,
+                          traversal_info &ti) const;
+  bool occluded_instance(const instance &in,
+                         const Ray &r,
+                         const float_t &t_max,
+                         traversal_info &ti) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  std::vector<BVHNode>  nodes;              // Top-level hierarchy; a leaf
+                                            // holds a single instance.
+  std::vector<instance> instances;
+  // The bottom-level hierarchies by the geometry of their meshes.
+  std::unordered_map<const void *, bottom_level> bottom_levels;
+  uint32_t              max_primitives{0};  // Of the bottom-level hierarchies;
+                                            // 0: use the BVH's default.
+};
+
+#endif //ELUCIDO_TWOLEVEL_H
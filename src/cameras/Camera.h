@@ -59,6 +59,25 @@ class Camera {
   }
   inline void calculate_ar() { ar = (iw * 1.f) / ih; }
 
+  /**
+   * A camera emitting rays in world space leaves the objects and light
+   * sources untouched; otherwise they have to be moved into camera space
+   * with apply_inverse_view_transform before rendering.
+   */
+  inline void set_world_space(const bool &_ws) { this->ws = _ws; }
+  inline bool world_space() const { return this->ws; }
+
+ protected:
+  /**
+   * Moves a ray generated in camera space into world space, if the camera
+   * emits rays in world space.
+   */
+  inline void to_world_space(Ray &r) const {
+    if (!ws) return;
+    r.set_orig(vm * r.orig());
+    r.set_dir(glm::normalize(vm * r.dir()));
+  }
+
 //==============================================================================
 // Data members
 //==============================================================================
@@ -69,5 +88,6 @@ class Camera {
   uint32_t  ih;     // Image's width.
   float_t   ar;     // Aspect ratio [ width / height ]
   glm::mat4 vm;     // View matrix.
+  bool      ws{false};  // Emit rays in world space.
 };
 #endif //ELUCIDO_CAMERA_H
\ No newline at end of file
@@ -15,6 +15,7 @@ Ray OrthographicCamera::get_ray(const uint32_t &pixel_x,
   r.rt = primary;
   r.set_orig(o);
   r.set_dir(glm::normalize(lookat - eye));
+  to_world_space(r);
 
   return r;
 }
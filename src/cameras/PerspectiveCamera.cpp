@@ -16,6 +16,7 @@ Ray PerspectiveCamera::get_ray(const uint32_t &pixel_x,
   r.rt = primary;
   r.set_orig(eye);
   r.set_dir(d);
+  to_world_space(r);
 
   return r;
 }
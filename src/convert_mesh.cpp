@@ -0,0 +1,35 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+// Converts an OBJ file into a binary mesh cache file, which is loaded
+// instead of the OBJ file, as long as the OBJ file doesn't change.
+
+#include <iostream>
+#include <string>
+
+#include "objects/MeshCache.h"
+#include "objects/TriangleMesh.h"
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    std::cout << "Usage: " << argv[0] << " <obj file> [<cache file>]" << std::endl;
+    exit(1);
+  }
+
+  std::string cf = (argc == 3) ? argv[2] : mesh_cache_path(argv[1]);
+
+  TriangleMesh tm;
+  auto li = tm.load_mesh(argv[1]);
+  if (!li.l) {
+    std::cout << "Couldn't load the mesh " << argv[1] << "." << std::endl;
+    return 1;
+  }
+  if (!tm.write_mesh_cache(cf.c_str(), argv[1])) {
+    std::cout << "Couldn't write the mesh cache " << cf << "." << std::endl;
+    return 1;
+  }
+
+  std::cout << "Converted '" << argv[1] << "' (" << li.nt << " triangles) into '"
+            << cf << "'." << std::endl;
+  return 0;
+}
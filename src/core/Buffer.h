@@ -0,0 +1,170 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_BUFFER_H
+#define ELUCIDO_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * A contiguous array, which either owns its elements or views elements
+ * stored elsewhere, e.g. in a memory-mapped file or in another buffer. The
+ * storage of a view is kept alive by a shared owner. Elements of a writable
+ * view can be modified in place; a read-only view copies its elements into
+ * own storage on the first non-const access. Changing the size of a view
+ * copies its elements as well. Copies of a read-only view share its
+ * elements; copies of other buffers own their elements.
+ */
+template <typename T>
+class Buffer {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  typedef T           value_type;
+  typedef T *         iterator;
+  typedef const T *   const_iterator;
+
+  Buffer() {}
+  Buffer(std::initializer_list<T> l) : v(l) { sync(); }
+  Buffer(const std::vector<T> &_v) : v(_v) { sync(); }
+  Buffer(const Buffer &b) { *this = b; }
+  Buffer(Buffer &&b) { *this = std::move(b); }
+
+  Buffer& operator=(const Buffer &b) {
+    if (this == &b) return *this;
+    if (b.ro) {
+      view(b.d, b.n, b.owner, false);
+      return *this;
+    }
+    owner.reset();
+    ro = false;
+    v.assign(b.begin(), b.end());
+    sync();
+    return *this;
+  }
+  Buffer& operator=(Buffer &&b) {
+    if (this == &b) return *this;
+    v = std::move(b.v);
+    owner = std::move(b.owner);
+    d = owner ? b.d : v.data();
+    n = b.n;
+    ro = b.ro;
+    b.ro = false;
+    b.v.clear();
+    b.sync();
+    return *this;
+  }
+
+  ~Buffer() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  /**
+   * Makes the buffer a view of n elements starting at data.
+   * @param data:     The first element.
+   * @param n:        The number of elements.
+   * @param o:        Keeps the elements alive as long as the buffer views
+   *                  them.
+   * @param writable: The elements may be modified in place.
+   */
+  inline void view(T *data,
+                   const size_t &_n,
+                   const std::shared_ptr<void> &o,
+                   const bool &writable = true) {
+    v.clear();
+    v.shrink_to_fit();
+    owner = o;
+    ro = !writable;
+    d = data;
+    n = _n;
+  }
+
+  /**
+   * Makes the buffer a read-only view of the elements of b, which are kept
+   * alive by o.
+   */
+  inline void share(const Buffer &b, const std::shared_ptr<void> &o) {
+    view(b.d, b.n, o, false);
+  }
+
+  inline bool mapped() const { return owner != nullptr; }
+  inline bool shared() const { return ro; }
+
+  inline size_t size() const { return n; }
+  inline bool empty() const { return n == 0; }
+
+  inline T * data() { if (ro) own(); return d; }
+  inline const T * data() const { return d; }
+
+  inline T & operator[](const size_t &i) { if (ro) own(); return d[i]; }
+  inline const T & operator[](const size_t &i) const { return d[i]; }
+  inline T & back() { if (ro) own(); return d[n - 1]; }
+  inline const T & back() const { return d[n - 1]; }
+
+  inline iterator begin() { if (ro) own(); return d; }
+  inline iterator end() { if (ro) own(); return d + n; }
+  inline const_iterator begin() const { return d; }
+  inline const_iterator end() const { return d + n; }
+
+  inline void push_back(const T &t) { own(); v.push_back(t); sync(); }
+  template <typename... Args>
+  inline void emplace_back(Args&&... args) {
+    own();
+    v.emplace_back(std::forward<Args>(args)...);
+    sync();
+  }
+  template <typename InputIt>
+  inline void insert(const_iterator pos, InputIt first, InputIt last) {
+    size_t i = pos - d;
+    own();
+    v.insert(v.begin() + i, first, last);
+    sync();
+  }
+  inline void resize(const size_t &s) { own(); v.resize(s); sync(); }
+  inline void reserve(const size_t &s) { own(); v.reserve(s); sync(); }
+  inline void clear() { owner.reset(); ro = false; v.clear(); sync(); }
+
+ private:
+  // Copies the elements of a view into own storage.
+  inline void own() {
+    if (!owner) return;
+    v.assign(d, d + n);
+    owner.reset();
+    ro = false;
+    sync();
+  }
+  inline void sync() {
+    d = v.data();
+    n = v.size();
+  }
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  std::vector<T>        v;              // Own storage.
+  std::shared_ptr<void> owner;          // Storage of a view; null, if the
+                                        // buffer owns its elements.
+  T                    *d{nullptr};     // First element.
+  size_t                n{0};           // Number of elements.
+  bool                  ro{false};      // The buffer is a read-only view.
+};
+
+template <typename T>
+inline bool operator==(const Buffer<T> &a, const Buffer<T> &b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <typename T>
+inline bool operator==(const Buffer<T> &a, const std::vector<T> &b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+#endif //ELUCIDO_BUFFER_H
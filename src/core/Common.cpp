@@ -107,4 +107,40 @@ bool triangle_intersect(const Ray &r,
   if (determinant < kEpsilon) flip_normal = true;
 
   return true;
-}
\ No newline at end of file
+}
+
+//==============================================================================
+bool triangle_shadow_intersect(const Ray &r,
+                               const glm::vec4 &v0,
+                               const glm::vec4 &v1,
+                               const glm::vec4 &v2,
+                               const float_t &light_distance) {
+  auto edge1 = v1 - v0;
+  auto edge2 = v2 - v0;
+
+  auto p_vec = glm::vec4(glm::cross(glm::vec3(r.dir()), glm::vec3(edge2)), 0.f);
+  auto determinant = glm::dot(edge1, p_vec);
+
+  if (determinant > -kEpsilon && determinant < kEpsilon)
+    return false;
+
+  auto inv_determinant = 1.f / determinant;
+
+  // Calculate distance vector from vertex 0 to the ray origin.
+  auto t_vec = r.orig() - v0;
+
+  // Calculate Barycentric u-parameter and test if it's in the bounds [0,1].
+  auto u = static_cast<float_t>(glm::dot(t_vec, p_vec) * inv_determinant);
+  if (u < 0.f || u > 1.f) return false;
+
+  auto q_vec = glm::vec4(glm::cross(glm::vec3(t_vec), glm::vec3(edge1)), 0.f);
+
+  // Calculate Barycentric v-parameter and test if it's in the bounds [0,1].
+  auto v = static_cast<float_t>(glm::dot(r.dir(), q_vec) * inv_determinant);
+  if (v < 0.f || v + u > 1.f) return false;
+
+  // The intersection point should lie between the ray's origin and the
+  // light source.
+  auto t = static_cast<float_t>(glm::dot(edge2, q_vec) * inv_determinant);
+  return t >= 0.f && t < light_distance;
+}
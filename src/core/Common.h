@@ -88,14 +88,19 @@ bool triangle_intersect(const Ray &r,
 
 /**
  * Same algorithm as for the normal intersection is used for the shadow
- * intersection routine.
- * @param r:  The ray with which the triangle would be intersected.
- * @param v0: Vertex 0.
- * @param v1: Vertex 1.
- * @param v2: Vertex 2.
- * @return:   True in case of an intersection, false otherwise.
- *            In case the ray runs parallel to the surface of the
- *            triangle, false is returned.
+ * intersection routine. Since one only needs to know, if something blocks
+ * the light, neither the barycentric coordinates nor the orientation of the
+ * triangle are returned.
+ * @param r:              The ray with which the triangle would be intersected.
+ * @param v0:             Vertex 0.
+ * @param v1:             Vertex 1.
+ * @param v2:             Vertex 2.
+ * @param light_distance: The distance from the ray's origin to the light
+ *                        source.
+ * @return:               True in case of an intersection closer than the
+ *                        light source, false otherwise.
+ *                        In case the ray runs parallel to the surface of the
+ *                        triangle, false is returned.
  */
 bool triangle_shadow_intersect(const Ray &r,
                                const glm::vec4 &v0,
@@ -1,6 +1,7 @@
 // Copyright 2017, University of Freiburg.
 // Author: Haralambi Todorov <harrytodorov@gmail.com>
 
+#include <algorithm>
 #include <glm/exponential.hpp>
 
 #include "ImagePlane.h"
@@ -90,3 +91,26 @@ void ImagePlane::set_sampling_strategy(const SamplingStrategy &_ss) {
 void ImagePlane::set_pixel_filter(const PixelFilter &_pf) {
   pf = _pf;
 }
+
+//==============================================================================
+void ImagePlane::set_tile_size(const uint32_t &_ts) {
+  ts = _ts;
+}
+
+//==============================================================================
+std::vector<image_tile> ImagePlane::generate_tiles() const {
+  std::vector<image_tile> tiles;
+
+  for (uint32_t y = 0; y < vres; y += ts) {
+    for (uint32_t x = 0; x < hres; x += ts) {
+      image_tile t;
+      t.x0 = x;
+      t.y0 = y;
+      t.x1 = std::min(x + ts, hres);
+      t.y1 = std::min(y + ts, vres);
+      tiles.push_back(t);
+    }
+  }
+
+  return tiles;
+}
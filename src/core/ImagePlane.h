@@ -43,6 +43,15 @@ class ImagePlane {
   void set_sampling_strategy(const SamplingStrategy &_ss);
   void generate_unit_samples();
   void set_pixel_filter(const PixelFilter &_pf);
+  void set_tile_size(const uint32_t &_ts);
+
+  /**
+   * Splits the image plane into tiles of (at most) ts x ts pixels. Tiles are
+   * ordered row by row starting from the top left corner of the image plane;
+   * tiles on the right and bottom border are clipped to the image plane.
+   * @return: The tiles covering the image plane.
+   */
+  std::vector<image_tile> generate_tiles() const;
  private:
   float_t encode_gamma(const float_t &c);
 
@@ -58,6 +67,7 @@ class ImagePlane {
   SamplingStrategy ss;        // Sampling strategy.
   PixelFilter pf;             // Pixel filter.
   OutputType ot;              // Output type.
+  uint32_t ts{16};            // Tile size in pixels.
   std::vector<glm::vec3> fb;  // The frame buffer.
 };
 
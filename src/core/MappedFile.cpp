@@ -0,0 +1,47 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//==============================================================================
+bool MappedFile::open(const char *f, const bool &writable, const bool &sequential) {
+  close();
+
+  int fd = ::open(f, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  s = static_cast<size_t>(st.st_size);
+  if (s > 0) {
+    int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *m = mmap(nullptr, s, protection, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      ::close(fd);
+      s = 0;
+      return false;
+    }
+    if (sequential) madvise(m, s, MADV_SEQUENTIAL);
+    d = static_cast<char *>(m);
+  }
+
+  // The mapping stays valid after closing the file descriptor.
+  ::close(fd);
+  return true;
+}
+
+//==============================================================================
+void MappedFile::close() {
+  if (d != nullptr) munmap(d, s);
+  d = nullptr;
+  s = 0;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_MAPPEDFILE_H
+#define ELUCIDO_MAPPEDFILE_H
+
+#include <cstddef>
+
+/**
+ * A private memory mapping of a whole file. Writing to a writable mapping
+ * copies the touched pages; the file itself is never changed. The mapping
+ * is released, when the object is destroyed.
+ */
+class MappedFile {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  MappedFile() {}
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile& operator=(const MappedFile &) = delete;
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  /**
+   * Maps the file f into memory.
+   * @param f:          Path to the file.
+   * @param writable:   Map the pages writable (copy-on-write).
+   * @param sequential: The file is going to be read front to back.
+   * @return:           False, if the file can't be opened or mapped.
+   */
+  bool open(const char *f, const bool &writable = false, const bool &sequential = true);
+  void close();
+
+  inline char * data() const { return d; }
+  inline size_t size() const { return s; }
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  char   *d{nullptr};   // Start of the mapping.
+  size_t  s{0};         // Size of the file in bytes.
+};
+
+#endif //ELUCIDO_MAPPEDFILE_H
@@ -11,3 +11,12 @@ void Ray::set_dir(const glm::vec4 &_d) {
   s[1] = (uint32_t) (id.y < 0);
   s[2] = (uint32_t) (id.z < 0);
 }
+
+//==============================================================================
+Ray Ray::transformed(const glm::mat4 &m) const {
+  Ray result;
+  result.rt = rt;
+  result.set_orig(m * o);
+  result.set_dir(m * d);
+  return result;
+}
@@ -4,6 +4,8 @@
 #ifndef ELUCIDO_RAY_H
 #define ELUCIDO_RAY_H
 
+#include <glm/mat4x4.hpp>
+
 #include "Utilities.h"
 
 class Ray {
@@ -28,6 +30,12 @@ class Ray {
 
   inline const uint32_t *sign() const { return this->s; }
 
+  /**
+   * Returns the ray transformed by m. Its direction isn't normalized, so
+   * that distances along the ray are the same in both spaces.
+   */
+  Ray transformed(const glm::mat4 &m) const;
+
 //==============================================================================
 // Data members
 //==============================================================================
@@ -20,7 +20,7 @@ glm::vec3 Renderer::cast_ray(const Ray &ray, const uint32_t &depth) {
   if (!trace_ray(ray, i)) return hr;
 
   // Increment the number of ray-object intersections.
-  __sync_fetch_and_add(&ri.nroi, 1);
+  STAT_ADD(rib.ri.nroi, 1);
 
   // If there is an intersection, reset the radiance to 0.
   hr = glm::vec3(0);
@@ -50,15 +50,12 @@ glm::vec3 Renderer::evaluate_phong(const isect_info &i,
 
     // Check if the intersection point is in shadow for the light
     // source.
-    isect_info si;
-
     Ray shadow_ray;
     shadow_ray.rt = shadow;
     shadow_ray.set_orig(i.ip + bias * i.ipn);
     shadow_ray.set_dir(light_direction);
 
-    auto in_shadow = trace_ray(shadow_ray, si);
-    if (in_shadow && si.tn < light_distance) continue;
+    if (occluded(shadow_ray, light_distance)) continue;
 
     labertian = labertian_amount(i.ipn, light_direction);
 
@@ -98,25 +95,29 @@ glm::vec4 Renderer::reflect(const glm::vec4 &normal,
 //==============================================================================
 bool Renderer::trace_ray(const Ray &r, isect_info &i) {
 
+#ifdef ELUCIDO_RENDER_STATISTICS
   // Increment primary rays.
-  if (r.rt == primary) __sync_fetch_and_add(&ri.npr, 1);
+  if (r.rt == primary) rib.ri.npr++;
 
   // Increment shadow rays.
-  if (r.rt == shadow) __sync_fetch_and_add(&ri.nsr, 1);
+  if (r.rt == shadow) rib.ri.nsr++;
 
   // Increment reflection rays.
-  if (r.rt == reflection) __sync_fetch_and_add(&ri.nrr, 1);
+  if (r.rt == reflection) rib.ri.nrr++;
 
   // Increment refraction rays.
-  if (r.rt == refraction) __sync_fetch_and_add(&ri.nrrr, 1);
+  if (r.rt == refraction) rib.ri.nrrr++;
+#endif
 
   // Check if the ray intersects within the scene bounds.
   if (!sbb.intersect(r)) return false;
 
   // Leave the acceleration structure to find the intersection point.
   if (ac != nullptr) {
-    bool intersected = ac->traverse(r, i);
-    __sync_fetch_and_add(&ri.nrpt, i.nrpt);
+    bool intersected = ac->traverse(r, i, worker);
+    STAT_ADD(rib.ri.nrpt, i.nrpt);
+    STAT_ADD(rib.ri.nmt, i.nmt);
+    STAT_ADD(rib.ri.nds, i.nds);
     return intersected;
   }
 
@@ -132,17 +133,16 @@ bool Renderer::trace_ray(const Ray &r, isect_info &i) {
         !object->bounding_box().intersect(r)) {
 
       // Increment ray-primitive tests, bounding box.
-      __sync_fetch_and_add(&ri.nrpt, 1);
+      STAT_ADD(rib.ri.nrpt, 1);
       continue;
     }
 
     // The number of ray-primitive intersections for triangulated mesh
     // is equal to the number of triangles in the mesh.
     if (object->object_type() == triangle_mesh)
-      __sync_fetch_and_add(&ri.nrpt,
-                           std::static_pointer_cast<TriangleMesh>(object)->nt);
+      STAT_ADD(rib.ri.nrpt, std::static_pointer_cast<TriangleMesh>(object)->nt);
     else
-      __sync_fetch_and_add(&ri.nrpt, 1);
+      STAT_ADD(rib.ri.nrpt, 1);
 
     // If there is an intersection with the object's bounding box,
     // try to intersect with the object itself.
@@ -153,4 +153,47 @@ bool Renderer::trace_ray(const Ray &r, isect_info &i) {
   }
 
   return (i.ho != nullptr);
-}
\ No newline at end of file
+}
+//==============================================================================
+bool Renderer::occluded(const Ray &r, const float_t &t_max) {
+
+#ifdef ELUCIDO_RENDER_STATISTICS
+  // Increment shadow rays.
+  if (r.rt == shadow) rib.ri.nsr++;
+#endif
+
+  // Check if the ray intersects within the scene bounds.
+  if (!sbb.intersect(r)) return false;
+
+  // Leave the acceleration structure to find a blocking primitive.
+  if (ac != nullptr) {
+    traversal_info ti;
+    ti.w = worker;
+    bool blocked = ac->occluded(r, t_max, ti);
+    STAT_ADD(rib.ri.nrpt, ti.nrpt);
+    STAT_ADD(rib.ri.nmt, ti.nmt);
+    STAT_ADD(rib.ri.nds, ti.nds);
+    return blocked;
+  }
+
+  // Iterate through objects and stop with the first blocking one.
+  for (const auto &object : objects) {
+    // Triangulated meshes are first intersected with their bounding boxes.
+    if (object->object_type() == triangle_mesh &&
+        !object->bounding_box().intersect(r)) {
+
+      // Increment ray-primitive tests, bounding box.
+      STAT_ADD(rib.ri.nrpt, 1);
+      continue;
+    }
+
+    if (object->object_type() == triangle_mesh)
+      STAT_ADD(rib.ri.nrpt, std::static_pointer_cast<TriangleMesh>(object)->nt);
+    else
+      STAT_ADD(rib.ri.nrpt, 1);
+
+    if (object->occluded(r, t_max)) return true;
+  }
+
+  return false;
+}
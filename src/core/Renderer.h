@@ -13,17 +13,26 @@
 #include "../objects/Object.h"
 #include "../accelerators/AccelerationStructure.h"
 
+/**
+ * A renderer is meant to be used by a single thread at a time; its render
+ * statistics are updated without synchronization. For parallel rendering
+ * each worker uses its own renderer and the statistics are merged after the
+ * frame is rendered. The renderer passes the index of its worker to the
+ * acceleration structure, which keeps per-worker traversal state.
+ */
 class Renderer {
  public:
   Renderer(const std::shared_ptr<AccelerationStructure> &_ac,
            const AABBox &_sbb,
            const std::vector<std::shared_ptr<Object>> &_objects,
-           const std::vector<std::shared_ptr<Light>> &_lights) :
-      ri(render_info()),
+           const std::vector<std::shared_ptr<Light>> &_lights,
+           const uint32_t &_worker = 0) :
+      rib(),
       ac(_ac),
       sbb(_sbb),
       objects(_objects),
-      lights(_lights)
+      lights(_lights),
+      worker(_worker)
   {}
 
   glm::vec3 cast_ray(const Ray &ray, const uint32_t &depth);
@@ -36,6 +45,17 @@ class Renderer {
    */
   bool trace_ray(const Ray &r, isect_info &i);
 
+  /**
+   * Determines if any object blocks the ray before the distance t_max.
+   * Contrary to trace_ray, the search stops with the first blocking object
+   * and no intersection information is computed.
+   * @param r:      The ray to be traced, typically a shadow ray.
+   * @param t_max:  The maximal distance from the ray's origin, up to which
+   *                an intersection is considered.
+   * @return:       True if the ray is blocked before t_max, false otherwise.
+   */
+  bool occluded(const Ray &r, const float_t &t_max);
+
   /**
    * Evaluate the radiance at the intersection point (i) in direction of the
    * ray (ray_direction) using the empirical Phong reflection model.
@@ -72,14 +92,15 @@ class Renderer {
   glm::vec4 reflect(const glm::vec4 &normal,
                     const glm::vec4 &to_reflect) const;
 
-  inline const render_info & finished() const { return ri; }
+  inline const render_info & finished() const { return rib.ri; }
 
  protected:
-  render_info                             ri;
+  render_info_block                       rib;
   std::shared_ptr<AccelerationStructure>  ac;
   AABBox                                  sbb;
   std::vector<std::shared_ptr<Object>>    objects;
   std::vector<std::shared_ptr<Light>>     lights;
+  uint32_t                                worker; // Index of the worker using the renderer.
 };
 
 #endif //ELUCIDO_RENDERER_H
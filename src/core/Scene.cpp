@@ -1,9 +1,12 @@
 // Copyright (c) 2018, University of Freiburg.
 // Author: Haralambi Todorov <harrytodorov@gmail.com>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <thread>
 #include "glm/ext.hpp"    // glm::to_string
 
 #include "Scene.h"
@@ -32,6 +35,9 @@ bool Scene::generate_as(const std::shared_ptr<acceleration_structure_description
       if (asd->max_resolution != 0) {
         std::static_pointer_cast<DynamicGrid>(as)->set_max_res(asd->max_resolution);
       }
+
+      // Insert triangles only into the cells, which they overlap.
+      std::static_pointer_cast<DynamicGrid>(as)->set_exact_insertion(asd->exact_insertion);
     } break;
 
     // Compact grid.
@@ -47,20 +53,112 @@ bool Scene::generate_as(const std::shared_ptr<acceleration_structure_description
       if (asd->max_resolution != 0) {
         std::static_pointer_cast<CompactGrid>(as)->set_max_res(asd->max_resolution);
       }
+
+      // Skip empty cells with a distance field.
+      std::static_pointer_cast<CompactGrid>(as)->set_distance_field(asd->distance_field);
+
+      // Insert triangles only into the cells, which they overlap.
+      std::static_pointer_cast<CompactGrid>(as)->set_exact_insertion(asd->exact_insertion);
+    } break;
+
+    // Two-level grid refining overloaded cells.
+    case AccelerationStructureType::hierarchical_grid : {
+      as = std::make_shared<HierarchicalGrid>();
+      auto hg = std::static_pointer_cast<HierarchicalGrid>(as);
+
+      // Alpha of both levels.
+      if (asd->alpha != 0.f) hg->set_alpha(asd->alpha);
+
+      // Maximum grid resolution per axis of both levels.
+      if (asd->max_resolution != 0) hg->set_max_res(asd->max_resolution);
+
+      // Cells with more primitives get a sub-grid.
+      if (asd->max_primitives != 0) hg->set_max_primitives(asd->max_primitives);
+
+      // Skip empty cells of the top level with a distance field.
+      hg->set_distance_field(asd->distance_field);
+
+      // Insert triangles only into the cells, which they overlap.
+      hg->set_exact_insertion(asd->exact_insertion);
     } break;
 
     // KD-tree midpoint.
     case AccelerationStructureType::kdtree_midpoint : {
       as = std::make_shared<KDtreeMidpoint>();
 
-      // TODO:
       // Maximum tree depth.
+      if (asd->max_depth != 0) {
+        std::static_pointer_cast<KDtreeMidpoint>(as)->set_max_depth(asd->max_depth);
+      }
+
       // Maximum primitives in node.
+      if (asd->max_primitives != 0) {
+        std::static_pointer_cast<KDtreeMidpoint>(as)->set_max_primitives(asd->max_primitives);
+      }
+    } break;
+
+    // KD-tree with SAH.
+    case AccelerationStructureType::kdtree_sah : {
+      as = std::make_shared<KDtreeSAH>();
+      auto kd = std::static_pointer_cast<KDtreeSAH>(as);
+
+      // Costs of the surface area heuristic.
+      if (asd->traversal_cost != 0.f) kd->set_traversal_cost(asd->traversal_cost);
+      if (asd->intersection_cost != 0.f) kd->set_intersection_cost(asd->intersection_cost);
+
+      // Maximum tree depth.
+      if (asd->max_depth != 0) kd->set_max_depth(asd->max_depth);
+
+      // Maximum primitives in node.
+      if (asd->max_primitives != 0) kd->set_max_primitives(asd->max_primitives);
+    } break;
+
+    // Bounding volume hierarchy.
+    case AccelerationStructureType::bvh : {
+      as = std::make_shared<BVH>();
+
+      // Maximum primitives in leaf.
+      if (asd->max_primitives != 0) {
+        std::static_pointer_cast<BVH>(as)->set_max_primitives(asd->max_primitives);
+      }
+
+      // Growth of the node area, up to which a refitted tree is kept.
+      if (asd->refit_threshold != 0.f) {
+        std::static_pointer_cast<BVH>(as)->set_refit_threshold(asd->refit_threshold);
+      }
+    } break;
+
+    // Bounding volume hierarchy over Morton-sorted primitives.
+    case AccelerationStructureType::lbvh : {
+      as = std::make_shared<LBVH>();
+
+      // Maximum primitives in leaf.
+      if (asd->max_primitives != 0) {
+        std::static_pointer_cast<LBVH>(as)->set_max_primitives(asd->max_primitives);
+      }
+
+      // Growth of the node area, up to which a refitted tree is kept.
+      if (asd->refit_threshold != 0.f) {
+        std::static_pointer_cast<LBVH>(as)->set_refit_threshold(asd->refit_threshold);
+      }
+    } break;
+
+    // Two-level structure with a BVH per triangle mesh.
+    case AccelerationStructureType::two_level : {
+      as = std::make_shared<TwoLevel>();
+
+      // Maximum primitives in a leaf of the bottom-level hierarchies.
+      if (asd->max_primitives != 0) {
+        std::static_pointer_cast<TwoLevel>(as)->set_max_primitives(asd->max_primitives);
+      }
     } break;
 
     default: break;
   }
 
+  // Built structures are persisted in and loaded from this directory.
+  as_cache_directory = asd->cache_directory;
+
   set_as(as);
   return true;
 }
@@ -97,6 +195,9 @@ bool Scene::generate_camera(const std::shared_ptr<camera_description> &cd,
   c->set_image_width(image_width);
   c->set_image_height(image_height);
 
+  // Rays in world space.
+  c->set_world_space(cd->world_space);
+
   // Transformations.
   apply_camera_transformations(c, cd->transformations);
 
@@ -165,16 +266,19 @@ bool Scene::generate_light(const light_description &light) {
 }
 
 //==============================================================================
-bool Scene::generate_object(const object_description &object) {
-  if (object.type == not_set_ot) return false;
+Scene::object_load Scene::load_object(const object_description &object,
+                                      const uint32_t &number_threads) {
+  object_load ret;
+  if (object.type == not_set_ot) return ret;
 
+  auto sl = std::chrono::high_resolution_clock::now();
   std::shared_ptr<Object> obj = nullptr;
 
   switch (object.type) {
     // Sphere.
     case ObjectType::sphere: {
       obj = std::make_shared<Sphere>(Sphere());
-      si.np++;
+      ret.np = 1;
 
       // Center.
       if (object.center != nullptr) {
@@ -195,7 +299,7 @@ bool Scene::generate_object(const object_description &object) {
     // Triangle.
     case ObjectType::triangle: {
       obj = std::make_shared<Triangle>(Triangle());
-      si.np++;
+      ret.np = 1;
 
       // Vertices.
       if (object.vertices.size() != 0) {
@@ -219,28 +323,24 @@ bool Scene::generate_object(const object_description &object) {
 
     // Triangle mesh.
     case ObjectType::triangle_mesh: {
-      if (object.file_name.empty()) return false;
+      if (object.file_name.empty()) return ret;
       obj = std::make_shared<TriangleMesh>(TriangleMesh());
 
-      // Print triangle mesh's loading information.
-      auto sl = std::chrono::high_resolution_clock::now();
-      auto li = std::static_pointer_cast<TriangleMesh>(obj)->load_mesh(object.file_name.c_str());
-      auto fl = std::chrono::high_resolution_clock::now();
-      auto ld = std::chrono::duration_cast<std::chrono::milliseconds>(fl - sl).count();
-      if (!li.l) return false;
-      print_tm_loading_info(li, ld, object.file_name);
-      si.np += li.nt;
+      ret.li = std::static_pointer_cast<TriangleMesh>(obj)->load_shared_mesh(object.file_name.c_str(),
+                                                                             number_threads);
+      if (!ret.li.l) return ret;
+      ret.np = ret.li.nt;
 
       // TODO: does not make sense to have 3 integers for interpolation.
       if (object.interpolation == 1)
         std::static_pointer_cast<TriangleMesh>(obj)->in = true;
     } break;
 
-    default: return false;
+    default: return ret;
   }
 
   // Transformations.
-  apply_object_transformations(obj, object.transformations);
+  transform_object(obj, object.transformations);
 
   // Material.
   material m = material();
@@ -262,7 +362,22 @@ bool Scene::generate_object(const object_description &object) {
   }
   obj->set_material(m);
 
-  add_object(obj);
+  auto fl = std::chrono::high_resolution_clock::now();
+  ret.lt = std::chrono::duration_cast<std::chrono::milliseconds>(fl - sl).count();
+  ret.o = obj;
+  return ret;
+}
+
+//==============================================================================
+bool Scene::add_loaded_object(const object_description &object,
+                              const object_load &l) {
+  if (l.o == nullptr) return false;
+  if (object.type == ObjectType::triangle_mesh) {
+    print_tm_loading_info(l.li, l.lt, object.file_name);
+  }
+  si.np += l.np;
+
+  add_object(l.o);
 
   size_t object_index = objects.size() - 1;
   add_object_for_animation(object_index, object.name);
@@ -270,6 +385,43 @@ bool Scene::generate_object(const object_description &object) {
   return true;
 }
 
+//==============================================================================
+void Scene::generate_objects(const std::vector<object_description> &description) {
+  auto sl = std::chrono::high_resolution_clock::now();
+
+  // The meshes, which are loaded concurrently, share the hardware threads
+  // for parsing their files.
+  uint32_t nm{0};
+  for (auto const &object : description) {
+    if (object.type == ObjectType::triangle_mesh) nm++;
+  }
+  uint32_t nw = std::min<uint32_t>(thread_pool->size(), std::max<uint32_t>(nm, 1));
+  uint32_t hw = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+  uint32_t number_threads = std::max<uint32_t>(hw / nw, 1);
+
+  // Load and transform the objects concurrently; they are independent from
+  // each other and from the scene.
+  std::vector<object_load> loaded(description.size());
+  for (size_t i = 0; i < description.size(); i++) {
+    thread_pool->submit([this, &description, &loaded, i, number_threads](const uint32_t &) {
+      loaded[i] = load_object(description[i], number_threads);
+    });
+  }
+  thread_pool->wait();
+
+  // Add them in declaration order, so that the scene doesn't depend on the
+  // order the loads finished in.
+  for (size_t i = 0; i < description.size(); i++) {
+    if (!add_loaded_object(description[i], loaded[i])) {
+      std::cout << "There was a problem while generating '" << description[i].name
+                << "'." << std::endl;
+    }
+  }
+
+  auto fl = std::chrono::high_resolution_clock::now();
+  si.lt = std::chrono::duration_cast<std::chrono::milliseconds>(fl - sl).count();
+}
+
 //==============================================================================
 bool Scene::load_scene(const scene_description &description) {
 
@@ -299,9 +451,14 @@ bool Scene::load_scene(const scene_description &description) {
   ip->set_number_of_samples(ipd->number_samples);
   ip->set_sampling_strategy(ipd->sampling_strategy);
   ip->set_pixel_filter(ipd->pixel_filter);
+  ip->set_tile_size(ipd->tile_size);
   ip->generate_unit_samples();
   set_image_plane(ip);
 
+  // Create the workers rendering the image plane's tiles.
+  thread_pool = std::make_shared<ThreadPool>(ipd->number_threads);
+  if (acceleration_structure != nullptr) acceleration_structure->set_thread_pool(thread_pool);
+
   // Generate camera.
   if (!generate_camera(description.camera, ip->hres, ip->vres)) {
     std::cout << "There was a problem while generating '"
@@ -310,12 +467,7 @@ bool Scene::load_scene(const scene_description &description) {
   }
 
   // Generate objects.
-  for (auto const &object : description.objects) {
-    if (!generate_object(object)) {
-      std::cout << "There was a problem while generating '" << object.name
-                << "'." << std::endl;
-    }
-  }
+  generate_objects(description.objects);
   si.no = objects.size();
 
   // Generate lights.
@@ -341,6 +493,13 @@ bool Scene::load_scene(const scene_description &description) {
 //==============================================================================
 void Scene::apply_object_transformations(const std::shared_ptr<Object> &ptr,
                                          const std::vector<transformation_description> &desc) {
+  transform_object(ptr, desc);
+  as_up_to_date = false;
+}
+
+//==============================================================================
+void Scene::transform_object(const std::shared_ptr<Object> &ptr,
+                             const std::vector<transformation_description> &desc) {
   for (auto const &t : desc) {
     switch (t.type) {
       case TransformationType::translation: {
@@ -410,6 +569,7 @@ void Scene::extend_scene_bb() {
 //==============================================================================
 void Scene::add_object(const std::shared_ptr<Object> object) {
   objects.push_back(object);
+  as_up_to_date = false;
 }
 
 //==============================================================================
@@ -442,7 +602,10 @@ void Scene::set_image_plane(const std::shared_ptr<ImagePlane> _ip) {
 }
 
 void Scene::set_as(const std::shared_ptr<AccelerationStructure> _ac) {
+  // The structure is traversed by the scene's workers.
+  if (_ac != nullptr) _ac->set_thread_pool(thread_pool);
   acceleration_structure = _ac;
+  as_up_to_date = false;
 }
 
 //==============================================================================
@@ -451,6 +614,15 @@ void Scene::print_as_construction_info(const as_construct_info &i,
   std::cout << "Construction time:\t\t\t\t\t\t"
             << i.d << "ms"
             << std::endl;
+  std::cout << "# of construction threads:\t\t\t\t"
+            << i.nt
+            << std::endl;
+  std::cout << "Construction speedup:\t\t\t\t\t"
+            << i.su
+            << std::endl;
+  std::cout << "Loaded from the cache:\t\t\t\t\t"
+            << (i.c ? "yes" : "no")
+            << std::endl;
   std::cout << "Type:\t\t\t\t\t\t\t\t\t";
 
   if (type == grid) {
@@ -481,8 +653,68 @@ void Scene::print_as_construction_info(const as_construct_info &i,
     std::cout << "Average number of primitives per cell:\t"
               << i.npnc
               << std::endl;
+  } else if (type == hierarchical_grid) {
+    std::cout << "hierarchical grid" << std::endl;
+    std::cout << "Resolution:\t\t\t\t\t\t\t\t"
+              << i.r[0] << 'x' << i.r[1] << 'x' << i.r[2]
+              << std::endl;
+    std::cout << "# of sub-grids:\t\t\t\t\t\t\t"
+              << i.nsg
+              << std::endl;
+    std::cout << "# of non-empty cells:\t\t\t\t\t"
+              << i.nfc
+              << std::endl;
+    std::cout << "Average number of primitives per cell:\t"
+              << i.npnc
+              << std::endl;
   } else if (type == kdtree_midpoint) {
     std::cout << "kd-tree with midpoint" << std::endl;
+    std::cout << "# of nodes:\t\t\t\t\t\t\t\t"
+              << i.nn
+              << std::endl;
+    std::cout << "# of leaves:\t\t\t\t\t\t\t"
+              << i.nl
+              << std::endl;
+    std::cout << "Average number of primitives per leaf:\t"
+              << i.npl
+              << std::endl;
+  } else if (type == kdtree_sah) {
+    std::cout << "kd-tree (binned SAH)" << std::endl;
+    std::cout << "# of nodes:\t\t\t\t\t\t\t\t"
+              << i.nn
+              << std::endl;
+    std::cout << "# of leaves:\t\t\t\t\t\t\t"
+              << i.nl
+              << std::endl;
+    std::cout << "Average number of primitives per leaf:\t"
+              << i.npl
+              << std::endl;
+  } else if (type == bvh || type == lbvh) {
+    if (type == bvh) {
+      std::cout << "bounding volume hierarchy (binned SAH)" << std::endl;
+    } else {
+      std::cout << "linear bounding volume hierarchy (Morton codes)" << std::endl;
+    }
+    std::cout << "Refitted:\t\t\t\t\t\t\t\t"
+              << (i.rf ? "yes" : "no")
+              << std::endl;
+    std::cout << "# of nodes:\t\t\t\t\t\t\t\t"
+              << i.nn
+              << std::endl;
+    std::cout << "# of leaves:\t\t\t\t\t\t\t"
+              << i.nl
+              << std::endl;
+    std::cout << "Average number of primitives per leaf:\t"
+              << i.npl
+              << std::endl;
+  } else if (type == two_level) {
+    std::cout << "two-level (BVH per triangle mesh)" << std::endl;
+    std::cout << "# of instances:\t\t\t\t\t\t\t"
+              << i.ni
+              << std::endl;
+    std::cout << "# of bottom-level BVHs built:\t\t\t"
+              << i.nb
+              << std::endl;
   }
 
   std::cout << "----------" << std::endl;
@@ -497,6 +729,12 @@ void Scene::print_tm_loading_info(const mesh_loading_info &li,
             << fn << "'." << std::endl;
   std::cout << "Loading time:\t\t\t\t\t\t\t"
             << loading_time << "ms" << std::endl;
+  std::cout << "Loading throughput:\t\t\t\t\t\t"
+            << li.mbs << "MB/s" << std::endl;
+  std::cout << "Loaded from the mesh cache:\t\t\t\t"
+            << (li.c ? "yes" : "no") << std::endl;
+  std::cout << "Shared with a loaded mesh:\t\t\t\t"
+            << (li.s ? "yes" : "no") << std::endl;
   std::cout << "# of vertices in the mesh:\t\t\t\t"
             << li.nv << std::endl;
   std::cout << "# of vertex normals in the mesh:\t\t"
@@ -515,6 +753,9 @@ void Scene::print_render_info(const render_info &ri,
   std::cout << "Done rendering." << std::endl;
   std::cout << "Rendering time:\t\t\t\t\t\t\t"
             << render_time << "sec" << std::endl;
+  std::cout << "# of render threads:\t\t\t\t\t"
+            << thread_pool->size() << std::endl;
+#ifdef ELUCIDO_RENDER_STATISTICS
   std::cout << "# of primary rays:\t\t\t\t\t\t"
             << ri.npr << std::endl;
   std::cout << "# of shadow rays:\t\t\t\t\t\t"
@@ -525,10 +766,17 @@ void Scene::print_render_info(const render_info &ri,
             << ri.nrrr << std::endl;
   std::cout << "# of ray-primitive intersection tests:\t"
             << ri.nrpt << std::endl;
+  std::cout << "# of tests avoided by mailboxing:\t\t"
+            << ri.nmt << std::endl;
+  std::cout << "Grid traversal steps per ray:\t\t\t"
+            << (1.f * ri.nds) / (ri.npr + ri.nsr + ri.nrr + ri.nrrr) << std::endl;
   std::cout << "# of ray-object intersections:\t\t\t"
             << ri.nroi << std::endl;
   std::cout << "ratio (isect tests / isect):\t\t\t"
             << (1.f * ri.nrpt) / ri.nroi << std::endl;
+#else
+  (void) ri;
+#endif
   std::cout << "----------" << std::endl;
   std::cout << std::endl;
 }
@@ -542,52 +790,54 @@ void Scene::print_scene_info(const scene_info &i) {
             << i.no << std::endl;
   std::cout << "# of light sources:\t\t\t\t\t\t"
             << i.nl << std::endl;
+  std::cout << "Object loading time:\t\t\t\t\t"
+            << i.lt << "ms" << std::endl;
   std::cout << "----------" << std::endl;
   std::cout << std::endl;
 }
 
 //==============================================================================
 void Scene::prepare_scene() {
+  // The acceleration structure of the previous frame stays valid, as long
+  // as neither objects nor the camera moved the geometry since.
+  if (as_up_to_date) return;
+
   // Compute scene's bounding box.
   extend_scene_bb();
 
   if (acceleration_structure != nullptr) {
-    // Construct acceleration structure.
+    // Construct acceleration structure or update the one of the previous
+    // frame. Only the first frame's structure is cached: the geometry of
+    // the following frames moved, otherwise the structure is still up to
+    // date, or it's in camera space and differs with every camera position.
+    std::string cache_directory = as_constructed ? std::string() : as_cache_directory;
     as_construct_info info;
     auto sc   = std::chrono::high_resolution_clock::now();
-    acceleration_structure->construct(scene_bb, objects, si.np, info);
+    acceleration_structure->update_cached(cache_directory, name, scene_bb, objects, si.np, info);
+    as_constructed = true;
     auto fc   = std::chrono::high_resolution_clock::now();
     info.d = std::chrono::duration_cast<std::chrono::milliseconds>(fc - sc).count();
     print_as_construction_info(info, acceleration_structure->get_type());
   }
+
+  // Geometry in camera space is moved back after rendering the frame.
+  as_up_to_date = camera->world_space();
 }
 
 //==============================================================================
-void Scene::render_image(const std::string &image_name) {
+void Scene::render_tile(const image_tile &tile, Renderer &renderer) {
   Ray                     primary_ray;
   std::vector<ip_sample>  ip_samples;
 
-  // Apply inverse view transform on objects and light sources.
-  camera->apply_inverse_view_transform(objects, lights);
-
-  prepare_scene();
-
-  std::unique_ptr<Renderer> renderer(new Renderer(acceleration_structure,
-                                                  scene_bb,
-                                                  objects,
-                                                  lights));
-
-  auto sr = std::chrono::high_resolution_clock::now();
-  // Iterate through the image plane's pixels starting from the top left
-  // corner.
-  for (uint32_t row = 0; row < image_plane->vres; row++) {
-    for (uint32_t col = 0; col < image_plane->hres; col++) {
+  // Iterate through the tile's pixels starting from its top left corner.
+  for (uint32_t row = tile.y0; row < tile.y1; row++) {
+    for (uint32_t col = tile.x0; col < tile.x1; col++) {
       ip_samples.clear();
 
       for (auto const &sample : image_plane->us) {
         primary_ray = camera->get_ray(col, row, sample.x, sample.y);
 
-        auto sample_radiance = renderer->cast_ray(primary_ray, max_depth);
+        auto sample_radiance = renderer.cast_ray(primary_ray, max_depth);
         auto sample_position = glm::vec2(col + sample.x, row + sample.y);
 
         ip_samples.emplace_back(sample_radiance, sample_position);
@@ -597,15 +847,50 @@ void Scene::render_image(const std::string &image_name) {
       image_plane->fb[row*image_plane->hres + col] = pixel_radiance;
     }
   }
+}
+
+//==============================================================================
+void Scene::render_image(const std::string &image_name) {
+  // Apply inverse view transform on objects and light sources, unless the
+  // camera emits rays in world space.
+  bool camera_space = !camera->world_space();
+  if (camera_space) camera->apply_inverse_view_transform(objects, lights);
+
+  prepare_scene();
 
-  // Print render time and statistics.
+  // Each worker uses its own renderer, so that the render statistics are
+  // collected without synchronization between the workers.
+  std::vector<std::unique_ptr<Renderer>> renderers;
+  for (uint32_t w = 0; w < thread_pool->size(); w++) {
+    renderers.emplace_back(new Renderer(acceleration_structure,
+                                        scene_bb,
+                                        objects,
+                                        lights,
+                                        w));
+  }
+
+  auto sr = std::chrono::high_resolution_clock::now();
+  // Split the image plane into tiles and hand them to the thread pool.
+  // Each pixel is computed exactly as in a serial traversal of the image
+  // plane, so the result does not depend on the number of threads.
+  for (auto const &tile : image_plane->generate_tiles()) {
+    thread_pool->submit([this, tile, &renderers](const uint32_t &worker) {
+      render_tile(tile, *renderers[worker]);
+    });
+  }
+  thread_pool->wait();
+
+  // Print render time and statistics merged from all workers.
   auto fr = std::chrono::high_resolution_clock::now();
   auto rd = std::chrono::duration_cast<std::chrono::seconds>(fr - sr).count();
-  auto ri = renderer->finished();
+  render_info ri;
+  for (auto const &renderer : renderers) {
+    ri += renderer->finished();
+  }
   print_render_info(ri, rd);
 
   // Reverse inverse view transform.
-  camera->reverse_inverse_view_transform(objects, lights);
+  if (camera_space) camera->reverse_inverse_view_transform(objects, lights);
 
   auto rendered_scene_name = image_name + ".png";
   image_plane->save_to_png(rendered_scene_name);
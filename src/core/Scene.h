@@ -25,10 +25,16 @@
 #include "../accelerators/AccelerationStructure.h"
 #include "../accelerators/DynamicGrid.h"
 #include "../accelerators/CompactGrid.h"
+#include "../accelerators/HierarchicalGrid.h"
 #include "../accelerators/KDtreeMidpoint.h"
+#include "../accelerators/KDtreeSAH.h"
+#include "../accelerators/BVH.h"
+#include "../accelerators/TwoLevel.h"
+#include "../accelerators/LBVH.h"
 
 #include "Renderer.h"
 #include "ImagePlane.h"
+#include "ThreadPool.h"
 
 class Scene {
 //==============================================================================
@@ -43,7 +49,10 @@ class Scene {
       camera(nullptr),
       acceleration_structure(nullptr),
       animations({}),
-      scene_bb(AABBox())
+      scene_bb(AABBox()),
+      thread_pool(nullptr),
+      as_up_to_date(false),
+      as_constructed(false)
       {};
 
   ~Scene() = default;
@@ -66,13 +75,43 @@ class Scene {
 
   bool load_scene(const scene_description &description);
   inline const std::string& get_name() { return name; }
+  inline const std::vector<std::shared_ptr<Object>>& get_objects() const { return objects; }
+  inline const std::unordered_map<std::string, size_t>& get_animated_objects() const {
+    return animated_objects;
+  }
+  inline const std::shared_ptr<ImagePlane>& get_image_plane() const { return image_plane; }
   void render_image(const std::string &image_name);
   void render_image_sequence(const size_t &animation_index);
 
  private:
-  bool generate_object(const object_description &object);
+  // An object created by the parallel load phase.
+  struct object_load {
+    std::shared_ptr<Object>   o{nullptr};   // Null, if loading failed.
+    mesh_loading_info         li;           // Of a triangle mesh.
+    uint32_t                  np{0};        // Number of primitives.
+    size_t                    lt{0};        // Loading time in ms.
+  };
+
+  /**
+   * Creates an object and applies its transformations and material. It
+   * doesn't modify the scene, so that objects can be loaded concurrently.
+   * @param object:         The description of the object.
+   * @param number_threads: Maximal number of threads parsing a mesh file.
+   * @return:               The loaded object.
+   */
+  object_load load_object(const object_description &object,
+                          const uint32_t &number_threads = 0);
+  bool add_loaded_object(const object_description &object, const object_load &l);
+
+  /**
+   * Loads the objects on the thread pool and adds them to the scene in
+   * declaration order.
+   */
+  void generate_objects(const std::vector<object_description> &description);
   void apply_object_transformations(const std::shared_ptr<Object> &ptr,
                                     const std::vector<transformation_description> &desc);
+  static void transform_object(const std::shared_ptr<Object> &ptr,
+                               const std::vector<transformation_description> &desc);
   bool generate_light(const light_description &light);
   void apply_light_transformations(const std::shared_ptr<Light> &ptr,
                                    const std::vector<transformation_description> &desc);
@@ -85,6 +124,14 @@ class Scene {
 
   void extend_scene_bb();
   void prepare_scene();
+
+  /**
+   * Renders the pixels of a tile of the image plane and writes the
+   * resulting radiance into the image plane's frame buffer.
+   * @param tile:     The tile to be rendered.
+   * @param renderer: The renderer used for casting the primary rays.
+   */
+  void render_tile(const image_tile &tile, Renderer &renderer);
   void convert_color01_range(glm::vec3 &color);
 
   void print_render_info(const render_info &ri, const size_t &render_time);
@@ -111,6 +158,13 @@ class Scene {
   std::vector<animation_description>      animations;
   AABBox                                  scene_bb;
   scene_info                              si;
+  std::shared_ptr<ThreadPool>             thread_pool;
+  bool                                    as_up_to_date;  // The acceleration structure matches
+                                                          // the objects' current geometry.
+  std::string                             as_cache_directory; // Built acceleration structures are
+                                                              // cached there; empty, if disabled.
+  bool                                    as_constructed; // The acceleration structure was
+                                                          // constructed for a previous frame.
 };
 
 #endif //ELUCIDO_ALL_SCENE_H
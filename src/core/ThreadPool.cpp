@@ -0,0 +1,125 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "ThreadPool.h"
+
+namespace {
+// The pool and the index of the worker running on the current thread;
+// used to push tasks submitted from within a task onto the worker's own
+// queue.
+thread_local const ThreadPool *current_pool{nullptr};
+thread_local uint32_t          current_worker{0};
+}
+
+//==============================================================================
+ThreadPool::ThreadPool(const uint32_t &number_threads) :
+    queued(0),
+    pending(0),
+    next_queue(0),
+    stop(false) {
+  uint32_t nw = number_threads;
+  if (nw == 0) nw = std::thread::hardware_concurrency();
+  if (nw == 0) nw = 1;
+
+  for (uint32_t i = 0; i < nw; i++) {
+    queues.emplace_back(new task_queue());
+  }
+  for (uint32_t i = 0; i < nw; i++) {
+    workers.emplace_back(&ThreadPool::worker_loop, this, i);
+  }
+}
+
+//==============================================================================
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(m);
+    stop = true;
+  }
+  work_cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+//==============================================================================
+void ThreadPool::submit(const pool_task &task) {
+  uint32_t q;
+  if (current_pool == this) {
+    q = current_worker;
+  } else {
+    q = next_queue.fetch_add(1) % size();
+  }
+
+  pending++;
+  {
+    std::lock_guard<std::mutex> lock(queues[q]->m);
+    queues[q]->tasks.push_back(task);
+  }
+
+  // Increment the number of queued tasks while holding the pool's mutex, so
+  // that a worker, which is about to sleep, does not miss the notification.
+  {
+    std::lock_guard<std::mutex> lock(m);
+    queued++;
+  }
+  work_cv.notify_one();
+}
+
+//==============================================================================
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m);
+  done_cv.wait(lock, [this] { return pending == 0; });
+}
+
+//==============================================================================
+bool ThreadPool::pop_task(const uint32_t &w, pool_task &task) {
+  std::lock_guard<std::mutex> lock(queues[w]->m);
+  if (queues[w]->tasks.empty()) return false;
+
+  // Workers take the most recently pushed task from their own queue.
+  task = std::move(queues[w]->tasks.back());
+  queues[w]->tasks.pop_back();
+  queued--;
+  return true;
+}
+
+//==============================================================================
+bool ThreadPool::steal_task(const uint32_t &w, pool_task &task) {
+  for (uint32_t i = 1; i < size(); i++) {
+    uint32_t victim = (w + i) % size();
+    std::lock_guard<std::mutex> lock(queues[victim]->m);
+    if (queues[victim]->tasks.empty()) continue;
+
+    // Thieves take the oldest task from the front of the victim's queue.
+    task = std::move(queues[victim]->tasks.front());
+    queues[victim]->tasks.pop_front();
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+//==============================================================================
+void ThreadPool::worker_loop(const uint32_t &w) {
+  current_pool   = this;
+  current_worker = w;
+
+  while (true) {
+    pool_task task;
+    if (pop_task(w, task) || steal_task(w, task)) {
+      task(w);
+
+      if (--pending == 0) {
+        std::lock_guard<std::mutex> lock(m);
+        done_cv.notify_all();
+      }
+      continue;
+    }
+
+    // Sleep until there is a task to execute or the pool is stopped.
+    std::unique_lock<std::mutex> lock(m);
+    work_cv.wait(lock, [this] { return queued > 0 || stop; });
+    if (stop && queued == 0) return;
+  }
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_THREADPOOL_H
+#define ELUCIDO_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A task executed by the thread pool. The index of the worker running the
+ * task is passed to it, so that tasks can use per-worker data without any
+ * synchronization.
+ */
+typedef std::function<void(const uint32_t &worker)> pool_task;
+
+class ThreadPool {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  /**
+   * Creates a pool with number_threads workers. If number_threads is 0, the
+   * number of hardware threads is used.
+   */
+  explicit ThreadPool(const uint32_t &number_threads);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool& operator=(const ThreadPool &) = delete;
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  /**
+   * Submits a task to the pool. Tasks submitted from a worker of the pool
+   * are pushed onto the worker's own queue; tasks submitted from outside
+   * are distributed over the workers' queues in a round robin fashion.
+   * Idle workers steal tasks from the queues of the other workers.
+   * @param task: The task to be executed.
+   */
+  void submit(const pool_task &task);
+
+  /**
+   * Blocks until all submitted tasks (including tasks submitted by other
+   * tasks) are finished. Should not be called from within a task.
+   */
+  void wait();
+
+  inline uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+ private:
+  struct task_queue {
+    std::mutex              m;
+    std::deque<pool_task>   tasks;
+  };
+
+  void worker_loop(const uint32_t &w);
+  bool pop_task(const uint32_t &w, pool_task &task);
+  bool steal_task(const uint32_t &w, pool_task &task);
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  std::vector<std::thread>                  workers;
+  std::vector<std::unique_ptr<task_queue>>  queues;
+  std::mutex                                m;          // Guards sleeping and waking up.
+  std::condition_variable                   work_cv;    // Signaled when a task is queued.
+  std::condition_variable                   done_cv;    // Signaled when all tasks are done.
+  std::atomic<uint64_t>                     queued;     // Number of tasks in the queues.
+  std::atomic<uint64_t>                     pending;    // Number of unfinished tasks.
+  std::atomic<uint32_t>                     next_queue; // Round robin index for external tasks.
+  bool                                      stop;
+};
+
+#endif //ELUCIDO_THREADPOOL_H
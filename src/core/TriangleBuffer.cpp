@@ -0,0 +1,227 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "TriangleBuffer.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+// The operations of the kernel are wrapped, so that the same kernel is
+// compiled for SSE and AVX. The order of the floating point operations is
+// the same as in triangle_intersect, so that both report the exact same
+// intersections.
+#if defined(__AVX__)
+#define ELUCIDO_SIMD_KERNEL
+typedef __m256 vfloat;
+inline vfloat   vload(const float_t *p)               { return _mm256_loadu_ps(p); }
+inline void     vstore(float_t *p, const vfloat &a)   { _mm256_storeu_ps(p, a); }
+inline vfloat   vset(const float_t &f)                { return _mm256_set1_ps(f); }
+inline vfloat   vadd(const vfloat &a, const vfloat &b) { return _mm256_add_ps(a, b); }
+inline vfloat   vsub(const vfloat &a, const vfloat &b) { return _mm256_sub_ps(a, b); }
+inline vfloat   vmul(const vfloat &a, const vfloat &b) { return _mm256_mul_ps(a, b); }
+inline vfloat   vdiv(const vfloat &a, const vfloat &b) { return _mm256_div_ps(a, b); }
+inline vfloat   vand(const vfloat &a, const vfloat &b) { return _mm256_and_ps(a, b); }
+inline vfloat   vor(const vfloat &a, const vfloat &b)  { return _mm256_or_ps(a, b); }
+inline vfloat   vlt(const vfloat &a, const vfloat &b)  { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat   vle(const vfloat &a, const vfloat &b)  { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline vfloat   vge(const vfloat &a, const vfloat &b)  { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline uint32_t vmask(const vfloat &a) { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+#elif defined(__SSE__)
+#define ELUCIDO_SIMD_KERNEL
+typedef __m128 vfloat;
+inline vfloat   vload(const float_t *p)               { return _mm_loadu_ps(p); }
+inline void     vstore(float_t *p, const vfloat &a)   { _mm_storeu_ps(p, a); }
+inline vfloat   vset(const float_t &f)                { return _mm_set1_ps(f); }
+inline vfloat   vadd(const vfloat &a, const vfloat &b) { return _mm_add_ps(a, b); }
+inline vfloat   vsub(const vfloat &a, const vfloat &b) { return _mm_sub_ps(a, b); }
+inline vfloat   vmul(const vfloat &a, const vfloat &b) { return _mm_mul_ps(a, b); }
+inline vfloat   vdiv(const vfloat &a, const vfloat &b) { return _mm_div_ps(a, b); }
+inline vfloat   vand(const vfloat &a, const vfloat &b) { return _mm_and_ps(a, b); }
+inline vfloat   vor(const vfloat &a, const vfloat &b)  { return _mm_or_ps(a, b); }
+inline vfloat   vlt(const vfloat &a, const vfloat &b)  { return _mm_cmplt_ps(a, b); }
+inline vfloat   vle(const vfloat &a, const vfloat &b)  { return _mm_cmple_ps(a, b); }
+inline vfloat   vge(const vfloat &a, const vfloat &b)  { return _mm_cmpge_ps(a, b); }
+inline uint32_t vmask(const vfloat &a) { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+#endif
+}
+
+//==============================================================================
+void TriangleBuffer::resize(const uint32_t &n) {
+  nt = n;
+
+  // Packets starting at one of the last triangles read past the end.
+  size_t padded_size = n + kTrianglePacketWidth - 1;
+  for (auto a : {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z}) {
+    a->assign(padded_size, 0.f);
+  }
+}
+
+//==============================================================================
+void TriangleBuffer::set(const uint32_t &i,
+                         const glm::vec4 &v0,
+                         const glm::vec4 &v1,
+                         const glm::vec4 &v2) {
+  auto edge1 = v1 - v0;
+  auto edge2 = v2 - v0;
+
+  v0x[i] = v0.x;    v0y[i] = v0.y;    v0z[i] = v0.z;
+  e1x[i] = edge1.x; e1y[i] = edge1.y; e1z[i] = edge1.z;
+  e2x[i] = edge2.x; e2y[i] = edge2.y; e2z[i] = edge2.z;
+}
+
+//==============================================================================
+uint32_t TriangleBuffer::test_packet(const Ray &r,
+                                     const uint32_t &first,
+                                     const uint32_t &mask,
+                                     const float_t &t_max,
+                                     float_t *t,
+                                     float_t *u,
+                                     float_t *v,
+                                     float_t *d) const {
+  glm::vec4 o = r.orig();
+  glm::vec4 dir = r.dir();
+
+#if defined(ELUCIDO_SIMD_KERNEL)
+  vfloat dx = vset(dir.x), dy = vset(dir.y), dz = vset(dir.z);
+  vfloat ax = vload(&e1x[first]), ay = vload(&e1y[first]), az = vload(&e1z[first]);
+  vfloat bx = vload(&e2x[first]), by = vload(&e2y[first]), bz = vload(&e2z[first]);
+
+  // p = dir x edge2
+  vfloat px = vsub(vmul(dy, bz), vmul(by, dz));
+  vfloat py = vsub(vmul(dz, bx), vmul(bz, dx));
+  vfloat pz = vsub(vmul(dx, by), vmul(bx, dy));
+  vfloat det = vadd(vadd(vmul(ax, px), vmul(ay, py)), vmul(az, pz));
+  vfloat valid = vor(vle(det, vset(-kEpsilon)), vge(det, vset(kEpsilon)));
+  vfloat inv_det = vdiv(vset(1.f), det);
+
+  // Distance vector from vertex 0 to the ray origin.
+  vfloat tx = vsub(vset(o.x), vload(&v0x[first]));
+  vfloat ty = vsub(vset(o.y), vload(&v0y[first]));
+  vfloat tz = vsub(vset(o.z), vload(&v0z[first]));
+
+  vfloat uu = vmul(vadd(vadd(vmul(tx, px), vmul(ty, py)), vmul(tz, pz)), inv_det);
+  valid = vand(valid, vand(vge(uu, vset(0.f)), vle(uu, vset(1.f))));
+
+  // q = t_vec x edge1
+  vfloat qx = vsub(vmul(ty, az), vmul(ay, tz));
+  vfloat qy = vsub(vmul(tz, ax), vmul(az, tx));
+  vfloat qz = vsub(vmul(tx, ay), vmul(ax, ty));
+
+  vfloat vv = vmul(vadd(vadd(vmul(dx, qx), vmul(dy, qy)), vmul(dz, qz)), inv_det);
+  valid = vand(valid, vand(vge(vv, vset(0.f)), vle(vadd(vv, uu), vset(1.f))));
+
+  vfloat tt = vmul(vadd(vadd(vmul(bx, qx), vmul(by, qy)), vmul(bz, qz)), inv_det);
+  valid = vand(valid, vand(vge(tt, vset(0.f)), vlt(tt, vset(t_max))));
+
+  vstore(t, tt);
+  vstore(u, uu);
+  vstore(v, vv);
+  vstore(d, det);
+  return vmask(valid) & mask;
+#else
+  // Scalar fallback for platforms without SSE.
+  uint32_t hits{0};
+  for (uint32_t l = 0; l < kTrianglePacketWidth; l++) {
+    if (!(mask & (1u << l))) continue;
+    uint32_t i = first + l;
+
+    float_t px = dir.y * e2z[i] - e2y[i] * dir.z;
+    float_t py = dir.z * e2x[i] - e2z[i] * dir.x;
+    float_t pz = dir.x * e2y[i] - e2x[i] * dir.y;
+    d[l] = (e1x[i] * px + e1y[i] * py) + e1z[i] * pz;
+    if (d[l] > -kEpsilon && d[l] < kEpsilon) continue;
+    float_t inv_det = 1.f / d[l];
+
+    float_t tx = o.x - v0x[i], ty = o.y - v0y[i], tz = o.z - v0z[i];
+    u[l] = ((tx * px + ty * py) + tz * pz) * inv_det;
+    if (u[l] < 0.f || u[l] > 1.f) continue;
+
+    float_t qx = ty * e1z[i] - e1y[i] * tz;
+    float_t qy = tz * e1x[i] - e1z[i] * tx;
+    float_t qz = tx * e1y[i] - e1x[i] * ty;
+    v[l] = ((dir.x * qx + dir.y * qy) + dir.z * qz) * inv_det;
+    if (v[l] < 0.f || v[l] + u[l] > 1.f) continue;
+
+    t[l] = ((e2x[i] * qx + e2y[i] * qy) + e2z[i] * qz) * inv_det;
+    if (t[l] < 0.f || !(t[l] < t_max)) continue;
+
+    hits |= 1u << l;
+  }
+  return hits;
+#endif
+}
+
+//==============================================================================
+bool TriangleBuffer::intersect_packet(const Ray &r,
+                                      const uint32_t &first,
+                                      const uint32_t &mask,
+                                      const float_t &t_max,
+                                      triangle_hit &th) const {
+  float_t t[kTrianglePacketWidth], u[kTrianglePacketWidth],
+          v[kTrianglePacketWidth], d[kTrianglePacketWidth];
+
+  uint32_t hits = test_packet(r, first, mask, t_max, t, u, v, d);
+  if (hits == 0) return false;
+
+  // Triangles are tested in order, so with equal distances the triangle
+  // with the lowest index wins.
+  float_t closest = t_max;
+  for (uint32_t l = 0; l < kTrianglePacketWidth; l++) {
+    if ((hits & (1u << l)) && t[l] < closest) {
+      closest = t[l];
+      th.t = t[l];
+      th.u = u[l];
+      th.v = v[l];
+      th.i = first + l;
+      th.fp = d[l] < kEpsilon;
+    }
+  }
+
+  return true;
+}
+
+//==============================================================================
+bool TriangleBuffer::occluded_packet(const Ray &r,
+                                     const uint32_t &first,
+                                     const uint32_t &mask,
+                                     const float_t &t_max) const {
+  float_t t[kTrianglePacketWidth], u[kTrianglePacketWidth],
+          v[kTrianglePacketWidth], d[kTrianglePacketWidth];
+
+  return test_packet(r, first, mask, t_max, t, u, v, d) != 0;
+}
+
+//==============================================================================
+bool TriangleBuffer::intersect_range(const Ray &r,
+                                     const uint32_t &begin,
+                                     const uint32_t &end,
+                                     const float_t &t_max,
+                                     triangle_hit &th) const {
+  bool intersected{false};
+  float_t closest = t_max;
+
+  for (uint32_t first = begin; first < end; first += kTrianglePacketWidth) {
+    if (intersect_packet(r, first, packet_mask(end - first), closest, th)) {
+      intersected = true;
+      closest = th.t;
+    }
+  }
+
+  return intersected;
+}
+
+//==============================================================================
+bool TriangleBuffer::occluded_range(const Ray &r,
+                                    const uint32_t &begin,
+                                    const uint32_t &end,
+                                    const float_t &t_max) const {
+  for (uint32_t first = begin; first < end; first += kTrianglePacketWidth) {
+    if (occluded_packet(r, first, packet_mask(end - first), t_max)) return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_TRIANGLEBUFFER_H
+#define ELUCIDO_TRIANGLEBUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "glm/vec4.hpp"
+
+#include "Utilities.h"
+#include "Ray.h"
+
+// Number of triangles tested at once by the packet kernels: 8 with AVX,
+// 4 with SSE or with the scalar fallback.
+#if defined(__AVX__)
+const uint32_t kTrianglePacketWidth = 8;
+#else
+const uint32_t kTrianglePacketWidth = 4;
+#endif
+
+// Closest intersection found within a packet of triangles.
+struct triangle_hit {
+  float_t   t;      // Distance from the ray's origin to the intersection point.
+  float_t   u;      // Barycentric coordinate u.
+  float_t   v;      // Barycentric coordinate v.
+  uint32_t  i;      // Index of the intersected triangle in the buffer.
+  bool      fp;     // Flip normal.
+};
+
+/**
+ * Structure-of-arrays store of triangles, which are precomputed for the
+ * Moeller-Trumbore intersection test: for every triangle its vertex v0 and
+ * its two edges (v1 - v0) and (v2 - v0) are stored. The packet kernels
+ * test a ray against kTrianglePacketWidth consecutive triangles at once.
+ * Triangles, which are not set, are degenerate and never intersected.
+ */
+class TriangleBuffer {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  TriangleBuffer() {}
+  ~TriangleBuffer() {}
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  /**
+   * Resizes the buffer to n degenerate triangles. The arrays are padded, so
+   * that a packet could start at any triangle of the buffer.
+   * @param n: The number of triangles.
+   */
+  void resize(const uint32_t &n);
+
+  void set(const uint32_t &i,
+           const glm::vec4 &v0,
+           const glm::vec4 &v1,
+           const glm::vec4 &v2);
+
+  inline uint32_t size() const { return nt; }
+
+  /**
+   * Intersects the ray with the packet of triangles starting at the index
+   * first. Only the triangles, whose bit in the mask is set, are tested.
+   * The results are exactly the same as the ones of triangle_intersect.
+   * @param r:      The ray with which the triangles would be intersected.
+   * @param first:  Index of the packet's first triangle.
+   * @param mask:   Bit l is set, if triangle first + l should be tested.
+   * @param t_max:  Only intersections closer than t_max are reported.
+   * @param th:     The closest intersection in the packet.
+   * @return:       True in case of an intersection closer than t_max.
+   */
+  bool intersect_packet(const Ray &r,
+                        const uint32_t &first,
+                        const uint32_t &mask,
+                        const float_t &t_max,
+                        triangle_hit &th) const;
+
+  /**
+   * Same as intersect_packet, but only checks if any of the triangles
+   * blocks the ray before t_max.
+   */
+  bool occluded_packet(const Ray &r,
+                       const uint32_t &first,
+                       const uint32_t &mask,
+                       const float_t &t_max) const;
+
+  /**
+   * Intersects the ray with all triangles with indices in [begin, end).
+   */
+  bool intersect_range(const Ray &r,
+                       const uint32_t &begin,
+                       const uint32_t &end,
+                       const float_t &t_max,
+                       triangle_hit &th) const;
+  bool occluded_range(const Ray &r,
+                      const uint32_t &begin,
+                      const uint32_t &end,
+                      const float_t &t_max) const;
+
+  /**
+   * Returns the mask, which selects the first n triangles of a packet.
+   */
+  static inline uint32_t packet_mask(const uint32_t &n) {
+    return n >= kTrianglePacketWidth ? (1u << kTrianglePacketWidth) - 1
+                                     : (1u << n) - 1;
+  }
+
+ private:
+  /**
+   * Tests the ray against all triangles of the packet starting at first.
+   * The distance, the barycentric coordinates and the determinant of every
+   * triangle are stored in t, u, v and d.
+   * @return: The mask of the triangles selected by mask, which are
+   *          intersected closer than t_max.
+   */
+  uint32_t test_packet(const Ray &r,
+                       const uint32_t &first,
+                       const uint32_t &mask,
+                       const float_t &t_max,
+                       float_t *t,
+                       float_t *u,
+                       float_t *v,
+                       float_t *d) const;
+
+//==============================================================================
+// Data members
+//==============================================================================
+ private:
+  std::vector<float_t>  v0x, v0y, v0z;  // Vertex 0.
+  std::vector<float_t>  e1x, e1y, e1z;  // Edge from vertex 0 to vertex 1.
+  std::vector<float_t>  e2x, e2y, e2z;  // Edge from vertex 0 to vertex 2.
+  uint32_t              nt{0};          // Number of triangles.
+};
+
+#endif //ELUCIDO_TRIANGLEBUFFER_H
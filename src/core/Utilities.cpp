@@ -35,6 +35,12 @@ bool set_camera_property(
       return false;
     }
 
+    /// Rays in world space; supported by all camera types.
+    if (CAMERA_SET_PROPERTIES.at(property) == camera_world_space) {
+      cameras.at(name).world_space = std::stoi(property_value) != 0;
+      return true;
+    }
+
     /// Zoom factor; set the property.
     if (CAMERA_SET_PROPERTIES.at(property) == camera_zoom_factor &&
         cameras.at(name).type == orthographic) {
@@ -283,6 +289,15 @@ bool set_image_plane_property(const std::string &property,
              PIXEL_FILTER_MAP.find(property_value) != PIXEL_FILTER_MAP.end()) {
     auto pf = PIXEL_FILTER_MAP.at(property_value);
     image_planes.at(name).pixel_filter = pf;
+  /// Number of render threads.
+  } else if (IMAGE_PLANE_PROPERTIES_MAP.at(property) == number_threads) {
+    auto val = static_cast<uint32_t>(std::stoi(property_value));
+    image_planes.at(name).number_threads = val;
+  /// Tile size.
+  } else if (IMAGE_PLANE_PROPERTIES_MAP.at(property) == tile_size) {
+    auto val = static_cast<uint32_t>(std::stoi(property_value));
+    if (val == 0) return false;
+    image_planes.at(name).tile_size = val;
   } else {
     // In case an invalid output type is specified.
     return false;
@@ -307,6 +322,32 @@ bool set_accel_str_property(const std::string &property,
     } else if (AC_PROPERTIES_MAP.at(property) == max_resolution) {
       acc_strs.at(name).max_resolution =
           static_cast<uint32_t>(std::stoi(property_value));
+    /// Cost of traversing a node.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_traversal_cost) {
+      acc_strs.at(name).traversal_cost = std::stof(property_value);
+    /// Cost of intersecting a primitive.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_intersection_cost) {
+      acc_strs.at(name).intersection_cost = std::stof(property_value);
+    /// Maximal tree depth.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_max_depth) {
+      acc_strs.at(name).max_depth =
+          static_cast<uint32_t>(std::stoi(property_value));
+    /// Maximal number of primitives in a leaf.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_max_primitives) {
+      acc_strs.at(name).max_primitives =
+          static_cast<uint32_t>(std::stoi(property_value));
+    /// Growth of the node area, up to which a refitted tree is kept.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_refit_threshold) {
+      acc_strs.at(name).refit_threshold = std::stof(property_value);
+    /// Skip empty cells of a grid with a distance field.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_distance_field) {
+      acc_strs.at(name).distance_field = std::stoi(property_value) != 0;
+    /// Insert triangles only into the grid cells, which they overlap.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_exact_insertion) {
+      acc_strs.at(name).exact_insertion = std::stoi(property_value) != 0;
+    /// Directory, in which built structures are cached.
+    } else if (AC_PROPERTIES_MAP.at(property) == as_cache_directory) {
+      acc_strs.at(name).cache_directory = property_value;
     }
   } else {
     return false;
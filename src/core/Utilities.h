@@ -33,6 +33,8 @@ const float_t bias = 0.0001;            // shadow bias is used for avoiding self
 const uint32_t max_depth = 5;           // maximum depth of recursion
 const glm::vec3 bgc(lightslategray);    // background color
 
+const size_t kCacheLineSize = 64;      // size of a cache line in bytes
+
 const std::string vertex("v");
 const std::string vertex_normal("vn");
 const std::string face("f");
@@ -117,12 +119,14 @@ const std::map<std::string, SceneThings> AVAILABLE_THINGS = {
 enum CameraSetProperties {
   camera_type,
   camera_zoom_factor,
-  camera_fov
+  camera_fov,
+  camera_world_space
 };
 const std::map<std::string, CameraSetProperties> CAMERA_SET_PROPERTIES = {
     {"type",        camera_type},
     {"zoom_factor", camera_zoom_factor},
-    {"fov",         camera_fov}
+    {"fov",         camera_fov},
+    {"world_space", camera_world_space}
 };
 
 // Available camera types +
@@ -267,7 +271,9 @@ enum ImagePlaneProperty {
   use_gamma,
   number_samples,
   sampling_strategy,
-  pixel_filter
+  pixel_filter,
+  number_threads,
+  tile_size
 };
 const std::map<std::string, ImagePlaneProperty> IMAGE_PLANE_PROPERTIES_MAP = {
     {"output_type",       output_type},
@@ -276,7 +282,9 @@ const std::map<std::string, ImagePlaneProperty> IMAGE_PLANE_PROPERTIES_MAP = {
     {"gamma",             use_gamma},
     {"number_samples",    number_samples},
     {"sampling_strategy", sampling_strategy},
-    {"pixel_filter",      pixel_filter}
+    {"pixel_filter",      pixel_filter},
+    {"threads",           number_threads},
+    {"tile_size",         tile_size}
 };
 
 // Available sampling strategies + corresponding mappings for the parser.
@@ -314,12 +322,28 @@ const std::map<std::string, PixelFilter> PIXEL_FILTER_MAP = {
 enum AccelerationStructureProperties {
   alpha,
   max_resolution,
-  as_type
+  as_type,
+  as_traversal_cost,
+  as_intersection_cost,
+  as_max_depth,
+  as_max_primitives,
+  as_refit_threshold,
+  as_distance_field,
+  as_exact_insertion,
+  as_cache_directory
 };
 const std::map<std::string, AccelerationStructureProperties> AC_PROPERTIES_MAP = {
-    {"alpha",           alpha},
-    {"max_resolution",  max_resolution},
-    {"type",            as_type}
+    {"alpha",             alpha},
+    {"max_resolution",    max_resolution},
+    {"type",              as_type},
+    {"traversal_cost",    as_traversal_cost},
+    {"intersection_cost", as_intersection_cost},
+    {"max_depth",         as_max_depth},
+    {"max_primitives",    as_max_primitives},
+    {"refit_threshold",   as_refit_threshold},
+    {"distance_field",    as_distance_field},
+    {"exact_insertion",   as_exact_insertion},
+    {"cache_directory",   as_cache_directory}
 };
 
 // Available accelerators structure types +
@@ -328,12 +352,22 @@ enum AccelerationStructureType {
   not_set_act,
   grid,
   compact_grid,
-  kdtree_midpoint
+  kdtree_midpoint,
+  kdtree_sah,
+  bvh,
+  two_level,
+  lbvh,
+  hierarchical_grid
 };
 const std::map<std::string, AccelerationStructureType> AC_TYPES_MAP = {
-    {"grid",            grid},
-    {"compact_grid",    compact_grid},
-    {"kdtree_midpoint", kdtree_midpoint}
+    {"grid",              grid},
+    {"compact_grid",      compact_grid},
+    {"kdtree_midpoint",   kdtree_midpoint},
+    {"kdtree_sah",        kdtree_sah},
+    {"bvh",               bvh},
+    {"two_level",         two_level},
+    {"lbvh",              lbvh},
+    {"hierarchical_grid", hierarchical_grid}
 };
 
 // Available animation properties +
@@ -448,11 +482,13 @@ struct camera_description {
   CameraType                                type;
   std::pair<CameraProperty, float_t>        property;
   std::vector<transformation_description>   transformations;
+  bool                                      world_space;  // Emit rays in world space.
   camera_description(const std::string &_name) :
       name(_name),
       type(not_set_ct),
       property({not_set_cp, 0.f}),
-      transformations({}) {}
+      transformations({}),
+      world_space(false) {}
 };
 
 struct light_description {
@@ -509,6 +545,8 @@ struct image_plane_description {
   uint32_t            number_samples;
   SamplingStrategy    sampling_strategy;
   PixelFilter         pixel_filter;
+  uint32_t            number_threads; // 0: use all hardware threads.
+  uint32_t            tile_size;      // Edge length of a tile in pixels.
   image_plane_description(const std::string &_name) :
       name(_name),
       output_type(not_set_out),
@@ -517,7 +555,9 @@ struct image_plane_description {
       use_gamma(0),
       number_samples(1),
       sampling_strategy(random_sampling),
-      pixel_filter(box_filter)
+      pixel_filter(box_filter),
+      number_threads(0),
+      tile_size(16)
   {}
 };
 
@@ -526,11 +566,29 @@ struct acceleration_structure_description {
   AccelerationStructureType   type;
   float_t                     alpha;
   uint32_t                    max_resolution;
+  float_t                     traversal_cost;     // 0: use the structure's default.
+  float_t                     intersection_cost;  // 0: use the structure's default.
+  uint32_t                    max_depth;          // 0: use the structure's default.
+  uint32_t                    max_primitives;     // 0: use the structure's default.
+  float_t                     refit_threshold;    // 0: use the structure's default.
+  bool                        distance_field;     // Skip empty cells of a grid.
+  bool                        exact_insertion;    // Insert triangles only into
+                                                  // the grid cells they overlap.
+  std::string                 cache_directory;    // Empty: don't cache the built
+                                                  // structure.
   acceleration_structure_description(const std::string &_name) :
       name(_name),
       type(not_set_act),
       alpha(0.f),
-      max_resolution(0) {}
+      max_resolution(0),
+      traversal_cost(0.f),
+      intersection_cost(0.f),
+      max_depth(0),
+      max_primitives(0),
+      refit_threshold(0.f),
+      distance_field(false),
+      exact_insertion(false),
+      cache_directory() {}
 };
 
 struct animation_description {
@@ -570,6 +628,10 @@ struct mesh_loading_info {
   uint32_t nvn{0};    // Number of vertex normals.
   uint32_t nf{0};     // Number of faces.
   uint32_t nt{0};     // Number of triangles.
+  uint64_t nb{0};     // Number of bytes read.
+  float_t  mbs{0};    // Loading throughput in MB/s.
+  bool     c{false};  // Loaded from the binary mesh cache.
+  bool     s{false};  // Shares the geometry of an already loaded mesh.
   bool     l{false};  // Successfully loaded mesh.
 };
 
@@ -582,6 +644,36 @@ struct render_info {
   uint64_t nrpt{0};   // Number of ray-primitive intersection tests.
   uint64_t nroi{0};   // Number of ray-object intersections; ray-bounding box intersection does not count
                       // as a valid ray-object intersection; so just ray-object intersections are counted
+  uint64_t nmt{0};    // Number of ray-primitive intersection tests avoided by mailboxing.
+  uint64_t nds{0};    // Number of steps of the grid traversals.
+
+  render_info& operator+=(const render_info &ri) {
+    npr  += ri.npr;
+    nsr  += ri.nsr;
+    nrr  += ri.nrr;
+    nrrr += ri.nrrr;
+    nrpt += ri.nrpt;
+    nroi += ri.nroi;
+    nmt  += ri.nmt;
+    nds  += ri.nds;
+    return *this;
+  }
+};
+
+// Render statistics of a single worker. The counters are padded on both
+// sides, so that they never share a cache line with the counters of another
+// worker, regardless of where the block is allocated.
+struct render_info_block {
+  char        lp[kCacheLineSize];   // Leading padding.
+  render_info ri;
+  char        tp[kCacheLineSize];   // Trailing padding.
+};
+
+struct image_tile {
+  uint32_t x0;  // Leftmost column of the tile.
+  uint32_t y0;  // Topmost row of the tile.
+  uint32_t x1;  // One past the rightmost column of the tile.
+  uint32_t y1;  // One past the bottommost row of the tile.
 };
 
 struct isect_info {
@@ -595,6 +687,9 @@ struct isect_info {
   bool                    fp;   // Flip normal.
   uint64_t                nrpt; // Number of ray-primitive intersection tests.
                                 // It's used inside an acceleration structure.
+  uint64_t                nmt;  // Number of ray-primitive intersection tests
+                                // avoided by mailboxing.
+  uint64_t                nds;  // Number of steps of a grid traversal.
   std::shared_ptr<Object> ho;   // Pointer to the object hit by a ray.
   isect_info() :
       ip{infinity},
@@ -605,23 +700,53 @@ struct isect_info {
       ti{},
       fp{false},
       ho{nullptr},
-      nrpt{0}
+      nrpt{0},
+      nmt{0},
+      nds{0}
   {}
 };
 
+// Information gathered during an occlusion (any-hit) query, for which no
+// intersection information is computed.
+struct traversal_info {
+  uint32_t w{0};      // Index of the worker tracing the ray; selects the
+                      // worker's mailbox of a grid.
+  uint64_t nrpt{0};   // Number of ray-primitive intersection tests.
+  uint64_t nmt{0};    // Number of ray-primitive intersection tests avoided
+                      // by mailboxing.
+  uint64_t nds{0};    // Number of steps of a grid traversal; a step either
+                      // moves to the next cell or skips empty cells.
+};
+
 struct as_construct_info {
   size_t    d{0};     // Duration of the construction in ms.
+  uint32_t  nt{1};    // Number of construction threads.
+  float_t   su{1.f};  // Speedup of the parallel construction.
+  bool      c{false}; // Loaded from the acceleration structure cache.
 
   // Grid-related information.
   uint32_t  r[3];    // Grid's resolution.
   uint32_t  nfc{0};  // Number of non-empty cells.
   float_t   npnc{0}; // Number of primitives per non-empty cell.
+  uint32_t  nsg{0};  // Number of sub-grids.
+
+  // Tree-related information.
+  uint32_t  nn{0};   // Number of nodes.
+  uint32_t  nl{0};   // Number of leaves.
+  float_t   npl{0};  // Average number of primitives per leaf.
+  bool      rf{false}; // The node bounds were refitted instead of
+                       // rebuilding the tree.
+
+  // Two-level-related information.
+  uint32_t  ni{0};   // Number of instances.
+  uint32_t  nb{0};   // Number of bottom-level structures built.
 };
 
 struct scene_info {
   uint32_t no{0}; // Number of objects.
   uint32_t nl{0}; // Number of light sources.
   uint32_t np{0}; // Number of primitives.
+  size_t   lt{0}; // Time for loading the objects in ms.
 };
 
 struct material {
@@ -654,6 +779,15 @@ struct ip_sample {
       evaluated{true} {}
 };
 
+// Render statistics are collected only if elucido is built with the
+// ELUCIDO_RENDER_STATISTICS option; otherwise updating them compiles to
+// nothing. The unevaluated operand keeps the arguments used.
+#ifdef ELUCIDO_RENDER_STATISTICS
+#define STAT_ADD(counter, amount) ((counter) += (amount))
+#else
+#define STAT_ADD(counter, amount) ((void) sizeof((counter) += (amount)))
+#endif
+
 //------------------------------------------------------------------------------
 // FUNCTION DEFINITIONS
 //------------------------------------------------------------------------------
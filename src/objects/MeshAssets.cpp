@@ -0,0 +1,82 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "MeshAssets.h"
+
+#include <climits>
+#include <cstdlib>
+
+#include "MeshCache.h"
+#include "TriangleMesh.h"
+
+//==============================================================================
+MeshAssets & MeshAssets::instance() {
+  static MeshAssets assets;
+  return assets;
+}
+
+//==============================================================================
+std::shared_ptr<const mesh_asset> MeshAssets::acquire(const std::string &f,
+                                                      const uint32_t &number_threads,
+                                                      bool &loaded) {
+  loaded = false;
+
+  // different paths to the same file share the asset
+  char rp[PATH_MAX];
+  std::string key = (realpath(f.c_str(), rp) != nullptr) ? std::string(rp) : f;
+
+  std::shared_ptr<entry> e;
+  {
+    std::lock_guard<std::mutex> lock(m);
+    auto &s = entries[key];
+    if (!s) s = std::make_shared<entry>();
+    e = s;
+  }
+
+  std::lock_guard<std::mutex> lock(e->m);
+  uint64_t ss{0};
+  int64_t sm{0};
+  bool stamped = file_stamp(f.c_str(), ss, sm);
+
+  auto a = e->a.lock();
+  if (a && stamped && ss == e->ss && sm == e->sm) return a;
+
+  TriangleMesh tm;
+  auto li = tm.load_cached_mesh(f.c_str(), number_threads);
+  if (!li.l) return nullptr;
+
+  tm.build_triangle_buffer();
+
+  auto na = std::make_shared<mesh_asset>();
+  na->va   = std::move(tm.va);
+  na->vna  = std::move(tm.vna);
+  na->via  = std::move(tm.via);
+  na->vnia = std::move(tm.vnia);
+  na->nt   = tm.nt;
+  na->nf   = tm.nf;
+  na->bb   = tm.bounding_box();
+  na->tb   = std::move(tm.tb);
+  na->li   = li;
+
+  e->a  = na;
+  e->ss = ss;
+  e->sm = sm;
+  loaded = true;
+  return na;
+}
+
+//==============================================================================
+size_t MeshAssets::size() {
+  std::lock_guard<std::mutex> lock(m);
+  size_t n{0};
+  for (auto it = entries.begin(); it != entries.end();) {
+    // entries, which are being loaded, are still held by the loader
+    if (it->second->a.expired() && it->second.use_count() == 1) {
+      it = entries.erase(it);
+    } else {
+      if (!it->second->a.expired()) n++;
+      ++it;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_MESHASSETS_H
+#define ELUCIDO_MESHASSETS_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "glm/vec4.hpp"
+
+#include "../accelerators/AABBox.h"
+#include "../core/Buffer.h"
+#include "../core/TriangleBuffer.h"
+#include "../core/Utilities.h"
+
+/**
+ * The immutable geometry of a loaded mesh file; shared by all triangle
+ * meshes placing the file in a scene.
+ */
+struct mesh_asset {
+  Buffer<glm::vec4>   va;     // Vertex array.
+  Buffer<glm::vec4>   vna;    // Vertex normal array.
+  Buffer<uint32_t>    via;    // Vertex index array.
+  Buffer<uint32_t>    vnia;   // Vertex normal index array.
+  uint32_t            nt{0};  // Number of triangles.
+  uint32_t            nf{0};  // Number of faces.
+  AABBox              bb;     // Bounding box of the vertices.
+  TriangleBuffer      tb;     // Triangles of the vertices; intersected by
+                              // all meshes placing the file.
+  mesh_loading_info   li;     // Information about loading the file.
+};
+
+/**
+ * Process-wide registry of loaded mesh files. A file is loaded only once
+ * while any mesh still references its asset; the asset is released with
+ * the last reference. Different files are loaded concurrently, requests for
+ * a file, which is being loaded, wait for it.
+ */
+class MeshAssets {
+//==============================================================================
+// Constructors & destructors
+//==============================================================================
+ public:
+  MeshAssets(const MeshAssets &) = delete;
+  MeshAssets& operator=(const MeshAssets &) = delete;
+
+  static MeshAssets & instance();
+
+//==============================================================================
+// Function declarations
+//==============================================================================
+  /**
+   * Returns the asset of the OBJ file f, which is loaded through its
+   * binary mesh cache, if it isn't loaded yet or if the file changed since
+   * it was loaded.
+   * @param f:              Path to the OBJ file.
+   * @param number_threads: Maximal number of threads parsing the file.
+   * @param loaded:         True, if the file was loaded by this call.
+   * @return:               The asset; null, if the file couldn't be loaded.
+   */
+  std::shared_ptr<const mesh_asset> acquire(const std::string &f,
+                                            const uint32_t &number_threads,
+                                            bool &loaded);
+
+  /**
+   * Returns the number of assets, which are still referenced.
+   */
+  size_t size();
+
+ private:
+  MeshAssets() {}
+
+  struct entry {
+    std::mutex                        m;
+    std::weak_ptr<const mesh_asset>   a;
+    uint64_t                          ss{0};  // Size of the loaded file.
+    int64_t                           sm{0};  // Modification time of the
+                                              // loaded file.
+  };
+
+//==============================================================================
+// Data members
+//==============================================================================
+  std::mutex                                              m;
+  std::unordered_map<std::string, std::shared_ptr<entry>> entries;  // Keyed by
+                                                                    // the real
+                                                                    // path.
+};
+
+#endif //ELUCIDO_MESHASSETS_H
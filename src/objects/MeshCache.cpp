@@ -0,0 +1,15 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "MeshCache.h"
+
+#include <sys/stat.h>
+
+//==============================================================================
+bool file_stamp(const char *f, uint64_t &size, int64_t &mtime) {
+  struct stat st;
+  if (stat(f, &st) != 0) return false;
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
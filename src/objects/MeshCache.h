@@ -0,0 +1,66 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_MESHCACHE_H
+#define ELUCIDO_MESHCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary mesh cache files are stored next to their OBJ file with this
+// extension appended.
+const char kMeshCacheExtension[] = ".emc";
+const char kMeshCacheMagic[8] = {'E', 'L', 'U', 'M', 'E', 'S', 'H', '\0'};
+const uint32_t kMeshCacheVersion = 1;
+const uint64_t kMeshCacheAlignment = 64;  // Of the arrays in the file.
+
+/**
+ * Header of a binary mesh cache file. The vertex, vertex normal, vertex
+ * index and vertex normal index arrays follow at the given offsets; they
+ * are stored exactly as in a TriangleMesh, so that a mapped file can be
+ * used without any conversion.
+ */
+struct mesh_cache_header {
+  char      magic[8];           // kMeshCacheMagic.
+  uint32_t  version{0};         // kMeshCacheVersion.
+  uint32_t  nv{0};              // Number of vertices.
+  uint32_t  nvn{0};             // Number of vertex normals.
+  uint32_t  ni{0};              // Number of vertex (normal) indices.
+  uint32_t  nt{0};              // Number of triangles.
+  uint32_t  nf{0};              // Number of faces.
+  uint64_t  ss{0};              // Size of the source file.
+  int64_t   sm{0};              // Modification time of the source file.
+  float     min[4];             // Bounding box of the vertices.
+  float     max[4];
+  uint64_t  ov{0};              // Offset of the vertices.
+  uint64_t  on{0};              // Offset of the vertex normals.
+  uint64_t  oi{0};              // Offset of the vertex indices.
+  uint64_t  oni{0};             // Offset of the vertex normal indices.
+};
+
+/**
+ * Returns the path of the cache file for the OBJ file source.
+ */
+inline std::string mesh_cache_path(const std::string &source) {
+  return source + kMeshCacheExtension;
+}
+
+/**
+ * Reads the size and the modification time of a file, which identify the
+ * version of a source file a cache was generated from.
+ * @param f:      Path to the file.
+ * @param size:   The size of the file in bytes.
+ * @param mtime:  The modification time of the file.
+ * @return:       False, if the file doesn't exist.
+ */
+bool file_stamp(const char *f, uint64_t &size, int64_t &mtime);
+
+/**
+ * Rounds o up to the next multiple of kMeshCacheAlignment.
+ */
+inline uint64_t mesh_cache_align(const uint64_t &o) {
+  return (o + kMeshCacheAlignment - 1) / kMeshCacheAlignment * kMeshCacheAlignment;
+}
+
+#endif //ELUCIDO_MESHCACHE_H
@@ -0,0 +1,260 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "glm/common.hpp"
+
+namespace {
+// Powers of ten, which are exactly representable as float, respectively
+// double.
+const float kPow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f,
+                         1e9f, 1e10f};
+const double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                         1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+                         1e19, 1e20, 1e21, 1e22};
+const uint32_t kMaxDigits = 19;   // Significant digits fitting into 64 bit.
+
+inline bool is_digit(const char &c) { return c >= '0' && c <= '9'; }
+inline bool is_blank(const char &c) { return c == ' ' || c == '\t'; }
+inline bool is_separator(const char &c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline const char * skip_blanks(const char *p, const char *e) {
+  while (p < e && is_blank(*p)) p++;
+  return p;
+}
+
+inline const char * skip_line(const char *p, const char *e) {
+  while (p < e && *p != '\n') p++;
+  return (p < e) ? p + 1 : e;
+}
+
+// Converts [p, e) with std::strtof; used for numbers which the fast path
+// can't convert exactly, and for "inf" or "nan".
+const char * parse_float_fallback(const char *p, const char *e, float_t &f) {
+  const char *q = p;
+  while (q < e && !is_separator(*q) && *q != '/') q++;
+  std::string t(p, q);
+  char *end;
+  float v = std::strtof(t.c_str(), &end);
+  if (end == t.c_str()) return p;
+  f = v;
+  return p + (end - t.c_str());
+}
+
+// Parses a face vertex of the form v, v/vt, v//vn or v/vt/vn; indices,
+// which aren't given, are 0.
+const char * parse_face_vertex(const char *p,
+                               const char *e,
+                               int64_t &v,
+                               int64_t &vn) {
+  int64_t vt;
+  v = vn = 0;
+  const char *q = parse_obj_int(p, e, v);
+  if (q == p) return p;
+  if (q < e && *q == '/') {
+    q = parse_obj_int(q + 1, e, vt);
+    if (q < e && *q == '/') q = parse_obj_int(q + 1, e, vn);
+  }
+  // Skip anything, which isn't part of a face vertex.
+  while (q < e && !is_separator(*q)) q++;
+  return q;
+}
+
+// Converts a parsed index into an index stored in the chunk. Negative
+// indices are relative to the last element parsed so far; they are stored
+// relative to the chunk's first element and their position is recorded,
+// so that the element offset of the chunk can be added when merging.
+inline uint32_t chunk_index(const int64_t &i,
+                            const size_t &number_elements,
+                            const size_t &position,
+                            std::vector<size_t> &relative) {
+  if (i >= 0) return static_cast<uint32_t>(i);
+  relative.push_back(position);
+  return static_cast<uint32_t>(static_cast<int64_t>(number_elements) + i + 1);
+}
+}
+
+//==============================================================================
+const char * parse_obj_float(const char *p, const char *e, float_t &f) {
+  const char *q = p;
+  bool negative{false};
+  if (q < e && (*q == '-' || *q == '+')) {
+    negative = *q == '-';
+    q++;
+  }
+
+  uint64_t m{0};            // Significant digits.
+  int32_t exponent{0};      // Decimal exponent of m.
+  uint32_t nd{0};           // Number of significant digits in m.
+  bool digits{false};       // Any digits before the exponent.
+  bool exact{true};         // No nonzero digits were dropped.
+
+  for (; q < e && is_digit(*q); q++) {
+    digits = true;
+    if (nd < kMaxDigits) {
+      m = 10 * m + (*q - '0');
+      if (m != 0) nd++;
+    } else {
+      exponent++;
+      if (*q != '0') exact = false;
+    }
+  }
+  if (q < e && *q == '.') {
+    for (q++; q < e && is_digit(*q); q++) {
+      digits = true;
+      if (nd < kMaxDigits) {
+        m = 10 * m + (*q - '0');
+        if (m != 0) nd++;
+        exponent--;
+      } else if (*q != '0') {
+        exact = false;
+      }
+    }
+  }
+  if (!digits) return parse_float_fallback(p, e, f);
+
+  if (q < e && (*q == 'e' || *q == 'E')) {
+    const char *r = q + 1;
+    bool negative_exponent{false};
+    if (r < e && (*r == '-' || *r == '+')) {
+      negative_exponent = *r == '-';
+      r++;
+    }
+    if (r < e && is_digit(*r)) {
+      int32_t x{0};
+      for (; r < e && is_digit(*r); r++) {
+        if (x < 100000) x = 10 * x + (*r - '0');
+      }
+      exponent += negative_exponent ? -x : x;
+      q = r;
+    }
+  }
+
+  if (m == 0) {
+    f = negative ? -0.f : 0.f;
+    return q;
+  }
+  if (!exact) return parse_float_fallback(p, e, f);
+
+  float v;
+  if (m <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+    // Both operands are exact floats; a single rounding gives the
+    // correctly rounded result.
+    v = static_cast<float>(m);
+    v = (exponent >= 0) ? v * kPow10f[exponent] : v / kPow10f[-exponent];
+  } else if (m < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+    double dv = static_cast<double>(m);
+    dv = (exponent >= 0) ? dv * kPow10[exponent] : dv / kPow10[-exponent];
+    v = static_cast<float>(dv);
+
+    // Rounding the rounded double to float is only wrong, if the double
+    // lies exactly halfway between two floats.
+    double rv = v;
+    if (rv != dv) {
+      float n = std::nextafter(v, (dv > rv) ? INFINITY : -INFINITY);
+      if (0.5 * (rv + static_cast<double>(n)) == dv) return parse_float_fallback(p, e, f);
+    }
+  } else {
+    return parse_float_fallback(p, e, f);
+  }
+
+  f = negative ? -v : v;
+  return q;
+}
+
+//==============================================================================
+const char * parse_obj_int(const char *p, const char *e, int64_t &i) {
+  const char *q = p;
+  bool negative{false};
+  if (q < e && (*q == '-' || *q == '+')) {
+    negative = *q == '-';
+    q++;
+  }
+  if (q == e || !is_digit(*q)) return p;
+
+  int64_t v{0};
+  for (; q < e && is_digit(*q); q++) v = 10 * v + (*q - '0');
+  i = negative ? -v : v;
+  return q;
+}
+
+//==============================================================================
+std::vector<std::pair<size_t, size_t>> split_obj_chunks(const char *b,
+                                                        const size_t &s,
+                                                        const uint32_t &number_chunks) {
+  std::vector<std::pair<size_t, size_t>> chunks;
+  size_t nc = std::max<size_t>(1, std::min<size_t>(number_chunks, s / kMinObjChunkSize));
+  size_t cs = s / nc;
+
+  size_t begin{0};
+  for (size_t c = 0; c < nc && begin < s; c++) {
+    size_t end = (c + 1 == nc) ? s : std::max(begin, (c + 1) * cs);
+    while (end < s && b[end - 1] != '\n') end++;
+    chunks.emplace_back(begin, end);
+    begin = end;
+  }
+  return chunks;
+}
+
+//==============================================================================
+void parse_obj_chunk(const char *b, const char *e, obj_chunk &c) {
+  std::vector<int64_t> fv, fvn;   // Indices of the current face.
+  int64_t v, vn;
+
+  const char *p = b;
+  while (p < e) {
+    p = skip_blanks(p, e);
+    if (e - p < 2) break;
+
+    // v:   vertex
+    // vn:  vertex normal
+    // f:   face
+    if (p[0] == 'v' && is_blank(p[1])) {
+      float_t x{0}, y{0}, z{0};
+      p = parse_obj_float(skip_blanks(p + 1, e), e, x);
+      p = parse_obj_float(skip_blanks(p, e), e, y);
+      p = parse_obj_float(skip_blanks(p, e), e, z);
+
+      glm::vec4 vx(x, y, z, 1);
+      c.min = glm::min(c.min, vx);
+      c.max = glm::max(c.max, vx);
+      c.va.push_back(vx);
+    } else if (p[0] == 'v' && p[1] == 'n' && e - p > 2 && is_blank(p[2])) {
+      float_t x{0}, y{0}, z{0};
+      p = parse_obj_float(skip_blanks(p + 2, e), e, x);
+      p = parse_obj_float(skip_blanks(p, e), e, y);
+      p = parse_obj_float(skip_blanks(p, e), e, z);
+      c.vna.push_back(glm::vec4(x, y, z, 0));
+    } else if (p[0] == 'f' && is_blank(p[1])) {
+      fv.clear();
+      fvn.clear();
+      p = skip_blanks(p + 1, e);
+      while (p < e) {
+        const char *q = parse_face_vertex(p, e, v, vn);
+        if (q == p) break;
+        fv.push_back(v);
+        fvn.push_back(vn);
+        p = skip_blanks(q, e);
+      }
+
+      // Each face with n vertices is split into n - 2 triangles.
+      for (size_t t = 0; t + 2 < fv.size(); t++) {
+        const size_t tv[3] = {0, t + 1, t + 2};
+        for (auto const &i : tv) {
+          c.via.push_back(chunk_index(fv[i], c.va.size(), c.via.size(), c.rvi));
+          c.vnia.push_back(chunk_index(fvn[i], c.vna.size(), c.vnia.size(), c.rni));
+        }
+        c.nt++;
+      }
+      c.nf++;
+    }
+    p = skip_line(p, e);
+  }
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#ifndef ELUCIDO_OBJPARSER_H
+#define ELUCIDO_OBJPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "glm/vec4.hpp"
+
+#include "../core/Utilities.h"
+
+// Chunks are at least that large, so that small files are parsed by the
+// calling thread only.
+const size_t kMinObjChunkSize = 1 << 20;
+
+// The geometry parsed from a chunk of an OBJ file.
+struct obj_chunk {
+  std::vector<glm::vec4>  va;       // Vertices.
+  std::vector<glm::vec4>  vna;      // Vertex normals.
+  std::vector<uint32_t>   via;      // Vertex indices of the triangles.
+  std::vector<uint32_t>   vnia;     // Vertex normal indices of the triangles.
+  std::vector<size_t>     rvi;      // Positions in via, which hold indices
+                                    // relative to the chunk's first vertex.
+  std::vector<size_t>     rni;      // Positions in vnia, which hold indices
+                                    // relative to the chunk's first normal.
+  glm::vec4               min{glm::vec4(glm::vec3(infinity), 1)};
+  glm::vec4               max{glm::vec4(glm::vec3(-infinity), 1)};
+  uint32_t                nf{0};    // Number of faces.
+  uint32_t                nt{0};    // Number of triangles.
+};
+
+/**
+ * Parses a decimal floating point number. Numbers, which can't be
+ * converted exactly with double arithmetic, are handed to std::strtof.
+ * @param p:    The first character of the number.
+ * @param e:    One past the last character of the buffer.
+ * @param f:    The parsed number.
+ * @return:     One past the last character of the number; p, if there
+ *              isn't a number at p.
+ */
+const char * parse_obj_float(const char *p, const char *e, float_t &f);
+
+/**
+ * Parses a signed decimal integer.
+ * @param p:    The first character of the number.
+ * @param e:    One past the last character of the buffer.
+ * @param i:    The parsed number.
+ * @return:     One past the last character of the number; p, if there
+ *              isn't a number at p.
+ */
+const char * parse_obj_int(const char *p, const char *e, int64_t &i);
+
+/**
+ * Splits the buffer into at most number_chunks ranges of about the same
+ * size; every range but the last ends right after a newline.
+ * @param b:              The buffer.
+ * @param s:              The size of the buffer.
+ * @param number_chunks:  The maximal number of ranges.
+ * @return:               Begin and end offsets of the ranges.
+ */
+std::vector<std::pair<size_t, size_t>> split_obj_chunks(const char *b,
+                                                        const size_t &s,
+                                                        const uint32_t &number_chunks);
+
+/**
+ * Parses the vertices, vertex normals and faces in the lines of [b, e).
+ * Faces with n vertices are split into a fan of n - 2 triangles; missing
+ * vertex normal indices are stored as 0.
+ * @param b:  The first character of the chunk.
+ * @param e:  One past the last character of the chunk.
+ * @param c:  The parsed geometry.
+ */
+void parse_obj_chunk(const char *b, const char *e, obj_chunk &c);
+
+#endif //ELUCIDO_OBJPARSER_H
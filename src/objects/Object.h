@@ -44,6 +44,17 @@ class Object {
 
   virtual bool intersect(const Ray &r, isect_info &i) const = 0;
 
+  /**
+   * Determines if the object blocks the ray before the distance t_max.
+   * Only the existence of such an intersection is determined; no
+   * intersection information is computed.
+   * @param r:      The ray with which the object would be intersected.
+   * @param t_max:  The maximal distance from the ray's origin, up to which
+   *                an intersection is considered.
+   * @return:       True if the ray is blocked before t_max, false otherwise.
+   */
+  virtual bool occluded(const Ray &r, const float_t &t_max) const = 0;
+
   virtual void apply_camera_transformation(const glm::mat4 &ctm) = 0;
   virtual void apply_transformations() = 0;
   virtual void translate(const float_t &translation,
@@ -6,7 +6,20 @@
 //==============================================================================
 bool Sphere::intersect(const Ray &r, isect_info &i) const {
   float_t t;
+  if (!intersect_distance(r, t)) return false;
 
+  hit_info(r, t, i);
+  return true;
+}
+
+//==============================================================================
+bool Sphere::occluded(const Ray &r, const float_t &t_max) const {
+  float_t t;
+  return intersect_distance(r, t) && t < t_max;
+}
+
+//==============================================================================
+bool Sphere::intersect_distance(const Ray &r, float_t &t) const {
   // Compute the distance vector between the
   // sphere's center and the ray's origin.
   glm::vec4 l = c - r.orig();
@@ -38,11 +51,14 @@ bool Sphere::intersect(const Ray &r, isect_info &i) const {
   if (l2 > r2) t = s - q;
   else t = s + q;
 
+  return true;
+}
+
+//==============================================================================
+void Sphere::hit_info(const Ray &r, const float_t &t, isect_info &i) const {
   i.tn  = t;
   i.ip  = r.orig() + t * r.dir();
   i.ipn = glm::normalize(i.ip - c);
-
-  return true;
 }
 
 //==============================================================================
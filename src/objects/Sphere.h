@@ -39,6 +39,21 @@ class Sphere : public Object {
   glm::vec4 centroid(const uint32_t &ti) const;
 
   bool intersect(const Ray &r, isect_info &i) const;
+  bool occluded(const Ray &r, const float_t &t_max) const;
+
+  /**
+   * Computes only the distance from the ray's origin to the closest
+   * intersection point with the sphere.
+   * @param r:  The ray with which the sphere would be intersected.
+   * @param t:  Distance from the intersection point to the ray's origin.
+   * @return:   True in case of an intersection, false otherwise.
+   */
+  bool intersect_distance(const Ray &r, float_t &t) const;
+
+  /**
+   * Fills the intersection information for the intersection at distance t.
+   */
+  void hit_info(const Ray &r, const float_t &t, isect_info &i) const;
 
   void apply_camera_transformation(const glm::mat4 &ivm);
   void apply_transformations();
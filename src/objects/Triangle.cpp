@@ -9,16 +9,40 @@ bool Triangle::intersect(const Ray &r, isect_info &i) const {
   float_t t, u, v;
   bool fp{false};
 
-  auto intersected = triangle_intersect(r, v0, v1, v2, t, u, v, fp);
+  auto intersected = intersect_distance(r, t, u, v, fp);
   if (!intersected) return false;
 
+  hit_info(r, t, u, v, fp, i);
+  return true;
+}
+
+//==============================================================================
+bool Triangle::intersect_distance(const Ray &r,
+                                  float_t &t,
+                                  float_t &u,
+                                  float_t &v,
+                                  bool &fp) const {
+  fp = false;
+  return triangle_intersect(r, v0, v1, v2, t, u, v, fp);
+}
+
+//==============================================================================
+void Triangle::hit_info(const Ray &r,
+                        const float_t &t,
+                        const float_t &u,
+                        const float_t &v,
+                        const bool &fp,
+                        isect_info &i) const {
   i.tn  = static_cast<float_t>(t);
   i.ip  = r.orig() + t*r.dir();
   i.ipn = (fp) ? -n : n;
   i.u   = static_cast<float_t>(u);
   i.v   = static_cast<float_t>(v);
+}
 
-  return true;
+//==============================================================================
+bool Triangle::occluded(const Ray &r, const float_t &t_max) const {
+  return triangle_shadow_intersect(r, v0, v1, v2, t_max);
 }
 
 //==============================================================================
@@ -69,6 +69,28 @@ class Triangle : public Object {
    *            triangle, false is returned.
    */
   bool intersect(const Ray &r, isect_info &i) const;
+  bool occluded(const Ray &r, const float_t &t_max) const;
+
+  /**
+   * Computes only the distance to the intersection point, its barycentric
+   * coordinates and the orientation of the triangle; see triangle_intersect.
+   */
+  bool intersect_distance(const Ray &r,
+                          float_t &t,
+                          float_t &u,
+                          float_t &v,
+                          bool &fp) const;
+
+  /**
+   * Fills the intersection information for an intersection found by
+   * intersect_distance.
+   */
+  void hit_info(const Ray &r,
+                const float_t &t,
+                const float_t &u,
+                const float_t &v,
+                const bool &fp,
+                isect_info &i) const;
 
   /**
    * Calculates the normal of the triangle:
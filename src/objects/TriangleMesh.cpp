@@ -3,130 +3,265 @@
 
 #include "TriangleMesh.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "MeshAssets.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "../core/MappedFile.h"
 #include "../core/Common.h"
 
+namespace {
+// Runs f(c) for every c in [0, n); c > 0 on their own threads, c = 0 on the
+// calling thread.
+template <typename F>
+void run_chunks(const size_t &n, const F &f) {
+  std::vector<std::thread> threads;
+  for (size_t c = 1; c < n; c++) threads.emplace_back(f, c);
+  if (n > 0) f(0);
+  for (auto &t : threads) t.join();
+}
+}
+
 //==============================================================================
-mesh_loading_info TriangleMesh::load_mesh(const char *f) {
-  std::string type;               // type of the object read on the current line
-  std::string line;               // one line of the file
-  std::vector<glm::vec4> tva;     // temporary array to store vertices
-  std::vector<glm::vec4> tvna;    // temporary array to store vertex normals
-  std::vector<uint32_t> vi;       // vertex index array
-  std::vector<uint32_t> ni;       // normal index array
+mesh_loading_info TriangleMesh::load_mesh(const char *f,
+                                          const uint32_t &number_threads) {
   mesh_loading_info ret;          // holder for the loading information
+  auto start = std::chrono::steady_clock::now();
 
-  // load file in memory
-  std::ifstream fs(f);
-
-  // if we fail to load file from memory, exit the function
-  if (!fs.good()) {
+  // map the file in memory; if this fails, exit the function
+  MappedFile mf;
+  if (!mf.open(f)) {
     return ret;
   }
 
-  // read the file line by line
-  while (std::getline(fs, line)) {
-    // convert the line into tokenizable object
-    std::stringstream tokens(line);
-
-    // read what is the type of the object that had to be initialized
-    // v:   vector
-    // vn:  vector normal
-    // f:   face
-    tokens >> type;
-
-    // in case we have a vertex
-    if (type == vertex) {
-      // x, y and z components of the vertex
-      float_t vx, vy, vz;
-      tokens >> vx >> vy >> vz;
-
-      // extend bb of triangulated mesh
-      bb.extend_by(glm::vec4(vx, vy, vz, 1));
-
-      // add vertex to temporary vertex array
-      va.push_back(glm::vec4(vx, vy, vz, 1));
-
-      // in case we have a vertex normal
-    } else if (type == vertex_normal) {
-      float_t vnx, vny, vnz;
-      tokens >> vnx >> vny >> vnz;
-
-      // add vertex normal to temporary vertex normal array
-      vna.push_back(glm::vec4(vnx, vny, vnz, 0));
-
-      // in case we have a face
-    } else if (type == face) {
-      std::string fp;
-      std::string d = "/";
-      std::string vd, // vd: vertex dummy, used to store information for the extracted vertex,
-                  cv; // cv: current vertex
-      std::vector<uint32_t> vertex_index, vertexnormal_index;
-      uint32_t nv(0);                 // number of vertices in the face
-
-      // extract information
-      while (tokens >> fp) {
-        // extract vertex index information
-        cv = fp;
-        vd = cv.substr(0, cv.find(d));
-        vertex_index.push_back((unsigned int) std::stoi(vd));
-
-        // extract vertex texture information
-        // TODO: for now we just skip this information, if any
-        cv.erase(0, cv.find(d) + d.length());
-        vd = cv.substr(0, cv.find(d));
-
-        // extract vertex normal information
-        cv.erase(0, cv.find(d) + d.length());
-        vd = cv.substr(0, cv.find(d));
-        vertexnormal_index.push_back((unsigned int) std::stoi(vd));
-
-        nv++;
-      }
-
-      // generate 1 or multiple triangles for each face; depending on vertices number
-      // each face has #_of_vertices - 2 triangles
-      for (int t = 0; t < (nv - 2); t++) {
-        // vertex indices for the triangle
-        uint32_t v0, v1, v2;
-        v0 = vertex_index.at(0);
-        v1 = vertex_index.at((uint32_t) t + 1);
-        v2 = vertex_index.at((uint32_t) t + 2);
-        via.push_back(v0);
-        via.push_back(v1);
-        via.push_back(v2);
-
-        // vertex normal indices for the triangle
-        uint32_t vn0, vn1, vn2;
-        vn0 = vertexnormal_index.at(0);
-        vn1 = vertexnormal_index.at((uint32_t) t + 1);
-        vn2 = vertexnormal_index.at((uint32_t) t + 2);
-        vnia.push_back(vn0);
-        vnia.push_back(vn1);
-        vnia.push_back(vn2);
-
-        nt++;
-      }
-
-      nf++;
-    }
+  // parse newline-aligned chunks of the file concurrently
+  uint32_t nc = (number_threads == 0) ? std::thread::hardware_concurrency() : number_threads;
+  auto ranges = split_obj_chunks(mf.data(), mf.size(), std::max(nc, 1u));
+  std::vector<obj_chunk> chunks(ranges.size());
+  run_chunks(chunks.size(), [&](const size_t &c) {
+    parse_obj_chunk(mf.data() + ranges[c].first, mf.data() + ranges[c].second, chunks[c]);
+  });
+
+  // offsets of the chunks' elements in the merged arrays; relative indices
+  // get the number of elements in the file before the chunk added
+  std::vector<size_t> vo(chunks.size() + 1, 0),
+                      no(chunks.size() + 1, 0),
+                      io(chunks.size() + 1, 0);
+  for (size_t c = 0; c < chunks.size(); c++) {
+    vo[c + 1] = vo[c] + chunks[c].va.size();
+    no[c + 1] = no[c] + chunks[c].vna.size();
+    io[c + 1] = io[c] + chunks[c].via.size();
+    bb.extend_by(chunks[c].min);
+    bb.extend_by(chunks[c].max);
+    nf += chunks[c].nf;
+    nt += chunks[c].nt;
   }
 
-  // close file after the data from it is extracted
-  if (fs.is_open()) {
-    fs.close();
-  }
+  size_t bv = va.size(), bn = vna.size(), bi = via.size();
+  va.resize(bv + vo.back());
+  vna.resize(bn + no.back());
+  via.resize(bi + io.back());
+  vnia.resize(bi + io.back());
+
+  run_chunks(chunks.size(), [&](const size_t &c) {
+    obj_chunk &ch = chunks[c];
+    std::copy(ch.va.begin(), ch.va.end(), va.begin() + bv + vo[c]);
+    std::copy(ch.vna.begin(), ch.vna.end(), vna.begin() + bn + no[c]);
+    std::copy(ch.via.begin(), ch.via.end(), via.begin() + bi + io[c]);
+    std::copy(ch.vnia.begin(), ch.vnia.end(), vnia.begin() + bi + io[c]);
+    for (auto const &i : ch.rvi) via[bi + io[c] + i] += static_cast<uint32_t>(vo[c]);
+    for (auto const &i : ch.rni) vnia[bi + io[c] + i] += static_cast<uint32_t>(no[c]);
+    ch = obj_chunk();
+  });
+
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
 
   ret.l   = true;
   ret.nv  = (uint32_t) va.size();
   ret.nvn = (uint32_t) vna.size();
   ret.nf  = nf;
   ret.nt  = nt;
+  ret.nb  = mf.size();
+  ret.mbs = (d.count() > 0.) ? static_cast<float_t>(mf.size() * 1e-6 / d.count()) : 0.f;
+
+  return ret;
+}
+
+//==============================================================================
+mesh_loading_info TriangleMesh::load_mesh_cache(const char *f, const char *source) {
+  mesh_loading_info ret;
+  auto start = std::chrono::steady_clock::now();
+
+  // the mapping is writable, so that the mesh can be transformed in place
+  auto mf = std::make_shared<MappedFile>();
+  if (!mf->open(f, true, false) || mf->size() < sizeof(mesh_cache_header)) {
+    return ret;
+  }
+
+  mesh_cache_header h;
+  std::memcpy(&h, mf->data(), sizeof(h));
+  if (std::memcmp(h.magic, kMeshCacheMagic, sizeof(h.magic)) != 0 ||
+      h.version != kMeshCacheVersion ||
+      h.ov + h.nv * sizeof(glm::vec4) > mf->size() ||
+      h.on + h.nvn * sizeof(glm::vec4) > mf->size() ||
+      h.oi + h.ni * sizeof(uint32_t) > mf->size() ||
+      h.oni + h.ni * sizeof(uint32_t) > mf->size()) {
+    return ret;
+  }
+
+  // the cache is outdated, if the source changed after it was generated
+  if (source != nullptr) {
+    uint64_t ss;
+    int64_t sm;
+    if (!file_stamp(source, ss, sm) || ss != h.ss || sm != h.sm) return ret;
+  }
+
+  va.view(reinterpret_cast<glm::vec4 *>(mf->data() + h.ov), h.nv, mf);
+  vna.view(reinterpret_cast<glm::vec4 *>(mf->data() + h.on), h.nvn, mf);
+  via.view(reinterpret_cast<uint32_t *>(mf->data() + h.oi), h.ni, mf);
+  vnia.view(reinterpret_cast<uint32_t *>(mf->data() + h.oni), h.ni, mf);
+  nt = h.nt;
+  nf = h.nf;
+  bb = AABBox(glm::vec4(h.min[0], h.min[1], h.min[2], h.min[3]),
+              glm::vec4(h.max[0], h.max[1], h.max[2], h.max[3]));
+
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+  ret.l   = true;
+  ret.c   = true;
+  ret.nv  = h.nv;
+  ret.nvn = h.nvn;
+  ret.nf  = nf;
+  ret.nt  = nt;
+  ret.nb  = mf->size();
+  ret.mbs = (d.count() > 0.) ? static_cast<float_t>(mf->size() * 1e-6 / d.count()) : 0.f;
 
   return ret;
 }
 
+//==============================================================================
+bool TriangleMesh::write_mesh_cache(const char *f, const char *source) const {
+  mesh_cache_header h;
+  std::memcpy(h.magic, kMeshCacheMagic, sizeof(h.magic));
+  h.version = kMeshCacheVersion;
+  h.nv  = (uint32_t) va.size();
+  h.nvn = (uint32_t) vna.size();
+  h.ni  = (uint32_t) via.size();
+  h.nt  = nt;
+  h.nf  = nf;
+  if (source != nullptr && !file_stamp(source, h.ss, h.sm)) return false;
+  for (uint32_t a = 0; a < 4; a++) {
+    h.min[a] = bb.bounds[0][a];
+    h.max[a] = bb.bounds[1][a];
+  }
+  h.ov  = mesh_cache_align(sizeof(h));
+  h.on  = mesh_cache_align(h.ov + va.size() * sizeof(glm::vec4));
+  h.oi  = mesh_cache_align(h.on + vna.size() * sizeof(glm::vec4));
+  h.oni = mesh_cache_align(h.oi + via.size() * sizeof(uint32_t));
+
+  // write to a temporary file first, so that a cache is never read while
+  // it's incomplete
+  static std::atomic<uint32_t> counter(0);
+  std::string tf = std::string(f) + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+  {
+    std::ofstream fs(tf, std::ios::binary | std::ios::trunc);
+    if (!fs.good()) return false;
+
+    const char zeros[kMeshCacheAlignment] = {};
+    auto write_at = [&fs, &zeros](const uint64_t &o, const void *d, const size_t &s) {
+      fs.write(zeros, o - static_cast<uint64_t>(fs.tellp()));
+      fs.write(static_cast<const char *>(d), s);
+    };
+    fs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    write_at(h.ov, va.data(), va.size() * sizeof(glm::vec4));
+    write_at(h.on, vna.data(), vna.size() * sizeof(glm::vec4));
+    write_at(h.oi, via.data(), via.size() * sizeof(uint32_t));
+    write_at(h.oni, vnia.data(), vnia.size() * sizeof(uint32_t));
+    if (!fs.good()) {
+      fs.close();
+      std::remove(tf.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(tf.c_str(), f) != 0) {
+    std::remove(tf.c_str());
+    return false;
+  }
+  return true;
+}
+
+//==============================================================================
+mesh_loading_info TriangleMesh::load_cached_mesh(const char *f,
+                                                 const uint32_t &number_threads) {
+  std::string cf = mesh_cache_path(f);
+  auto ret = load_mesh_cache(cf.c_str(), f);
+  if (ret.l) return ret;
+
+  ret = load_mesh(f, number_threads);
+
+  // the cache is an optimization; failing to write it isn't an error
+  if (ret.l) write_mesh_cache(cf.c_str(), f);
+  return ret;
+}
+
+//==============================================================================
+mesh_loading_info TriangleMesh::load_shared_mesh(const char *f,
+                                                 const uint32_t &number_threads) {
+  bool loaded;
+  auto a = MeshAssets::instance().acquire(f, number_threads, loaded);
+  if (!a) return mesh_loading_info();
+
+  // the views keep the asset alive
+  std::shared_ptr<void> o = std::const_pointer_cast<mesh_asset>(a);
+  va.share(a->va, o);
+  vna.share(a->vna, o);
+  via.share(a->via, o);
+  vnia.share(a->vnia, o);
+  nt = a->nt;
+  nf = a->nf;
+  vb = a->bb;
+  ltb = std::shared_ptr<const TriangleBuffer>(a, &a->tb);
+  ins = true;
+  set_placement(gt);
+
+  auto ret = a->li;
+  if (!loaded) {
+    ret.s   = true;
+    ret.nb  = 0;
+    ret.mbs = 0.f;
+  }
+  return ret;
+}
+
 //==============================================================================
 bool TriangleMesh::intersect(const Ray &r, isect_info &i) const {
+  // The shared triangles of an instanced mesh are intersected by the ray
+  // in the space of its vertices.
+  if (ins && ltb && ltb->size() == nt) {
+    triangle_hit th;
+    if (!ltb->intersect_range(r.transformed(wto), 0, nt, i.tn, th)) return false;
+    hit_info(r, th.i, th.t, th.u, th.v, th.fp != mi, i);
+    return true;
+  }
+
+  if (tb.size() == nt) {
+    triangle_hit th;
+    if (!tb.intersect_range(r, 0, nt, i.tn, th)) return false;
+    hit_info(r, th.i, th.t, th.u, th.v, th.fp, i);
+    return true;
+  }
+
+  // The triangle buffer isn't built, if the vertices of the mesh were not
+  // transformed yet.
   bool intersected{false};
 
   for (uint32_t _ti = 0; _ti < nt; _ti++) {
@@ -145,9 +280,7 @@ bool TriangleMesh::intersect_triangle(const Ray &r,
   glm::vec4 v0, v1, v2;
   bool intersected{false};
 
-  v0 = va[via[3 * ti] - 1];
-  v1 = va[via[3 * ti + 1] - 1];
-  v2 = va[via[3 * ti + 2] - 1];
+  triangle_vertices(ti, v0, v1, v2);
 
   float_t tt{infinity}, u{0}, v{0};
   bool    flip_normal = false;
@@ -168,6 +301,57 @@ bool TriangleMesh::intersect_triangle(const Ray &r,
   return intersected;
 }
 
+//==============================================================================
+bool TriangleMesh::occluded(const Ray &r, const float_t &t_max) const {
+  if (ins && ltb && ltb->size() == nt) {
+    return ltb->occluded_range(r.transformed(wto), 0, nt, t_max);
+  }
+  if (tb.size() == nt) return tb.occluded_range(r, 0, nt, t_max);
+
+  for (uint32_t _ti = 0; _ti < nt; _ti++) {
+    if (occluded_triangle(r, _ti, t_max)) return true;
+  }
+
+  return false;
+}
+
+//==============================================================================
+bool TriangleMesh::occluded_triangle(const Ray &r,
+                                     const uint32_t &ti,
+                                     const float_t &t_max) const {
+  glm::vec4 v0, v1, v2;
+  triangle_vertices(ti, v0, v1, v2);
+  return triangle_shadow_intersect(r, v0, v1, v2, t_max);
+}
+
+//==============================================================================
+void TriangleMesh::hit_info(const Ray &r,
+                            const uint32_t &ti,
+                            const float_t &t,
+                            const float_t &u,
+                            const float_t &v,
+                            const bool &fp,
+                            isect_info &i) const {
+  i.tn = t;
+  i.u = u;
+  i.v = v;
+  i.ip = r.orig() + t * r.dir();
+  i.ti = ti;
+  i.fp = fp;
+  compute_normal(i);
+}
+
+//==============================================================================
+void TriangleMesh::build_triangle_buffer() {
+  glm::vec4 v0, v1, v2;
+
+  tb.resize(nt);
+  for (uint32_t ti = 0; ti < nt; ti++) {
+    triangle_vertices(ti, v0, v1, v2);
+    tb.set(ti, v0, v1, v2);
+  }
+}
+
 //==============================================================================
 void TriangleMesh::compute_normal(isect_info &i) const {
 
@@ -178,6 +362,11 @@ void TriangleMesh::compute_normal(isect_info &i) const {
     vn0 = vna[vnia[3 * i.ti] - 1];
     vn1 = vna[vnia[3 * i.ti + 1] - 1];
     vn2 = vna[vnia[3 * i.ti + 2] - 1];
+    if (ins) {
+      vn0 = glm::normalize(glm::vec4(glm::vec3(nm * vn0), 0.f));
+      vn1 = glm::normalize(glm::vec4(glm::vec3(nm * vn1), 0.f));
+      vn2 = glm::normalize(glm::vec4(glm::vec3(nm * vn2), 0.f));
+    }
 
     u = i.u;
     v = i.v;
@@ -186,10 +375,7 @@ void TriangleMesh::compute_normal(isect_info &i) const {
     i.ipn = w * vn0 + u * vn1 + v * vn2;
   } else {
     glm::vec4 v0, v1, v2;
-
-    v0 = va[via[3 * i.ti] - 1];
-    v1 = va[via[3 * i.ti + 1] - 1];
-    v2 = va[via[3 * i.ti + 2] - 1];
+    triangle_vertices(i.ti, v0, v1, v2);
 
     auto c = glm::cross(glm::vec3(v1 - v0),
                         glm::vec3(v2 - v0));
@@ -201,7 +387,13 @@ void TriangleMesh::compute_normal(isect_info &i) const {
 
 //==============================================================================
 void TriangleMesh::apply_camera_transformation(const glm::mat4 &ctm) {
+  if (ins) {
+    set_placement(ctm * gt);
+    return;
+  }
+
   glm::vec4 v, vn;
+  glm::mat4 nm = glm::transpose(glm::inverse(ctm));
   bb.reset();
 
   for (auto &_ti : va) {
@@ -213,18 +405,39 @@ void TriangleMesh::apply_camera_transformation(const glm::mat4 &ctm) {
 
   for (auto &_ti : vna) {
     vn = _ti;
-    vn = glm::transpose(glm::inverse(ctm)) * vn;
+    vn = nm * vn;
     // Reset normal's w component to 0.
     vn.w = 0.f;
     // Renormalize.
     vn = glm::normalize(vn);
     _ti = vn;
   }
+
+  gt = ctm * gt;
+  build_triangle_buffer();
 }
 
 //==============================================================================
 void TriangleMesh::apply_transformations() {
+  // The vertices of an instanced mesh are shared; only its placement moves.
+  if (ins) {
+    set_placement(mt * gt);
+    mt = glm::mat4(1);
+    return;
+  }
+
+  // The vertices aren't rewritten, if the mesh wasn't transformed; reading
+  // them doesn't copy shared ones.
+  if (mt == glm::mat4(1)) {
+    const Buffer<glm::vec4> &cva = va;
+    bb.reset();
+    for (auto const &_ti : cva) bb.extend_by(_ti);
+    if (tb.size() != nt) build_triangle_buffer();
+    return;
+  }
+
   glm::vec4 v, vn;
+  glm::mat4 nm = glm::transpose(glm::inverse(mt));
   bb.reset();
 
   // Transform vertices.
@@ -238,7 +451,7 @@ void TriangleMesh::apply_transformations() {
   // Transform vertex normals.
   for (auto &_ti : vna) {
     vn = _ti;
-    vn = glm::transpose(glm::inverse(mt)) * vn;
+    vn = nm * vn;
     // Reset normal's w component to 0.
     vn.w = 0.f;
     // Renormalize.
@@ -247,7 +460,10 @@ void TriangleMesh::apply_transformations() {
   }
 
   // Reset model transform matrix.
+  gt = mt * gt;
   mt = glm::mat4(1);
+
+  build_triangle_buffer();
 }
 
 //==============================================================================
@@ -260,29 +476,41 @@ TriangleMesh::TriangleMesh(const TriangleMesh &tm) : Object(tm) {
   this->nf = tm.nf;
   this->in = tm.in;
   this->ot = tm.ot;
+  this->tb = tm.tb;
+  this->gt = tm.gt;
+  this->ins = tm.ins;
+  this->nm = tm.nm;
+  this->vb = tm.vb;
+  this->wto = tm.wto;
+  this->mi = tm.mi;
+  this->ltb = tm.ltb;
 }
 
 //==============================================================================
-const AABBox & TriangleMesh::get_BB(const uint32_t &ti) const {
-  auto box = new AABBox();
+void TriangleMesh::set_placement(const glm::mat4 &t) {
+  gt  = t;
+  wto = glm::inverse(t);
+  nm  = glm::transpose(wto);
+  mi  = glm::determinant(glm::mat3(t)) < 0.f;
+  bb  = vb.transformed(t);
+}
+
+//==============================================================================
+AABBox TriangleMesh::get_BB(const uint32_t &ti) const {
+  AABBox box;
 
   glm::vec4 v0, v1, v2;
-  v0 = va[via[3 * ti] - 1];
-  v1 = va[via[3 * ti + 1] - 1];
-  v2 = va[via[3 * ti + 2] - 1];
-  box->extend_by(v0);
-  box->extend_by(v1);
-  box->extend_by(v2);
-  auto const &ret = *box;
-  return ret;
+  triangle_vertices(ti, v0, v1, v2);
+  box.extend_by(v0);
+  box.extend_by(v1);
+  box.extend_by(v2);
+  return box;
 }
 
 //==============================================================================
 glm::vec4 TriangleMesh::centroid(const uint32_t &ti) const {
   glm::vec4 v0, v1, v2, centroid;
-  v0 = va[via[3 * ti] - 1];
-  v1 = va[via[3 * ti + 1] - 1];
-  v2 = va[via[3 * ti + 2] - 1];
+  triangle_vertices(ti, v0, v1, v2);
   centroid = (v0 + v1 + v2) / 3.f;
 
   return centroid;
@@ -4,7 +4,11 @@
 #ifndef ELUCIDO_TRIANGLEMESH_H
 #define ELUCIDO_TRIANGLEMESH_H
 
+#include <memory>
+
 #include "Object.h"
+#include "../core/Buffer.h"
+#include "../core/TriangleBuffer.h"
 
 class TriangleMesh : public Object {
 //==============================================================================
@@ -35,6 +39,10 @@ class TriangleMesh : public Object {
   bool intersect_triangle(const Ray &r,
                           const uint32_t &ti,
                           isect_info &i) const;
+  bool occluded(const Ray &r, const float_t &t_max) const;
+  bool occluded_triangle(const Ray &r,
+                         const uint32_t &ti,
+                         const float_t &t_max) const;
 
   /**
    * Computes the normal for the intersection point defined in i.
@@ -42,6 +50,61 @@ class TriangleMesh : public Object {
    */
   void compute_normal(isect_info &i) const;
 
+  /**
+   * Fills the intersection information for an intersection with the
+   * triangle ti; computes the intersection point and its normal.
+   * @param r:  The intersected ray.
+   * @param ti: The index of the triangle.
+   * @param t:  Distance from the intersection point to the ray's origin.
+   * @param u:  Barycentric u-parameter.
+   * @param v:  Barycentric v-parameter.
+   * @param fp: Flip normal.
+   * @param i:  A structure containing intersection information.
+   */
+  void hit_info(const Ray &r,
+                const uint32_t &ti,
+                const float_t &t,
+                const float_t &u,
+                const float_t &v,
+                const bool &fp,
+                isect_info &i) const;
+
+  inline void triangle_vertices(const uint32_t &ti,
+                                glm::vec4 &v0,
+                                glm::vec4 &v1,
+                                glm::vec4 &v2) const {
+    v0 = va[via[3 * ti] - 1];
+    v1 = va[via[3 * ti + 1] - 1];
+    v2 = va[via[3 * ti + 2] - 1];
+    if (ins) {
+      v0 = gt * v0;
+      v1 = gt * v1;
+      v2 = gt * v2;
+    }
+  }
+
+  /**
+   * Identifies the geometry of the mesh: the shared vertex array of an
+   * instanced mesh, which is the same for all its placements, or the mesh
+   * itself.
+   */
+  inline const void * geometry_key() const {
+    return ins ? static_cast<const void *>(va.data()) : this;
+  }
+
+  /**
+   * Replaces the transformations of an instanced mesh, which place its
+   * vertices in the scene.
+   * @param t:  Transformation from the space of the vertices.
+   */
+  void set_placement(const glm::mat4 &t);
+
+  /**
+   * Fills the mesh's triangle buffer; has to be called whenever the
+   * vertices of the mesh change.
+   */
+  void build_triangle_buffer();
+
   glm::vec4 centroid(const uint32_t &ti) const;
 
   /**
@@ -50,8 +113,60 @@ class TriangleMesh : public Object {
    * @param ti: The index of the triangle.
    * @return:   The bounding box of the triangle.
    */
-  const AABBox & get_BB(const uint32_t &ti) const;
-  mesh_loading_info load_mesh(const char *f);
+  AABBox get_BB(const uint32_t &ti) const;
+
+  /**
+   * Loads the vertices, vertex normals and faces of an OBJ file. The file
+   * is mapped into memory and split into newline-aligned chunks, which are
+   * parsed concurrently and merged in file order.
+   * @param f:              Path to the OBJ file.
+   * @param number_threads: Maximal number of parsing threads; 0 for the
+   *                        number of hardware threads.
+   * @return:               Information about the loaded mesh.
+   */
+  mesh_loading_info load_mesh(const char *f, const uint32_t &number_threads = 0);
+
+  /**
+   * Replaces the geometry of the mesh with the one stored in a binary mesh
+   * cache file. The file is mapped into memory and the mesh's arrays view
+   * the mapped data; pages are only copied, when they are written.
+   * @param f:      Path to the cache file.
+   * @param source: Path to the OBJ file the cache was generated from; if
+   *                given, the cache is only loaded if it was generated
+   *                from the current version of the source.
+   * @return:       Information about the loaded mesh.
+   */
+  mesh_loading_info load_mesh_cache(const char *f, const char *source = nullptr);
+
+  /**
+   * Writes the geometry of the mesh to a binary mesh cache file.
+   * @param f:      Path to the cache file.
+   * @param source: Path to the OBJ file the mesh was loaded from; its
+   *                size and modification time are stored in the cache.
+   * @return:       False, if the file couldn't be written.
+   */
+  bool write_mesh_cache(const char *f, const char *source = nullptr) const;
+
+  /**
+   * Loads an OBJ file through its binary mesh cache. If there isn't a
+   * cache for the current version of the file, the OBJ file is parsed and
+   * the cache is (re)generated.
+   * @param f:              Path to the OBJ file.
+   * @param number_threads: Maximal number of threads parsing the OBJ file.
+   * @return:               Information about the loaded mesh.
+   */
+  mesh_loading_info load_cached_mesh(const char *f, const uint32_t &number_threads = 0);
+
+  /**
+   * Loads an OBJ file through the process-wide mesh asset registry. Meshes
+   * loading the same file share its geometry and are instanced: their
+   * transformations are kept in gt instead of being applied to the shared
+   * vertices.
+   * @param f:              Path to the OBJ file.
+   * @param number_threads: Maximal number of threads parsing the OBJ file.
+   * @return:               Information about the loaded mesh.
+   */
+  mesh_loading_info load_shared_mesh(const char *f, const uint32_t &number_threads = 0);
 
   void apply_camera_transformation(const glm::mat4 &ctm);
   void apply_transformations();
@@ -59,13 +174,27 @@ class TriangleMesh : public Object {
 //==============================================================================
 // Data members
 //==============================================================================
-  std::vector<glm::vec4>  va;         // Vertex array.
-  std::vector<glm::vec4>  vna;        // Vertex normal array.
-  std::vector<uint32_t>   via;        // Vertex index array.
-  std::vector<uint32_t>   vnia;       // Vertex normal index array.
+  Buffer<glm::vec4>       va;         // Vertex array.
+  Buffer<glm::vec4>       vna;        // Vertex normal array.
+  Buffer<uint32_t>        via;        // Vertex index array.
+  Buffer<uint32_t>        vnia;       // Vertex normal index array.
   uint32_t                nt{0};      // Number of triangles.
   uint32_t                nf{0};      // Number of faces.
   bool                    in{false};  // Interpolate normals.
+  TriangleBuffer          tb;         // Triangles used for intersecting the
+                                      // whole mesh.
+  glm::mat4               gt{1.f};    // All transformations applied to the
+                                      // mesh since it was loaded.
+  bool                    ins{false}; // Instanced: gt isn't applied to the
+                                      // vertices, but places them.
+  glm::mat4               nm{1.f};    // Normal matrix of gt; instanced only.
+  glm::mat4               wto{1.f};   // Inverse of gt; instanced only.
+  bool                    mi{false};  // gt mirrors the mesh; instanced only.
+  std::shared_ptr<const TriangleBuffer> ltb;  // Triangles of the untransformed
+                                              // vertices, shared by the
+                                              // placements; instanced only.
+  AABBox                  vb{};       // Bounding box of the untransformed
+                                      // vertices; instanced only.
 };
 
 #endif //ELUCIDO_TRIANGLEMESH_H
@@ -164,4 +164,33 @@ TEST(AABBox, longestAxisZ) {
   Axis longest = box.longestAxis();
   
   EXPECT_EQ(longest, Z);
-}
\ No newline at end of file
+}
+//==============================================================================
+TEST(AABBox, overlapsTriangle) {
+  AABBox box(glm::vec4(0.f, 0.f, 0.f, 1.f), glm::vec4(1.f, 1.f, 1.f, 1.f));
+
+  // Inside and far away.
+  EXPECT_TRUE(box.overlaps_triangle({0.2f, 0.2f, 0.5f, 1.f},
+                                    {0.8f, 0.2f, 0.5f, 1.f},
+                                    {0.5f, 0.8f, 0.5f, 1.f}));
+  EXPECT_FALSE(box.overlaps_triangle({2.f, 2.f, 2.f, 1.f},
+                                     {3.f, 2.f, 2.f, 1.f},
+                                     {2.f, 3.f, 2.f, 1.f}));
+
+  // A triangle much larger than the box cutting through it.
+  EXPECT_TRUE(box.overlaps_triangle({-10.f, -10.f, 0.5f, 1.f},
+                                    {10.f, -10.f, 0.5f, 1.f},
+                                    {0.f, 10.f, 0.5f, 1.f}));
+
+  // The bounding boxes of these triangles overlap the box, but an edge
+  // cross product or the triangle's normal separates them from it.
+  EXPECT_FALSE(box.overlaps_triangle({2.5f, 0.f, 0.5f, 1.f},
+                                     {0.f, 2.5f, 0.5f, 1.f},
+                                     {2.5f, 2.5f, 0.5f, 1.f}));
+  EXPECT_FALSE(box.overlaps_triangle({3.5f, 0.f, 0.f, 1.f},
+                                     {0.f, 3.5f, 0.f, 1.f},
+                                     {0.f, 0.f, 3.5f, 1.f}));
+  EXPECT_TRUE(box.overlaps_triangle({2.5f, 0.f, 0.f, 1.f},
+                                    {0.f, 2.5f, 0.f, 1.f},
+                                    {0.f, 0.f, 2.5f, 1.f}));
+}
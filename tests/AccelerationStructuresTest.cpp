@@ -3,15 +3,62 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <dirent.h>
 
 #include "../src/accelerators/DynamicGrid.h"
+#include "../src/accelerators/CompactGrid.h"
+#include "../src/accelerators/HierarchicalGrid.h"
+#include "../src/accelerators/KDtreeMidpoint.h"
+#include "../src/accelerators/KDtreeSAH.h"
+#include "../src/accelerators/BVH.h"
+#include "../src/accelerators/TwoLevel.h"
+#include "../src/accelerators/LBVH.h"
 #include "../src/accelerators/AABBox.h"
+#include "../src/accelerators/ASCache.h"
 #include "../src/objects/TriangleMesh.h"
 #include "../src/objects/Triangle.h"
 #include "../src/objects/Sphere.h"
+#include "../src/core/ThreadPool.h"
+
+//==============================================================================
+// Creates a mesh of the cube [-1, 1]^3 made of 12 triangles.
+std::shared_ptr<TriangleMesh> cube_mesh() {
+  auto mesh = std::make_shared<TriangleMesh>();
+  for (uint32_t v = 0; v < 8; v++) {
+    glm::vec4 p((v & 1) ? 1.f : -1.f,
+                (v & 2) ? 1.f : -1.f,
+                (v & 4) ? 1.f : -1.f,
+                1.f);
+    mesh->va.push_back(p);
+  }
+
+  // Two triangles per face; vertex indices start at 1 as in OBJ files.
+  const uint32_t triangles[12][3] = {{1, 5, 7}, {1, 7, 3},
+                                     {2, 4, 8}, {2, 8, 6},
+                                     {1, 2, 6}, {1, 6, 5},
+                                     {3, 7, 8}, {3, 8, 4},
+                                     {1, 3, 4}, {1, 4, 2},
+                                     {5, 6, 8}, {5, 8, 7}};
+  for (auto const &t : triangles) {
+    for (auto const &v : t) mesh->via.push_back(v);
+  }
+  mesh->nt = 12;
+  mesh->nf = 12;
+  mesh->apply_transformations();
+  return mesh;
+}
 
 //==============================================================================
 TEST(AccelerationStructure, convertToPrimitives) {
@@ -28,6 +75,37 @@ TEST(AccelerationStructure, convertToPrimitives) {
   delete grid_structure;
 }
 
+//==============================================================================
+TEST(AccelerationStructure, primitiveReferences) {
+  std::shared_ptr<Object> cube = cube_mesh();
+  std::shared_ptr<Object> s = std::make_shared<Sphere>(Sphere());
+
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(s);
+  objs.push_back(cube);
+
+  AABBox box;
+  box.extend_by(cube->bounding_box().bounds[0]);
+  box.extend_by(cube->bounding_box().bounds[1]);
+  box.extend_by(s->bounding_box().bounds[0]);
+  box.extend_by(s->bounding_box().bounds[1]);
+
+  CompactGrid grid;
+  auto ci = as_construct_info();
+  grid.construct(box, objs, 13, ci);
+
+  // Primitives refer to their objects by the index in the object list.
+  auto const &primitives = grid.get_primitives();
+  ASSERT_EQ(primitives.size(), 13);
+  EXPECT_EQ(primitives[0].type(), sphere);
+  EXPECT_EQ(primitives[0].oi, 0);
+  for (uint32_t i = 1; i < primitives.size(); i++) {
+    EXPECT_EQ(primitives[i].type(), triangle_mesh);
+    EXPECT_EQ(primitives[i].oi, 1);
+    EXPECT_EQ(primitives[i].ti, i - 1);
+  }
+}
+
 //==============================================================================
 TEST(Grid, intersectSingleSphere) {
   Ray ray;
@@ -303,4 +381,1171 @@ TEST(Grid, intersectSingleTriangleOutside) {
   auto intersected = g->traverse(ray, ii);
 
   EXPECT_TRUE(!intersected);
-}
\ No newline at end of file
+}
+//==============================================================================
+TEST(AccelerationStructure, occluded) {
+  // A triangle in the plane x = 3 in front of a sphere, which the ray along
+  // the x-axis intersects at x = 5.
+  std::shared_ptr<Object> t = std::make_shared<Triangle>(
+      glm::vec4(3.f, -1.f, -1.f, 1.f),
+      glm::vec4(3.f,  1.f, -1.f, 1.f),
+      glm::vec4(3.f,  0.f,  1.f, 1.f));
+
+  std::shared_ptr<Object> s = std::make_shared<Sphere>(Sphere());
+  std::static_pointer_cast<Sphere>(s)->set_radius(1.f);
+  std::static_pointer_cast<Sphere>(s)->set_center({6.f, 0.f, 0.f, 1.f});
+
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(t);
+  objs.push_back(s);
+
+  AABBox box;
+  box.extend_by(t->bounding_box().bounds[0]);
+  box.extend_by(t->bounding_box().bounds[1]);
+  box.extend_by(s->bounding_box().bounds[0]);
+  box.extend_by(s->bounding_box().bounds[1]);
+
+  std::vector<std::shared_ptr<AccelerationStructure>> structures;
+  structures.push_back(std::make_shared<DynamicGrid>());
+  structures.push_back(std::make_shared<CompactGrid>());
+  auto kd = std::make_shared<KDtreeMidpoint>();
+  kd->set_max_primitives(1);
+  structures.push_back(kd);
+  auto kd_sah = std::make_shared<KDtreeSAH>();
+  kd_sah->set_max_primitives(1);
+  structures.push_back(kd_sah);
+  structures.push_back(std::make_shared<BVH>());
+
+  Ray ray;
+  ray.set_orig({0.f, 0.f, 0.f, 1.f});
+  ray.set_dir( {1.f, 0.f, 0.f, 0.f});
+
+  Ray missing_ray;
+  missing_ray.set_orig({0.f, 0.f, 0.f, 1.f});
+  missing_ray.set_dir( {0.f, 1.f, 0.f, 0.f});
+
+  for (auto const &as : structures) {
+    auto ci = as_construct_info();
+    as->construct(box, objs, 2, ci);
+
+    traversal_info ti;
+    EXPECT_TRUE(as->occluded(ray, 10.f, ti));
+    EXPECT_TRUE(as->occluded(ray, 4.f, ti));
+    EXPECT_FALSE(as->occluded(ray, 2.5f, ti));
+    EXPECT_FALSE(as->occluded(missing_ray, 10.f, ti));
+
+    // The closest hit and the occlusion query should agree.
+    auto ii = isect_info();
+    EXPECT_TRUE(as->traverse(ray, ii));
+    EXPECT_FLOAT_EQ(ii.tn, 3.f);
+  }
+}
+
+//==============================================================================
+TEST(BVH, constructDepthFirst) {
+  std::shared_ptr<Object> cube = cube_mesh();
+
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(cube);
+
+  auto ci = as_construct_info();
+  BVH b;
+  b.set_max_primitives(1);
+  b.construct(cube->bounding_box(), objs, 12, ci);
+
+  // Every leaf holds a single triangle.
+  auto const &nodes = b.get_nodes();
+  EXPECT_EQ(nodes.size(), 2 * 12 - 1);
+  EXPECT_EQ(ci.nl, 12);
+
+  uint32_t primitives_in_leaves{0};
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].np > 0) {
+      primitives_in_leaves += nodes[i].np;
+      continue;
+    }
+    // Children are stored after their parent and their bounding boxes lie
+    // inside the parent's bounding box.
+    EXPECT_GT(nodes[i].offset, i + 1);
+    for (auto const &c : {i + 1, nodes[i].offset}) {
+      for (uint32_t a = 0; a < 3; a++) {
+        EXPECT_GE(nodes[c].bmin[a], nodes[i].bmin[a]);
+        EXPECT_LE(nodes[c].bmax[a], nodes[i].bmax[a]);
+      }
+    }
+  }
+  EXPECT_EQ(primitives_in_leaves, 12);
+}
+
+//==============================================================================
+TEST(BVH, intersectTriangleMesh) {
+  std::shared_ptr<Object> cube = cube_mesh();
+
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(cube);
+
+  auto ci = as_construct_info();
+  BVH b;
+  b.set_max_primitives(2);
+  b.construct(cube->bounding_box(), objs, 12, ci);
+
+  // Shoot rays from around the cube towards its center and compare the
+  // closest intersections with the ones of the mesh itself.
+  for (auto const &o : {glm::vec4( 5.f,  0.3f,  0.2f, 1.f),
+                        glm::vec4(-4.f,  2.f,   1.f,  1.f),
+                        glm::vec4( 0.1f, 6.f,  -3.f,  1.f),
+                        glm::vec4( 2.f, -3.f,   7.f,  1.f)}) {
+    Ray ray;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(glm::vec4(0.f, 0.f, 0.f, 1.f) - o));
+
+    auto bi = isect_info();
+    auto mi = isect_info();
+    EXPECT_TRUE(b.traverse(ray, bi));
+    EXPECT_TRUE(cube->intersect(ray, mi));
+    EXPECT_FLOAT_EQ(bi.tn, mi.tn);
+    EXPECT_EQ(bi.ti, mi.ti);
+    EXPECT_EQ(bi.ho, cube);
+  }
+}
+
+//==============================================================================
+TEST(BVH, constructEmpty) {
+  BVH b;
+  b.set_thread_pool(std::make_shared<ThreadPool>(2));
+  auto ci = as_construct_info();
+  ci.nn = 7;
+  b.construct(AABBox(), {}, 0, ci);
+
+  // The construction information is set for an empty scene as well.
+  EXPECT_EQ(ci.nn, 0);
+  EXPECT_EQ(ci.nl, 0);
+  EXPECT_FLOAT_EQ(ci.npl, 0.f);
+  EXPECT_EQ(ci.nt, 2);
+
+  Ray ray;
+  ray.set_orig({0.f, 0.f, 0.f, 1.f});
+  ray.set_dir( {1.f, 0.f, 0.f, 0.f});
+  auto ii = isect_info();
+  EXPECT_FALSE(b.traverse(ray, ii));
+}
+
+//==============================================================================
+// Creates a mesh of randomly placed small triangles inside [-10, 10]^3.
+std::shared_ptr<Object> random_triangle_mesh(const uint32_t &number_triangles) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<float_t> position(-10.f, 10.f);
+  std::uniform_real_distribution<float_t> edge(-0.5f, 0.5f);
+
+  auto mesh = std::make_shared<TriangleMesh>();
+  for (uint32_t t = 0; t < number_triangles; t++) {
+    glm::vec4 v0(position(generator), position(generator), position(generator), 1.f);
+    mesh->va.push_back(v0);
+    for (uint32_t v = 0; v < 2; v++) {
+      mesh->va.push_back(v0 + glm::vec4(edge(generator), edge(generator), edge(generator), 0.f));
+    }
+    for (uint32_t v = 0; v < 3; v++) {
+      mesh->via.push_back(3 * t + v + 1);
+    }
+  }
+  mesh->nt = number_triangles;
+  mesh->apply_transformations();
+  return mesh;
+}
+
+//==============================================================================
+TEST(AccelerationStructure, parallelConstruction) {
+  const uint32_t number_triangles = 50000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  auto pool = std::make_shared<ThreadPool>(4);
+
+  std::vector<std::pair<std::shared_ptr<AccelerationStructure>,
+                        std::shared_ptr<AccelerationStructure>>> structures;
+  structures.emplace_back(std::make_shared<CompactGrid>(),
+                          std::make_shared<CompactGrid>());
+  structures.emplace_back(std::make_shared<KDtreeMidpoint>(),
+                          std::make_shared<KDtreeMidpoint>());
+  structures.emplace_back(std::make_shared<KDtreeSAH>(),
+                          std::make_shared<KDtreeSAH>());
+  structures.emplace_back(std::make_shared<BVH>(),
+                          std::make_shared<BVH>());
+  structures.emplace_back(std::make_shared<LBVH>(),
+                          std::make_shared<LBVH>());
+  structures.emplace_back(std::make_shared<HierarchicalGrid>(),
+                          std::make_shared<HierarchicalGrid>());
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+
+  for (auto const &s : structures) {
+    auto serial_info   = as_construct_info();
+    auto parallel_info = as_construct_info();
+    s.first->construct(mesh->bounding_box(), objs, number_triangles, serial_info);
+    s.second->set_thread_pool(pool);
+    s.second->construct(mesh->bounding_box(), objs, number_triangles, parallel_info);
+
+    EXPECT_EQ(serial_info.nt, 1);
+    EXPECT_EQ(parallel_info.nt, 4);
+
+    // Both structures should find the same closest intersections.
+    for (uint32_t i = 0; i < 200; i++) {
+      Ray ray;
+      ray.set_orig({0.f, 0.f, 0.f, 1.f});
+      ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                           direction(generator),
+                                           direction(generator), 0.f)));
+
+      auto si = isect_info();
+      auto pi = isect_info();
+      EXPECT_EQ(s.first->traverse(ray, si), s.second->traverse(ray, pi));
+      EXPECT_EQ(si.tn, pi.tn);
+      EXPECT_EQ(si.ti, pi.ti);
+    }
+  }
+
+  // The parallel construction of the hierarchy should yield exactly the same
+  // depth-first node array.
+  auto const &serial_nodes =
+      std::static_pointer_cast<BVH>(structures[3].first)->get_nodes();
+  auto const &parallel_nodes =
+      std::static_pointer_cast<BVH>(structures[3].second)->get_nodes();
+  ASSERT_EQ(serial_nodes.size(), parallel_nodes.size());
+  EXPECT_EQ(std::memcmp(serial_nodes.data(),
+                        parallel_nodes.data(),
+                        serial_nodes.size() * sizeof(BVHNode)), 0);
+}
+
+//==============================================================================
+TEST(Grid, mailboxing) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  auto bvh = std::make_shared<BVH>();
+  auto bvh_info = as_construct_info();
+  bvh->construct(mesh->bounding_box(), objs, number_triangles, bvh_info);
+
+  std::vector<std::shared_ptr<AccelerationStructure>> grids;
+  grids.push_back(std::make_shared<DynamicGrid>());
+  grids.push_back(std::make_shared<CompactGrid>());
+
+  for (auto const &grid : grids) {
+    auto ci = as_construct_info();
+    grid->construct(mesh->bounding_box(), objs, number_triangles, ci);
+
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+    uint64_t avoided_tests{0};
+
+    for (uint32_t i = 0; i < 200; i++) {
+      Ray ray;
+      ray.set_orig({0.f, 0.f, 0.f, 1.f});
+      ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                           direction(generator),
+                                           direction(generator), 0.f)));
+
+      // Skipping already tested primitives must not change the closest hit.
+      auto gi = isect_info();
+      auto bi = isect_info();
+      EXPECT_EQ(grid->traverse(ray, gi), bvh->traverse(ray, bi));
+      EXPECT_EQ(gi.tn, bi.tn);
+      EXPECT_EQ(gi.ti, bi.ti);
+      avoided_tests += gi.nmt;
+
+      traversal_info ti;
+      EXPECT_EQ(grid->occluded(ray, 30.f, ti), bi.ho != nullptr);
+    }
+
+#ifdef ELUCIDO_RENDER_STATISTICS
+    // Triangles overlapping several cells are tested only once per ray.
+    EXPECT_GT(avoided_tests, 0);
+#endif
+  }
+}
+
+//==============================================================================
+TEST(Grid, mailboxPerWorker) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  auto bvh = std::make_shared<BVH>();
+  auto bvh_info = as_construct_info();
+  bvh->construct(mesh->bounding_box(), objs, number_triangles, bvh_info);
+
+  // Every worker traverses both grids alternately with its own mailboxes.
+  auto pool = std::make_shared<ThreadPool>(4);
+  std::vector<std::shared_ptr<AccelerationStructure>> grids;
+  grids.push_back(std::make_shared<DynamicGrid>());
+  grids.push_back(std::make_shared<CompactGrid>());
+  for (auto const &grid : grids) {
+    grid->set_thread_pool(pool);
+    auto ci = as_construct_info();
+    grid->construct(mesh->bounding_box(), objs, number_triangles, ci);
+  }
+
+  const uint32_t number_rays = 400;
+  std::vector<Ray> rays(number_rays);
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+  for (auto &ray : rays) {
+    ray.set_orig({0.f, 0.f, 0.f, 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                         direction(generator),
+                                         direction(generator), 0.f)));
+  }
+
+  std::vector<float_t> expected(number_rays);
+  for (uint32_t i = 0; i < number_rays; i++) {
+    auto bi = isect_info();
+    bvh->traverse(rays[i], bi);
+    expected[i] = bi.tn;
+  }
+
+  std::vector<float_t> found(2 * number_rays);
+  std::atomic<uint64_t> avoided_tests(0);
+  for (uint32_t i = 0; i < number_rays; i++) {
+    pool->submit([&, i](const uint32_t &worker) {
+      for (size_t g = 0; g < grids.size(); g++) {
+        auto gi = isect_info();
+        grids[g]->traverse(rays[i], gi, worker);
+        found[2 * i + g] = gi.tn;
+        avoided_tests += gi.nmt;
+      }
+    });
+  }
+  pool->wait();
+
+  for (uint32_t i = 0; i < number_rays; i++) {
+    EXPECT_EQ(found[2 * i], expected[i]);
+    EXPECT_EQ(found[2 * i + 1], expected[i]);
+  }
+#ifdef ELUCIDO_RENDER_STATISTICS
+  EXPECT_GT(avoided_tests, 0);
+#endif
+}
+
+//==============================================================================
+TEST(AccelerationStructure, finalizeClosestHit) {
+  std::shared_ptr<Object> cube = cube_mesh();
+
+  std::shared_ptr<Object> s = std::make_shared<Sphere>(Sphere());
+  std::static_pointer_cast<Sphere>(s)->set_radius(1.f);
+  std::static_pointer_cast<Sphere>(s)->set_center({0.f, 4.f, 0.f, 1.f});
+
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(cube);
+  objs.push_back(s);
+
+  AABBox box;
+  box.extend_by(cube->bounding_box().bounds[0]);
+  box.extend_by(cube->bounding_box().bounds[1]);
+  box.extend_by(s->bounding_box().bounds[0]);
+  box.extend_by(s->bounding_box().bounds[1]);
+
+  BVH b;
+  auto ci = as_construct_info();
+  b.construct(box, objs, 13, ci);
+
+  for (auto const &o : {glm::vec4( 5.f, 0.3f,  0.2f, 1.f),
+                        glm::vec4( 0.2f, 9.f, -0.1f, 1.f)}) {
+    Ray ray;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(glm::vec4(0.f, 0.f, 0.f, 1.f) - o));
+
+    // The hit record holds only the distance and the primitive; the complete
+    // intersection information is computed by finalize.
+    hit_record hr;
+    traversal_info ti;
+    ASSERT_TRUE(b.closest_hit(ray, hr, ti));
+
+    auto ii = isect_info();
+    b.finalize(ray, hr, ii);
+
+    auto oi = isect_info();
+    auto const &ho = objs[hr.p.oi];
+    EXPECT_TRUE(ho->intersect(ray, oi));
+    EXPECT_EQ(ii.ho, ho);
+    EXPECT_FLOAT_EQ(ii.tn, oi.tn);
+    EXPECT_FLOAT_EQ(ii.ip.x, oi.ip.x);
+    EXPECT_FLOAT_EQ(ii.ip.y, oi.ip.y);
+    EXPECT_FLOAT_EQ(ii.ip.z, oi.ip.z);
+    EXPECT_FLOAT_EQ(ii.ipn.x, oi.ipn.x);
+    EXPECT_FLOAT_EQ(ii.ipn.y, oi.ipn.y);
+    EXPECT_FLOAT_EQ(ii.ipn.z, oi.ipn.z);
+  }
+}
+
+//==============================================================================
+TEST(KDtreeMidpoint, frontToBackTraversal) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  auto bvh = std::make_shared<BVH>();
+  auto bvh_info = as_construct_info();
+  bvh->construct(mesh->bounding_box(), objs, number_triangles, bvh_info);
+
+  KDtreeMidpoint kd;
+  auto ci = as_construct_info();
+  kd.construct(mesh->bounding_box(), objs, number_triangles, ci);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+  uint64_t intersection_tests{0};
+  uint32_t hits{0};
+
+  for (uint32_t i = 0; i < 200; i++) {
+    Ray ray;
+    ray.set_orig({0.f, 0.f, 0.f, 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                         direction(generator),
+                                         direction(generator), 0.f)));
+
+    auto ki = isect_info();
+    auto bi = isect_info();
+    EXPECT_EQ(kd.traverse(ray, ki), bvh->traverse(ray, bi));
+    EXPECT_EQ(ki.tn, bi.tn);
+    EXPECT_EQ(ki.ti, bi.ti);
+    if (ki.ho != nullptr) {
+      intersection_tests += ki.nrpt;
+      hits++;
+    }
+
+    traversal_info ti;
+    EXPECT_EQ(kd.occluded(ray, 30.f, ti), bi.ho != nullptr);
+  }
+
+  // Rays, which hit a triangle, stop before visiting most of the leaves.
+  ASSERT_GT(hits, 0);
+  EXPECT_LT(intersection_tests / hits, number_triangles / 10);
+}
+
+//==============================================================================
+TEST(KDtreeSAH, matchesBVH) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  auto bvh = std::make_shared<BVH>();
+  auto bvh_info = as_construct_info();
+  bvh->construct(mesh->bounding_box(), objs, number_triangles, bvh_info);
+
+  KDtreeSAH kd;
+  kd.set_max_depth(20);
+  kd.set_max_primitives(2);
+  auto ci = as_construct_info();
+  kd.construct(mesh->bounding_box(), objs, number_triangles, ci);
+
+  // Every node is either a leaf or has two children; primitives overlapping
+  // a splitting plane are referenced by both children.
+  EXPECT_GT(ci.nl, 1);
+  EXPECT_EQ(ci.nn, 2 * ci.nl - 1);
+  EXPECT_GE(ci.npl * ci.nl, number_triangles);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(-12.f, 12.f);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+
+  for (uint32_t i = 0; i < 500; i++) {
+    Ray ray;
+    ray.set_orig({position(generator), position(generator), position(generator), 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                         direction(generator),
+                                         direction(generator), 0.f)));
+
+    auto ki = isect_info();
+    auto bi = isect_info();
+    EXPECT_EQ(kd.traverse(ray, ki), bvh->traverse(ray, bi));
+    EXPECT_EQ(ki.tn, bi.tn);
+    EXPECT_EQ(ki.ti, bi.ti);
+
+    traversal_info ti;
+    EXPECT_EQ(kd.occluded(ray, 30.f, ti), bi.ho != nullptr && bi.tn < 30.f);
+  }
+}
+
+//==============================================================================
+TEST(KDtree, packedNodes) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  KDtreeSAH kd;
+  auto ci = as_construct_info();
+  kd.construct(mesh->bounding_box(), objs, number_triangles, ci);
+
+  auto const &nodes = kd.get_nodes();
+  auto const &lp = kd.get_leaf_primitives();
+  ASSERT_EQ(nodes.size(), ci.nn);
+  EXPECT_EQ(sizeof(KDNode), 8);
+
+  // Every node except the root is the child of exactly one node, and the
+  // children of a node are stored next to each other behind it. The leaves
+  // cover the shared primitive index array without overlapping.
+  std::vector<uint32_t> parents(nodes.size(), 0);
+  std::vector<uint32_t> covered(lp.size(), 0);
+  std::vector<bool> referenced(number_triangles, false);
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].leaf()) {
+      uint32_t first = nodes[i].first_primitive();
+      ASSERT_LE(first + nodes[i].primitives_size(), lp.size());
+      for (uint32_t j = 0; j < nodes[i].primitives_size(); j++) covered[first + j]++;
+      continue;
+    }
+    EXPECT_LT(nodes[i].axis(), 3);
+    EXPECT_GT(nodes[i].left_child(), i);
+    EXPECT_EQ(nodes[i].right_child(), nodes[i].left_child() + 1);
+    ASSERT_LT(nodes[i].right_child(), nodes.size());
+    parents[nodes[i].left_child()]++;
+    parents[nodes[i].right_child()]++;
+  }
+  EXPECT_EQ(parents[0], 0);
+  for (uint32_t i = 1; i < nodes.size(); i++) EXPECT_EQ(parents[i], 1);
+
+  for (auto const &c : covered) EXPECT_EQ(c, 1);
+  for (auto const &p : lp) {
+    ASSERT_LT(p, number_triangles);
+    referenced[p] = true;
+  }
+  for (uint32_t i = 0; i < number_triangles; i++) EXPECT_TRUE(referenced[i]);
+}
+
+//==============================================================================
+TEST(BVH, refitMovedObjects) {
+  const uint32_t number_triangles = 5000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  BVH bvh;
+  auto ci = as_construct_info();
+  bvh.update(mesh->bounding_box(), objs, number_triangles, ci);
+  EXPECT_FALSE(ci.rf);
+
+  // A translated object keeps the topology of the hierarchy.
+  mesh->translate(3.f, X);
+  mesh->apply_transformations();
+  auto ri = as_construct_info();
+  bvh.update(mesh->bounding_box(), objs, number_triangles, ri);
+  EXPECT_TRUE(ri.rf);
+  EXPECT_EQ(ri.nn, ci.nn);
+  EXPECT_EQ(ri.nl, ci.nl);
+
+  BVH rebuilt;
+  auto bi = as_construct_info();
+  rebuilt.construct(mesh->bounding_box(), objs, number_triangles, bi);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(-12.f, 12.f);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+
+  for (uint32_t i = 0; i < 500; i++) {
+    Ray ray;
+    ray.set_orig({position(generator), position(generator), position(generator), 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                         direction(generator),
+                                         direction(generator), 0.f)));
+
+    auto fi = isect_info();
+    auto oi = isect_info();
+    EXPECT_EQ(bvh.traverse(ray, fi), rebuilt.traverse(ray, oi));
+    EXPECT_EQ(fi.tn, oi.tn);
+    EXPECT_EQ(fi.ti, oi.ti);
+
+    traversal_info ti;
+    EXPECT_EQ(bvh.occluded(ray, 30.f, ti), oi.ho != nullptr && oi.tn < 30.f);
+  }
+
+  // The hierarchy is rebuilt, if its quality degrades too much or objects
+  // are added.
+  bvh.set_refit_threshold(0.5f);
+  auto ti = as_construct_info();
+  bvh.update(mesh->bounding_box(), objs, number_triangles, ti);
+  EXPECT_FALSE(ti.rf);
+
+  bvh.set_refit_threshold(1.5f);
+  objs.push_back(random_triangle_mesh(10));
+  auto ai = as_construct_info();
+  bvh.update(mesh->bounding_box(), objs, number_triangles + 10, ai);
+  EXPECT_FALSE(ai.rf);
+}
+
+//==============================================================================
+TEST(TwoLevel, transformedInstances) {
+  auto mesh = random_triangle_mesh(5000);
+  auto mirrored = random_triangle_mesh(2000);
+  mirrored->translate(25.f, X);
+  mirrored->apply_transformations();
+  auto sphere = std::make_shared<Sphere>(Sphere());
+  sphere->set_radius(2.f);
+  sphere->set_center({0.f, 15.f, 0.f, 1.f});
+
+  std::vector<std::shared_ptr<Object>> objs = {mesh, mirrored, sphere};
+
+  TwoLevel tl;
+  auto ci = as_construct_info();
+  tl.construct(AABBox(), objs, 7001, ci);
+  EXPECT_EQ(ci.ni, 3);
+  EXPECT_EQ(ci.nb, 2);
+
+  // Transforming the meshes only moves their instances.
+  mesh->rotate(30.f, Y);
+  mesh->translate(-4.f, Z);
+  mesh->apply_transformations();
+  mirrored->scale(-1.f, X);
+  mirrored->apply_transformations();
+
+  auto ri = as_construct_info();
+  tl.construct(AABBox(), objs, 7001, ri);
+  EXPECT_EQ(ri.ni, 3);
+  EXPECT_EQ(ri.nb, 0);
+
+  BVH bvh;
+  auto bi = as_construct_info();
+  bvh.construct(AABBox(), objs, 7001, bi);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(-30.f, 30.f);
+  std::uniform_real_distribution<float_t> target(-10.f, 10.f);
+  uint32_t hits{0};
+
+  // Every other ray is aimed at the mirrored mesh.
+  for (uint32_t i = 0; i < 1000; i++) {
+    glm::vec4 o(position(generator), position(generator), position(generator), 1.f);
+    glm::vec4 p(target(generator), target(generator), target(generator), 1.f);
+    if (i % 2 == 1) p.x -= 25.f;
+
+    Ray ray;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(p - o));
+
+    auto ti = isect_info();
+    auto oi = isect_info();
+    ASSERT_EQ(tl.traverse(ray, ti), bvh.traverse(ray, oi));
+    if (oi.ho == nullptr) continue;
+
+    hits++;
+    EXPECT_EQ(ti.ho, oi.ho);
+    EXPECT_EQ(ti.ti, oi.ti);
+    EXPECT_NEAR(ti.tn, oi.tn, 1e-3f * oi.tn);
+    EXPECT_NEAR(glm::dot(ti.ipn, oi.ipn), 1.f, 1e-3f);
+
+    traversal_info tr;
+    EXPECT_TRUE(tl.occluded(ray, oi.tn + 1e-2f, tr));
+    EXPECT_FALSE(tl.occluded(ray, oi.tn * 0.99f, tr));
+  }
+  EXPECT_GT(hits, 200);
+}
+
+//==============================================================================
+TEST(LBVH, constructEmpty) {
+  LBVH lbvh;
+  lbvh.set_thread_pool(std::make_shared<ThreadPool>(2));
+  auto li = as_construct_info();
+  li.nn = 7;
+  lbvh.construct(AABBox(), {}, 0, li);
+
+  // The construction information is set for an empty scene as well.
+  EXPECT_EQ(li.nn, 0);
+  EXPECT_EQ(li.nl, 0);
+  EXPECT_FLOAT_EQ(li.npl, 0.f);
+  EXPECT_EQ(li.nt, 2);
+  EXPECT_TRUE(lbvh.get_nodes().empty());
+}
+
+//==============================================================================
+TEST(LBVH, matchesBVH) {
+  const uint32_t number_triangles = 20000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  auto sphere = std::make_shared<Sphere>(Sphere());
+  sphere->set_radius(2.f);
+  sphere->set_center({0.f, 15.f, 0.f, 1.f});
+
+  std::vector<std::shared_ptr<Object>> objs = {mesh, sphere};
+
+  LBVH lbvh;
+  auto li = as_construct_info();
+  lbvh.construct(AABBox(), objs, number_triangles + 1, li);
+
+  // The hierarchy is a binary tree stored depth-first, whose leaves cover
+  // every primitive exactly once.
+  auto const &nodes = lbvh.get_nodes();
+  EXPECT_EQ(nodes.size(), 2 * li.nl - 1);
+  std::vector<uint32_t> covered(number_triangles + 1, 0);
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].np > 0) {
+      EXPECT_LE(nodes[i].np, 4);
+      for (uint32_t p = nodes[i].offset; p < nodes[i].offset + nodes[i].np; p++) {
+        covered[p]++;
+      }
+      continue;
+    }
+    EXPECT_GT(nodes[i].offset, i + 1);
+    for (auto const &c : {i + 1, nodes[i].offset}) {
+      for (uint32_t a = 0; a < 3; a++) {
+        EXPECT_GE(nodes[c].bmin[a], nodes[i].bmin[a]);
+        EXPECT_LE(nodes[c].bmax[a], nodes[i].bmax[a]);
+      }
+    }
+  }
+  for (auto const &c : covered) EXPECT_EQ(c, 1);
+
+  BVH bvh;
+  auto bi = as_construct_info();
+  bvh.construct(AABBox(), objs, number_triangles + 1, bi);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(-20.f, 20.f);
+  std::uniform_real_distribution<float_t> target(-10.f, 10.f);
+  uint32_t hits{0};
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    glm::vec4 o(position(generator), position(generator), position(generator), 1.f);
+    glm::vec4 p(target(generator), target(generator), target(generator), 1.f);
+
+    Ray ray;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(p - o));
+
+    auto l = isect_info();
+    auto b = isect_info();
+    ASSERT_EQ(lbvh.traverse(ray, l), bvh.traverse(ray, b));
+    if (b.ho == nullptr) continue;
+
+    hits++;
+    EXPECT_EQ(l.ho, b.ho);
+    EXPECT_EQ(l.ti, b.ti);
+    EXPECT_FLOAT_EQ(l.tn, b.tn);
+
+    traversal_info tr;
+    EXPECT_TRUE(lbvh.occluded(ray, b.tn + 1e-2f, tr));
+    EXPECT_FALSE(lbvh.occluded(ray, b.tn * 0.99f, tr));
+  }
+  EXPECT_GT(hits, 500);
+}
+
+//==============================================================================
+TEST(HierarchicalGrid, refineDenseCells) {
+  // A dense mesh next to a far away sphere ends up in a few overloaded cells
+  // of the top level.
+  const uint32_t number_triangles = 20000;
+  auto mesh = random_triangle_mesh(number_triangles);
+  auto sphere = std::make_shared<Sphere>(Sphere());
+  sphere->set_radius(1.f);
+  sphere->set_center({200.f, 0.f, 0.f, 1.f});
+
+  std::vector<std::shared_ptr<Object>> objs = {mesh, sphere};
+  AABBox box;
+  for (auto const &o : objs) {
+    box.extend_by(o->bounding_box().bounds[0]);
+    box.extend_by(o->bounding_box().bounds[1]);
+  }
+
+  HierarchicalGrid hg;
+  auto hi = as_construct_info();
+  hg.construct(box, objs, number_triangles + 1, hi);
+  EXPECT_GT(hi.nsg, 0);
+  EXPECT_EQ(hi.nsg, hg.get_sub_grids().size());
+
+  CompactGrid cg;
+  auto ci = as_construct_info();
+  cg.construct(box, objs, number_triangles + 1, ci);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(-20.f, 20.f);
+  std::uniform_real_distribution<float_t> target(-10.f, 10.f);
+  uint32_t hits{0};
+  traversal_info hr, cr;
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    glm::vec4 o(position(generator), position(generator), position(generator), 1.f);
+    glm::vec4 p(target(generator), target(generator), target(generator), 1.f);
+    if (i % 10 == 0) p = glm::vec4(200.f, 0.f, 0.f, 1.f);
+
+    Ray ray;
+    ray.set_orig(o);
+    ray.set_dir(glm::normalize(p - o));
+
+    auto h = isect_info();
+    auto c = isect_info();
+    ASSERT_EQ(hg.traverse(ray, h), cg.traverse(ray, c));
+    if (c.ho == nullptr) continue;
+
+    hits++;
+    EXPECT_EQ(h.ho, c.ho);
+    EXPECT_EQ(h.ti, c.ti);
+    EXPECT_FLOAT_EQ(h.tn, c.tn);
+
+    hit_record hh, ch;
+    hg.closest_hit(ray, hh, hr);
+    cg.closest_hit(ray, ch, cr);
+
+    traversal_info tr;
+    EXPECT_TRUE(hg.occluded(ray, c.tn + 1e-2f, tr));
+    EXPECT_FALSE(hg.occluded(ray, c.tn * 0.99f, tr));
+  }
+  EXPECT_GT(hits, 500);
+
+#ifdef ELUCIDO_RENDER_STATISTICS
+  // The sub-grids save intersection tests.
+  EXPECT_LT(hr.nrpt, cr.nrpt);
+#endif
+}
+
+//==============================================================================
+TEST(CompactGrid, distanceFieldSkipsEmptyCells) {
+  // Two small clusters of triangles far apart leave most cells empty.
+  auto near_mesh = random_triangle_mesh(2000);
+  auto far_mesh = random_triangle_mesh(2000);
+  far_mesh->scale(0.2f, X);
+  far_mesh->scale(0.2f, Y);
+  far_mesh->scale(0.2f, Z);
+  far_mesh->translate(150.f, X);
+  far_mesh->translate(60.f, Y);
+  far_mesh->apply_transformations();
+  near_mesh->scale(0.2f, X);
+  near_mesh->scale(0.2f, Y);
+  near_mesh->scale(0.2f, Z);
+  near_mesh->apply_transformations();
+
+  std::vector<std::shared_ptr<Object>> objs = {near_mesh, far_mesh};
+  AABBox box;
+  for (auto const &o : objs) {
+    box.extend_by(o->bounding_box().bounds[0]);
+    box.extend_by(o->bounding_box().bounds[1]);
+  }
+
+  CompactGrid plain, skipping;
+  plain.set_max_res(16);
+  skipping.set_max_res(16);
+  skipping.set_distance_field(true);
+  auto pi = as_construct_info();
+  auto si = as_construct_info();
+  plain.construct(box, objs, 4000, pi);
+  skipping.construct(box, objs, 4000, si);
+  EXPECT_TRUE(plain.get_distances().empty());
+
+  // The distances are the Chebyshev distances to the nearest non-empty cell.
+  auto const &distances = skipping.get_distances();
+  ASSERT_EQ(distances.size(), si.r[0] * si.r[1] * si.r[2]);
+  // Signed cell indices, so that their differences can be negative.
+  const int32_t r[3] = {static_cast<int32_t>(si.r[0]),
+                        static_cast<int32_t>(si.r[1]),
+                        static_cast<int32_t>(si.r[2])};
+  std::vector<std::array<int32_t, 3>> non_empty;
+  for (int32_t z = 0; z < r[2]; z++) {
+    for (int32_t y = 0; y < r[1]; y++) {
+      for (int32_t x = 0; x < r[0]; x++) {
+        if (distances[skipping.offset(x, y, z)] == 0) non_empty.push_back({x, y, z});
+      }
+    }
+  }
+  EXPECT_EQ(non_empty.size(), si.nfc);
+  for (int32_t z = 0; z < r[2]; z++) {
+    for (int32_t y = 0; y < r[1]; y++) {
+      for (int32_t x = 0; x < r[0]; x++) {
+        int32_t d = 255;
+        for (auto const &c : non_empty) {
+          d = std::min(d, std::max({std::abs(c[0] - x), std::abs(c[1] - y), std::abs(c[2] - z)}));
+        }
+        EXPECT_EQ(distances[skipping.offset(x, y, z)], d);
+      }
+    }
+  }
+
+  // Rays between the clusters find the same intersections in fewer steps.
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> offset(-2.f, 2.f);
+  uint64_t plain_steps{0}, skipping_steps{0};
+  uint32_t hits{0};
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    glm::vec4 o(offset(generator), offset(generator), offset(generator), 1.f);
+    glm::vec4 p(150.f + offset(generator), 60.f + offset(generator), offset(generator), 1.f);
+    if (i % 2 == 1) std::swap(o, p);
+
+    // The rays start next to one cluster and are aimed at the other one.
+    Ray ray;
+    ray.set_orig(o + 4.f * glm::normalize(p - o));
+    ray.set_dir(glm::normalize(p - o));
+
+    auto a = isect_info();
+    auto b = isect_info();
+    ASSERT_EQ(plain.traverse(ray, a), skipping.traverse(ray, b));
+    plain_steps += a.nds;
+    skipping_steps += b.nds;
+    if (a.ho == nullptr) continue;
+
+    hits++;
+    EXPECT_EQ(a.ho, b.ho);
+    EXPECT_EQ(a.ti, b.ti);
+    EXPECT_FLOAT_EQ(a.tn, b.tn);
+
+    traversal_info tr;
+    EXPECT_TRUE(skipping.occluded(ray, a.tn + 1e-2f, tr));
+    EXPECT_FALSE(skipping.occluded(ray, a.tn * 0.99f, tr));
+  }
+  EXPECT_GT(hits, 100);
+
+#ifdef ELUCIDO_RENDER_STATISTICS
+  EXPECT_LT(2 * skipping_steps, plain_steps);
+#endif
+}
+
+//==============================================================================
+TEST(CompactGrid, exactInsertion) {
+  // A sloped plane of large triangles, whose bounding boxes overlap many
+  // cells they don't touch.
+  const uint32_t n = 40;
+  auto mesh = std::make_shared<TriangleMesh>();
+  for (uint32_t y = 0; y <= n; y++) {
+    for (uint32_t x = 0; x <= n; x++) {
+      mesh->va.emplace_back(x, y, 0.7f * x + 0.4f * y, 1.f);
+    }
+  }
+  for (uint32_t y = 0; y < n; y++) {
+    for (uint32_t x = 0; x < n; x++) {
+      uint32_t i = y * (n + 1) + x + 1;
+      for (auto const &v : {i, i + 1, i + n + 2, i, i + n + 2, i + n + 1}) {
+        mesh->via.push_back(v);
+      }
+    }
+  }
+  mesh->nt = 2 * n * n;
+  mesh->apply_transformations();
+  std::vector<std::shared_ptr<Object>> objs = {mesh};
+
+  CompactGrid bounds, exact;
+  DynamicGrid dynamic;
+  bounds.set_alpha(20.f);
+  exact.set_alpha(20.f);
+  dynamic.set_alpha(20.f);
+  exact.set_exact_insertion(true);
+  dynamic.set_exact_insertion(true);
+  auto bi = as_construct_info();
+  auto ei = as_construct_info();
+  auto di = as_construct_info();
+  bounds.construct(mesh->bounding_box(), objs, mesh->nt, bi);
+  exact.construct(mesh->bounding_box(), objs, mesh->nt, ei);
+  dynamic.construct(mesh->bounding_box(), objs, mesh->nt, di);
+
+  EXPECT_LT(ei.npnc, bi.npnc);
+  EXPECT_LT(ei.nfc, bi.nfc);
+  EXPECT_EQ(di.nfc, ei.nfc);
+  EXPECT_FLOAT_EQ(di.npnc, ei.npnc);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<float_t> position(0.f, 1.f * n);
+  std::uniform_real_distribution<float_t> direction(-0.3f, 0.3f);
+  traversal_info bt, et;
+  uint32_t hits{0};
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    Ray ray;
+    ray.set_orig({position(generator), position(generator), 60.f, 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                         direction(generator),
+                                         -1.f, 0.f)));
+
+    auto b = isect_info();
+    auto e = isect_info();
+    auto d = isect_info();
+    ASSERT_EQ(bounds.traverse(ray, b), exact.traverse(ray, e));
+    ASSERT_EQ(b.ho != nullptr, dynamic.traverse(ray, d));
+    if (b.ho == nullptr) continue;
+
+    hits++;
+    EXPECT_EQ(b.ti, e.ti);
+    EXPECT_EQ(b.ti, d.ti);
+    EXPECT_FLOAT_EQ(b.tn, e.tn);
+    bt.nrpt += b.nrpt;
+    et.nrpt += e.nrpt;
+
+    traversal_info tr;
+    EXPECT_TRUE(exact.occluded(ray, b.tn + 1e-2f, tr));
+    EXPECT_FALSE(exact.occluded(ray, b.tn * 0.99f, tr));
+  }
+  EXPECT_GT(hits, 500);
+
+#ifdef ELUCIDO_RENDER_STATISTICS
+  EXPECT_LT(et.nrpt, bt.nrpt);
+#endif
+}
+
+//==============================================================================
+// A structure loaded from the cache should find the same intersections as
+// the one, which was built; changing the geometry should invalidate the
+// cache.
+TEST(AccelerationStructure, cache) {
+  const uint32_t number_triangles = 20000;
+  const std::string directory = "test_as_cache";
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  std::vector<std::pair<std::shared_ptr<AccelerationStructure>,
+                        std::shared_ptr<AccelerationStructure>>> structures;
+  structures.emplace_back(std::make_shared<CompactGrid>(),
+                          std::make_shared<CompactGrid>());
+  structures.emplace_back(std::make_shared<KDtreeMidpoint>(),
+                          std::make_shared<KDtreeMidpoint>());
+  structures.emplace_back(std::make_shared<KDtreeSAH>(),
+                          std::make_shared<KDtreeSAH>());
+  std::static_pointer_cast<CompactGrid>(structures[0].first)->set_distance_field(true);
+  std::static_pointer_cast<CompactGrid>(structures[0].second)->set_distance_field(true);
+
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+
+  for (auto const &s : structures) {
+    auto built_info  = as_construct_info();
+    auto cached_info = as_construct_info();
+    EXPECT_FALSE(s.first->update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                        number_triangles, built_info));
+    EXPECT_TRUE(s.second->update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                        number_triangles, cached_info));
+    EXPECT_FALSE(built_info.c);
+    EXPECT_TRUE(cached_info.c);
+    EXPECT_EQ(cached_info.nfc, built_info.nfc);
+    EXPECT_EQ(cached_info.nn, built_info.nn);
+
+    for (uint32_t i = 0; i < 200; i++) {
+      Ray ray;
+      ray.set_orig({0.f, 0.f, 0.f, 1.f});
+      ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                           direction(generator),
+                                           direction(generator), 0.f)));
+
+      auto bi = isect_info();
+      auto ci = isect_info();
+      EXPECT_EQ(s.first->traverse(ray, bi), s.second->traverse(ray, ci));
+      EXPECT_EQ(bi.tn, ci.tn);
+      EXPECT_EQ(bi.ti, ci.ti);
+    }
+  }
+
+  // Other build parameters miss the cache.
+  KDtreeMidpoint shallow;
+  shallow.set_max_depth(4);
+  auto info = as_construct_info();
+  EXPECT_FALSE(shallow.update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                     number_triangles, info));
+
+  // So does another geometry; its structure replaces the cached one.
+  mesh->translate(1.f, X);
+  mesh->apply_transformations();
+  CompactGrid moved;
+  moved.set_distance_field(true);
+  info = as_construct_info();
+  EXPECT_FALSE(moved.update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                   number_triangles, info));
+  CompactGrid moved_cached;
+  moved_cached.set_distance_field(true);
+  info = as_construct_info();
+  EXPECT_TRUE(moved_cached.update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                         number_triangles, info));
+  EXPECT_GT(info.nfc, 0);
+
+  // Structures, which can't be cached, are built.
+  BVH bvh;
+  info = as_construct_info();
+  EXPECT_FALSE(bvh.update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                 number_triangles, info));
+  EXPECT_GT(info.nn, 0);
+
+  // The entry keeps a single file per structure type.
+  uint32_t files{0};
+  if (DIR *d = opendir(directory.c_str())) {
+    while (dirent *e = readdir(d)) {
+      if (std::strstr(e->d_name, kASCacheExtension) != nullptr) files++;
+    }
+    closedir(d);
+  }
+  EXPECT_EQ(files, 3);
+
+  std::string command = "rm -rf " + directory;
+  EXPECT_EQ(std::system(command.c_str()), 0);
+}
+
+//==============================================================================
+// Overwrites the section i of a cache file with 0xFF bytes.
+void corrupt_cache_section(const std::string &f, const size_t &i) {
+  std::fstream fs(f, std::ios::in | std::ios::out | std::ios::binary);
+  as_cache_header h;
+  fs.read(reinterpret_cast<char *>(&h), sizeof(h));
+  std::vector<as_cache_section> table(h.ns);
+  fs.read(reinterpret_cast<char *>(table.data()), table.size() * sizeof(as_cache_section));
+  ASSERT_LT(i, table.size());
+
+  std::vector<char> ones(table[i].s, static_cast<char>(0xFF));
+  fs.seekp(static_cast<std::streamoff>(table[i].o));
+  fs.write(ones.data(), ones.size());
+}
+
+//==============================================================================
+// A cache file, whose key still matches, but whose indices are out of range,
+// is rebuilt instead of being traversed.
+TEST(AccelerationStructure, corruptCacheIsRebuilt) {
+  const uint32_t number_triangles = 5000;
+  const std::string directory = "test_as_cache_corrupt";
+  auto mesh = random_triangle_mesh(number_triangles);
+  std::vector<std::shared_ptr<Object>> objs;
+  objs.push_back(mesh);
+
+  // The structures with the sections to corrupt: the nodes and the leaf
+  // primitives of the tree, the cell offsets and object lists of the grid.
+  std::vector<std::pair<std::function<std::shared_ptr<AccelerationStructure>()>,
+                        std::vector<size_t>>> cases;
+  cases.emplace_back([]() { return std::make_shared<KDtreeSAH>(); },
+                     std::vector<size_t>{0, 1});
+  cases.emplace_back([]() { return std::make_shared<CompactGrid>(); },
+                     std::vector<size_t>{1, 2});
+
+  std::mt19937 generator(17);
+  std::uniform_real_distribution<float_t> direction(-1.f, 1.f);
+
+  for (auto const &c : cases) {
+    for (auto const &section : c.second) {
+      // The structure is built, as it would map the file it's loaded from.
+      auto built = c.first();
+      std::ostringstream name;
+      name << directory << "/scene_" << static_cast<uint32_t>(built->get_type())
+           << kASCacheExtension;
+      std::remove(name.str().c_str());
+      auto info = as_construct_info();
+      EXPECT_FALSE(built->update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                        number_triangles, info));
+      corrupt_cache_section(name.str(), section);
+
+      auto rebuilt = c.first();
+      info = as_construct_info();
+      EXPECT_FALSE(rebuilt->update_cached(directory, "scene", mesh->bounding_box(), objs,
+                                          number_triangles, info));
+      EXPECT_FALSE(info.c);
+
+      for (uint32_t i = 0; i < 100; i++) {
+        Ray ray;
+        ray.set_orig({0.f, 0.f, 0.f, 1.f});
+        ray.set_dir(glm::normalize(glm::vec4(direction(generator),
+                                             direction(generator),
+                                             direction(generator), 0.f)));
+        auto bi = isect_info();
+        auto ri = isect_info();
+        EXPECT_EQ(built->traverse(ray, bi), rebuilt->traverse(ray, ri));
+        EXPECT_EQ(bi.tn, ri.tn);
+      }
+    }
+  }
+
+  std::string command = "rm -rf " + directory;
+  EXPECT_EQ(std::system(command.c_str()), 0);
+}
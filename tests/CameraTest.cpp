@@ -6,6 +6,7 @@
 
 #include "../src/cameras/PerspectiveCamera.h"
 #include "../src/cameras/OrthographicCamera.h"
+#include "../src/objects/Sphere.h"
 
 //==============================================================================
 TEST(PerspectiveCamera, getRay) {
@@ -178,3 +179,48 @@ TEST(OrthographicCamera, getRay) {
   EXPECT_NEAR(cr4.orig().z,  0.f, float_err);
   EXPECT_NEAR(cr4.orig().w,  1.f, float_err);
 }
+
+//==============================================================================
+TEST(Camera, worldSpaceRays) {
+  auto sphere = std::make_shared<Sphere>(Sphere());
+  sphere->set_radius(1.f);
+  sphere->set_center({3.f, 1.f, -4.f, 1.f});
+  std::vector<std::shared_ptr<Object>> objects = {sphere};
+  std::vector<std::shared_ptr<Light>> lights;
+
+  PerspectiveCamera perspective(60.f, 40, 30);
+  OrthographicCamera orthographic(4.f, 40, 30);
+  std::vector<Camera *> cameras = {&perspective, &orthographic};
+
+  for (auto camera : cameras) {
+    camera->rotate(-30.f, Y);
+    camera->translate(1.f, X);
+
+    // Intersect the rays in camera space with the transformed sphere.
+    std::vector<float_t> distances;
+    camera->apply_inverse_view_transform(objects, lights);
+    for (uint32_t p = 0; p < 40 * 30; p++) {
+      isect_info ii;
+      sphere->intersect(camera->get_ray(p % 40, p / 40, 0.5f, 0.5f), ii);
+      distances.push_back(ii.tn);
+    }
+    camera->reverse_inverse_view_transform(objects, lights);
+
+    // Rays in world space hit the untouched sphere at the same distances.
+    camera->set_world_space(true);
+    uint32_t hits{0};
+    for (uint32_t p = 0; p < 40 * 30; p++) {
+      Ray r = camera->get_ray(p % 40, p / 40, 0.5f, 0.5f);
+      EXPECT_EQ(r.rt, primary);
+      EXPECT_NEAR(glm::length(r.dir()), 1.f, 1e-5f);
+
+      isect_info ii;
+      sphere->intersect(r, ii);
+      EXPECT_EQ(ii.tn == infinity, distances[p] == infinity);
+      if (ii.tn == infinity) continue;
+      EXPECT_NEAR(ii.tn, distances[p], 1e-3f);
+      hits++;
+    }
+    EXPECT_GT(hits, 0);
+  }
+}
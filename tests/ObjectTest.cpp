@@ -2,10 +2,22 @@
 // Author: Haralambi Todorov <harrytodorov@gmail.com>
 
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
 #include "glm/ext.hpp"    // glm::to_string
 
 #include "../src/objects/Sphere.h"
 #include "../src/objects/Triangle.h"
+#include "../src/objects/TriangleMesh.h"
+#include "../src/objects/ObjParser.h"
+#include "../src/objects/MeshCache.h"
+#include "../src/objects/MeshAssets.h"
+#include "../src/core/Common.h"
+#include "../src/core/TriangleBuffer.h"
 
 //==============================================================================
 TEST(Sphere, basicInitialization) {
@@ -253,4 +265,458 @@ TEST(Triangle, intersectOutside) {
   auto intersected = t.intersect(ray, ii);
 
   EXPECT_TRUE(!intersected);
-}
\ No newline at end of file
+}
+//==============================================================================
+TEST(Sphere, occluded) {
+  Ray ray;
+  ray.set_orig({0.f, 0.f, 0.f, 1.f});
+  ray.set_dir( {1.f, 0.f, 0.f, 0.f});
+
+  Sphere s;
+  s.set_radius(1.f);
+  s.set_center({5.f, 0.f, 0.f, 1.f});
+
+  // The intersection lies at distance 4.
+  EXPECT_TRUE(s.occluded(ray, 10.f));
+  EXPECT_FALSE(s.occluded(ray, 3.f));
+
+  // Sphere behind the ray's origin.
+  ray.set_dir({-1.f, 0.f, 0.f, 0.f});
+  EXPECT_FALSE(s.occluded(ray, 10.f));
+}
+
+//==============================================================================
+TEST(Triangle, occluded) {
+  Ray ray;
+  ray.set_orig({0.f, 0.f,  2.f, 1.f});
+  ray.set_dir( {0.f, 0.f, -1.f, 0.f});
+
+  Triangle t;
+  t.set_vertices({-1.f, -1.f, 0.f, 1.f},
+                 { 1.f, -1.f, 0.f, 1.f},
+                 { 0.f,  1.f, 0.f, 1.f});
+
+  // The intersection lies at distance 2.
+  EXPECT_TRUE(t.occluded(ray, 3.f));
+  EXPECT_FALSE(t.occluded(ray, 1.f));
+
+  // Triangle behind the ray's origin.
+  ray.set_dir({0.f, 0.f, 1.f, 0.f});
+  EXPECT_FALSE(t.occluded(ray, 3.f));
+}
+
+//==============================================================================
+TEST(TriangleBuffer, matchesTriangleIntersect) {
+  const uint32_t number_triangles = 103;
+  std::mt19937 generator(5);
+  std::uniform_real_distribution<float_t> position(-2.f, 2.f);
+
+  std::vector<glm::vec4> vertices;
+  TriangleBuffer tb;
+  tb.resize(number_triangles);
+  for (uint32_t i = 0; i < number_triangles; i++) {
+    for (uint32_t v = 0; v < 3; v++) {
+      vertices.emplace_back(position(generator), position(generator),
+                            position(generator), 1.f);
+    }
+    tb.set(i, vertices[3 * i], vertices[3 * i + 1], vertices[3 * i + 2]);
+  }
+  EXPECT_EQ(tb.size(), number_triangles);
+
+  uint32_t number_hits{0};
+  for (uint32_t i = 0; i < 500; i++) {
+    Ray ray;
+    ray.set_orig({position(generator), position(generator), -5.f, 1.f});
+    ray.set_dir(glm::normalize(glm::vec4(position(generator),
+                                         position(generator),
+                                         4.f, 0.f)));
+
+    // The closest intersection found by intersecting one triangle after
+    // another.
+    float_t closest{infinity}, closest_u{0}, closest_v{0};
+    uint32_t closest_i{0};
+    bool closest_fp{false};
+    for (uint32_t j = 0; j < number_triangles; j++) {
+      float_t t, u, v;
+      bool fp{false};
+      if (triangle_intersect(ray, vertices[3 * j], vertices[3 * j + 1],
+                             vertices[3 * j + 2], t, u, v, fp) && t < closest) {
+        closest = t;
+        closest_u = u;
+        closest_v = v;
+        closest_i = j;
+        closest_fp = fp;
+      }
+    }
+
+    triangle_hit th;
+    bool hit = tb.intersect_range(ray, 0, number_triangles, infinity, th);
+    ASSERT_EQ(hit, closest < infinity);
+    EXPECT_EQ(tb.occluded_range(ray, 0, number_triangles, infinity), hit);
+    if (!hit) continue;
+
+    number_hits++;
+    EXPECT_EQ(th.t, closest);
+    EXPECT_EQ(th.u, closest_u);
+    EXPECT_EQ(th.v, closest_v);
+    EXPECT_EQ(th.i, closest_i);
+    EXPECT_EQ(th.fp, closest_fp);
+
+    // Only intersections before t_max are reported.
+    EXPECT_FALSE(tb.intersect_range(ray, 0, number_triangles, closest, th));
+    EXPECT_FALSE(tb.occluded_range(ray, 0, number_triangles, closest));
+  }
+  EXPECT_GT(number_hits, 0);
+}
+
+//==============================================================================
+TEST(TriangleBuffer, packetMask) {
+  TriangleBuffer tb;
+  tb.resize(2);
+  tb.set(1, glm::vec4(-1.f, -1.f, -3.f, 1.f),
+            glm::vec4( 1.f, -1.f, -3.f, 1.f),
+            glm::vec4( 0.f,  1.f, -3.f, 1.f));
+
+  Ray ray;
+  ray.set_orig({0.f, 0.f, 0.f, 1.f});
+  ray.set_dir( {0.f, 0.f, -1.f, 0.f});
+
+  // Triangle 0 is degenerate and never intersected.
+  triangle_hit th;
+  EXPECT_FALSE(tb.intersect_packet(ray, 0, 1u, infinity, th));
+  EXPECT_FALSE(tb.occluded_packet(ray, 0, 1u, infinity));
+
+  EXPECT_TRUE(tb.intersect_packet(ray, 0, TriangleBuffer::packet_mask(2),
+                                  infinity, th));
+  EXPECT_EQ(th.i, 1);
+  EXPECT_FLOAT_EQ(th.t, 3.f);
+  EXPECT_FALSE(th.fp);
+
+  // A packet could start at any triangle.
+  EXPECT_TRUE(tb.occluded_packet(ray, 1, 1u, infinity));
+  EXPECT_FALSE(tb.occluded_packet(ray, 1, 1u, 2.f));
+}
+
+//==============================================================================
+TEST(ObjParser, parseFloatMatchesStrtof) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> value(-1000., 1000.);
+  std::uniform_int_distribution<int> precision(1, 12);
+
+  std::vector<std::string> numbers = {"0", "-0", "1", "+2.5", "0.000001",
+                                      "1e10", "1.5E-3", "-3.4028235e38",
+                                      "123456789012345678901234", "1e-45",
+                                      "0.1", "0.30000001192092896", "7."};
+  for (uint32_t i = 0; i < 20000; i++) {
+    std::ostringstream ss;
+    ss.precision(precision(gen));
+    if (i % 2) ss << std::scientific;
+    ss << value(gen);
+    numbers.push_back(ss.str());
+  }
+
+  for (auto const &n : numbers) {
+    float_t f{0};
+    const char *e = parse_obj_float(n.data(), n.data() + n.size(), f);
+    EXPECT_EQ(e, n.data() + n.size()) << n;
+    EXPECT_EQ(f, std::strtof(n.c_str(), nullptr)) << n;
+  }
+
+  // Not a number.
+  std::string x("/1");
+  float_t f{0};
+  EXPECT_EQ(parse_obj_float(x.data(), x.data() + x.size(), f), x.data());
+}
+
+//==============================================================================
+TEST(TriangleMesh, loadMesh) {
+  const char *fp = "test_load_mesh.obj";
+  {
+    std::ofstream fs(fp);
+    fs << "# a quad and a triangle\r\n"
+       << "v 0 0 0\r\n"
+       << "v 1.5 0 0\n"
+       << "v\t1.5 2 -1e-1\n"
+       << "v 0 2 0\n"
+       << "vt 0.5 0.5\n"
+       << "vn 0 0 1\n"
+       << "vn 0 1 0\n"
+       << "f 1/1/1 2/1/1 3/1/1 4/1/2\r\n"
+       << "  f -4//-2 -3//-1 -1//-1\n"
+       << "f 1 2 4";
+  }
+
+  TriangleMesh tm;
+  auto li = tm.load_mesh(fp);
+  std::remove(fp);
+
+  ASSERT_TRUE(li.l);
+  EXPECT_EQ(li.nv, 4);
+  EXPECT_EQ(li.nvn, 2);
+  EXPECT_EQ(li.nf, 3);
+  EXPECT_EQ(li.nt, 4);
+  EXPECT_GT(li.nb, 0);
+
+  EXPECT_EQ(tm.va[2], glm::vec4(1.5f, 2.f, -0.1f, 1.f));
+  EXPECT_EQ(tm.vna[1], glm::vec4(0.f, 1.f, 0.f, 0.f));
+  std::vector<uint32_t> via = {1, 2, 3, 1, 3, 4, 1, 2, 4, 1, 2, 4};
+  std::vector<uint32_t> vnia = {1, 1, 1, 1, 1, 2, 1, 2, 2, 0, 0, 0};
+  EXPECT_EQ(tm.via, via);
+  EXPECT_EQ(tm.vnia, vnia);
+  EXPECT_EQ(tm.bounding_box().bounds[0], glm::vec4(0.f, 0.f, -0.1f, 1.f));
+  EXPECT_EQ(tm.bounding_box().bounds[1], glm::vec4(1.5f, 2.f, 0.f, 1.f));
+
+  EXPECT_FALSE(TriangleMesh().load_mesh("does_not_exist.obj").l);
+}
+
+//==============================================================================
+// A file large enough to be split into several chunks is loaded the same
+// way by one and by several threads.
+TEST(TriangleMesh, loadMeshParallel) {
+  const char *fp = "test_load_mesh_parallel.obj";
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<float_t> value(-10.f, 10.f);
+  {
+    std::ofstream fs(fp);
+    fs.precision(7);
+    for (uint32_t i = 0; i < 100000; i++) {
+      fs << "v " << value(gen) << " " << value(gen) << " " << value(gen) << "\n";
+      fs << "vn " << value(gen) << " " << value(gen) << " " << value(gen) << "\n";
+      if (i >= 2) fs << "f -3//-3 -2//-2 " << i + 1 << "//" << i + 1 << "\n";
+    }
+  }
+
+  TriangleMesh single, parallel;
+  auto ls = single.load_mesh(fp, 1);
+  auto lp = parallel.load_mesh(fp, 4);
+  std::remove(fp);
+
+  ASSERT_TRUE(ls.l);
+  ASSERT_TRUE(lp.l);
+  EXPECT_GT(lp.nb, 4 * kMinObjChunkSize);
+  EXPECT_EQ(ls.nt, 99998);
+  EXPECT_EQ(lp.nt, ls.nt);
+  EXPECT_EQ(parallel.va, single.va);
+  EXPECT_EQ(parallel.vna, single.vna);
+  EXPECT_EQ(parallel.via, single.via);
+  EXPECT_EQ(parallel.vnia, single.vnia);
+  EXPECT_EQ(parallel.bounding_box().bounds[0], single.bounding_box().bounds[0]);
+  EXPECT_EQ(parallel.bounding_box().bounds[1], single.bounding_box().bounds[1]);
+  for (uint32_t t = 0; t < parallel.nt; t++) {
+    ASSERT_EQ(parallel.via[3 * t], t + 1);
+    ASSERT_EQ(parallel.vnia[3 * t + 2], t + 3);
+  }
+}
+
+//==============================================================================
+TEST(TriangleMesh, meshCache) {
+  const char *fp = "test_mesh_cache.obj";
+  std::string cf = mesh_cache_path(fp);
+  std::remove(cf.c_str());
+  {
+    std::ofstream fs(fp);
+    fs << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 -1\n"
+       << "vn 0 0 1\nvn 0 1 0\n"
+       << "f 1//1 2//1 3//2 4//2\n";
+  }
+
+  // The first load parses the OBJ file and generates the cache.
+  TriangleMesh parsed;
+  auto lp = parsed.load_cached_mesh(fp);
+  ASSERT_TRUE(lp.l);
+  EXPECT_FALSE(lp.c);
+  EXPECT_FALSE(parsed.va.mapped());
+
+  // The second load maps the cache.
+  TriangleMesh cached;
+  auto lc = cached.load_cached_mesh(fp);
+  ASSERT_TRUE(lc.l);
+  EXPECT_TRUE(lc.c);
+  EXPECT_TRUE(cached.va.mapped());
+  EXPECT_EQ(lc.nt, lp.nt);
+  EXPECT_EQ(lc.nf, lp.nf);
+  EXPECT_EQ(cached.va, parsed.va);
+  EXPECT_EQ(cached.vna, parsed.vna);
+  EXPECT_EQ(cached.via, parsed.via);
+  EXPECT_EQ(cached.vnia, parsed.vnia);
+  EXPECT_EQ(cached.bounding_box().bounds[0], parsed.bounding_box().bounds[0]);
+  EXPECT_EQ(cached.bounding_box().bounds[1], parsed.bounding_box().bounds[1]);
+
+  // Transforming the mapped mesh doesn't change the cache.
+  cached.translate(2.f, X);
+  cached.apply_transformations();
+  EXPECT_TRUE(cached.va.mapped());
+  EXPECT_FLOAT_EQ(cached.va[1].x, 3.f);
+  TriangleMesh again;
+  ASSERT_TRUE(again.load_mesh_cache(cf.c_str()).l);
+  EXPECT_EQ(again.va, parsed.va);
+
+  // Growing a mapped array copies it.
+  again.va.push_back(glm::vec4(5.f, 5.f, 5.f, 1.f));
+  EXPECT_FALSE(again.va.mapped());
+  EXPECT_EQ(again.va.size(), parsed.va.size() + 1);
+  EXPECT_EQ(again.va[3], parsed.va[3]);
+
+  // A changed OBJ file regenerates the cache.
+  {
+    std::ofstream fs(fp, std::ios::app);
+    fs << "v 0 0 2\nf 1//1 2//1 5//1\n";
+  }
+  TriangleMesh changed;
+  auto lch = changed.load_cached_mesh(fp);
+  ASSERT_TRUE(lch.l);
+  EXPECT_FALSE(lch.c);
+  EXPECT_EQ(lch.nt, lp.nt + 1);
+  TriangleMesh recached;
+  auto lr = recached.load_cached_mesh(fp);
+  EXPECT_TRUE(lr.c);
+  EXPECT_EQ(lr.nt, lp.nt + 1);
+
+  std::remove(fp);
+  std::remove(cf.c_str());
+  EXPECT_FALSE(TriangleMesh().load_mesh_cache(fp).l);
+}
+
+//==============================================================================
+// The brute-force intersection of an instanced mesh intersects the shared
+// triangles in the space of the vertices; it has to agree with a mesh, whose
+// vertices were transformed.
+TEST(TriangleMesh, instancedIntersection) {
+  const char *fp = "test_instanced_mesh.obj";
+  std::string cf = mesh_cache_path(fp);
+  std::mt19937 generator(5);
+  std::uniform_real_distribution<float_t> position(-1.f, 1.f);
+  {
+    std::ofstream fs(fp);
+    for (uint32_t v = 0; v < 90; v++) {
+      fs << "v " << position(generator) << " " << position(generator) << " "
+         << position(generator) << "\n";
+    }
+    for (uint32_t v = 0; v < 90; v++) {
+      fs << "vn " << position(generator) << " " << position(generator) << " "
+         << position(generator) << "\n";
+    }
+    for (uint32_t t = 0; t < 30; t++) {
+      fs << "f " << 3 * t + 1 << "//" << 3 * t + 1 << " "
+         << 3 * t + 2 << "//" << 3 * t + 2 << " "
+         << 3 * t + 3 << "//" << 3 * t + 3 << "\n";
+    }
+  }
+
+  // The second placement mirrors the mesh.
+  for (auto const &mirror : {1.f, -1.f}) {
+    TriangleMesh a, b;
+    ASSERT_TRUE(a.load_shared_mesh(fp).l);
+    ASSERT_TRUE(b.load_mesh(fp).l);
+    for (auto m : {&a, &b}) {
+      m->in = true;
+      m->scale(2.f * mirror, X);
+      m->rotate(30.f, Y);
+      m->translate(3.f, Z);
+      m->apply_transformations();
+    }
+    ASSERT_TRUE(a.ins);
+    ASSERT_FALSE(b.ins);
+    EXPECT_EQ(a.tb.size(), 0);
+    EXPECT_EQ(b.tb.size(), b.nt);
+
+    uint32_t hits{0};
+    for (uint32_t i = 0; i < 500; i++) {
+      Ray r;
+      r.set_orig({4.f * position(generator), 4.f * position(generator), 8.f, 1.f});
+      r.set_dir(glm::normalize(glm::vec4(position(generator),
+                                         position(generator),
+                                         3.f, 1.f) - r.orig()));
+
+      isect_info ia, ib;
+      bool ha = a.intersect(r, ia);
+      ASSERT_EQ(ha, b.intersect(r, ib));
+      EXPECT_EQ(a.occluded(r, infinity), b.occluded(r, infinity));
+      if (!ha) continue;
+      hits++;
+      EXPECT_EQ(ia.ti, ib.ti);
+      EXPECT_NEAR(ia.tn, ib.tn, 1e-4f);
+      for (uint32_t c = 0; c < 3; c++) {
+        EXPECT_NEAR(ia.ipn[c], ib.ipn[c], 1e-4f);
+      }
+      EXPECT_EQ(a.occluded(r, ia.tn * 0.99f), b.occluded(r, ib.tn * 0.99f));
+    }
+    EXPECT_GT(hits, 50);
+  }
+
+  std::remove(fp);
+  std::remove(cf.c_str());
+}
+
+//==============================================================================
+TEST(TriangleMesh, sharedMesh) {
+  const char *fp = "test_shared_mesh.obj";
+  std::string cf = mesh_cache_path(fp);
+  {
+    std::ofstream fs(fp);
+    fs << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+       << "vn 0 0 1\n"
+       << "f 1//1 2//1 3//1 4//1\n";
+  }
+
+  size_t assets = MeshAssets::instance().size();
+  {
+    // The file is loaded once; both meshes view the same geometry.
+    TriangleMesh a, b;
+    auto la = a.load_shared_mesh(fp);
+    auto lb = b.load_shared_mesh(fp);
+    ASSERT_TRUE(la.l);
+    ASSERT_TRUE(lb.l);
+    EXPECT_FALSE(la.s);
+    EXPECT_TRUE(lb.s);
+    EXPECT_EQ(lb.nt, 2);
+    EXPECT_EQ(MeshAssets::instance().size(), assets + 1);
+    EXPECT_TRUE(b.via.shared());
+    EXPECT_EQ(static_cast<const Buffer<uint32_t> &>(a.via).data(),
+              static_cast<const Buffer<uint32_t> &>(b.via).data());
+    EXPECT_EQ(static_cast<const Buffer<glm::vec4> &>(a.va).data(),
+              static_cast<const Buffer<glm::vec4> &>(b.va).data());
+
+    // Copies share the geometry as well.
+    TriangleMesh c(b);
+    EXPECT_EQ(static_cast<const Buffer<uint32_t> &>(c.via).data(),
+              static_cast<const Buffer<uint32_t> &>(b.via).data());
+
+    // Transforming one mesh only moves its placement; the vertices stay
+    // shared.
+    b.translate(2.f, X);
+    b.apply_transformations();
+    b.apply_camera_transformation(glm::mat4(1.f));
+    EXPECT_TRUE(b.va.shared());
+    EXPECT_TRUE(b.vna.shared());
+    EXPECT_EQ(static_cast<const Buffer<glm::vec4> &>(a.va).data(),
+              static_cast<const Buffer<glm::vec4> &>(b.va).data());
+    EXPECT_EQ(a.geometry_key(), b.geometry_key());
+
+    glm::vec4 v0, v1, v2;
+    b.triangle_vertices(0, v0, v1, v2);
+    EXPECT_FLOAT_EQ(v1.x, 3.f);
+    a.triangle_vertices(0, v0, v1, v2);
+    EXPECT_FLOAT_EQ(v1.x, 1.f);
+    EXPECT_FLOAT_EQ(b.bounding_box().bounds[0].x, 2.f);
+    EXPECT_FLOAT_EQ(b.bounding_box().bounds[1].x, 3.f);
+
+    isect_info ia, ib;
+    Ray r;
+    r.set_orig({2.5f, 0.5f, 1.f, 1.f});
+    r.set_dir( {0.f, 0.f, -1.f, 0.f});
+    EXPECT_FALSE(a.intersect(r, ia));
+    ASSERT_TRUE(b.intersect(r, ib));
+    EXPECT_FLOAT_EQ(ib.tn, 1.f);
+    EXPECT_FLOAT_EQ(ib.ip.x, 2.5f);
+  }
+
+  // The asset is released with its last mesh.
+  EXPECT_EQ(MeshAssets::instance().size(), assets);
+  TriangleMesh d;
+  EXPECT_FALSE(d.load_shared_mesh(fp).s);
+  EXPECT_FALSE(TriangleMesh().load_shared_mesh("does_not_exist.obj").l);
+
+  std::remove(fp);
+  std::remove(cf.c_str());
+}
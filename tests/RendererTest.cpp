@@ -4,8 +4,11 @@
 #include <gtest/gtest.h>
 #include "glm/ext.hpp"    // glm::to_string
 #include <memory>
+#include <cstddef>
+#include <vector>
 
 #include "../src/core/Renderer.h"
+#include "../src/core/ImagePlane.h"
 #include "../src/lights/DirectionalLight.h"
 #include "../src/lights/PointLight.h"
 #include "../src/objects/Sphere.h"
@@ -119,4 +122,59 @@ TEST(Phong, testEvaluation) {
   EXPECT_NEAR(radiance.r, 0.193f, float_err);
   EXPECT_NEAR(radiance.g, 0.193f, float_err);
   EXPECT_NEAR(radiance.b, 0.193f, float_err);
-}
\ No newline at end of file
+}
+
+//==============================================================================
+TEST(Renderer, mergeRenderStatistics) {
+  render_info w1, w2;
+  w1.npr  = 10;
+  w1.nsr  = 4;
+  w1.nrpt = 100;
+  w1.nroi = 7;
+  w2.npr  = 5;
+  w2.nrr  = 2;
+  w2.nrrr = 1;
+  w2.nrpt = 50;
+
+  render_info merged;
+  merged += w1;
+  merged += w2;
+
+  EXPECT_EQ(merged.npr,  15);
+  EXPECT_EQ(merged.nsr,  4);
+  EXPECT_EQ(merged.nrr,  2);
+  EXPECT_EQ(merged.nrrr, 1);
+  EXPECT_EQ(merged.nrpt, 150);
+  EXPECT_EQ(merged.nroi, 7);
+
+  // The counters of a worker should never share a cache line with the
+  // counters of another worker.
+  EXPECT_GE(offsetof(render_info_block, ri), kCacheLineSize);
+  EXPECT_GE(sizeof(render_info_block) - offsetof(render_info_block, tp),
+            kCacheLineSize);
+}
+
+//==============================================================================
+TEST(ImagePlane, tilesCoverImagePlane) {
+  ImagePlane ip(37, 21);
+  ip.set_tile_size(8);
+
+  auto tiles = ip.generate_tiles();
+  EXPECT_EQ(tiles.size(), 5 * 3);
+
+  // Every pixel should be covered by exactly one tile.
+  std::vector<uint32_t> covered(ip.hres * ip.vres, 0);
+  for (auto const &tile : tiles) {
+    EXPECT_LE(tile.x1 - tile.x0, 8);
+    EXPECT_LE(tile.y1 - tile.y0, 8);
+    for (uint32_t y = tile.y0; y < tile.y1; y++) {
+      for (uint32_t x = tile.x0; x < tile.x1; x++) {
+        covered[y * ip.hres + x]++;
+      }
+    }
+  }
+
+  for (auto const &c : covered) {
+    EXPECT_EQ(c, 1);
+  }
+}
@@ -395,6 +395,27 @@ TEST(SceneParser, checkForAnimationAnimatingMultipleCameras) {
   EXPECT_EQ(result.second.size(), 0);
 }
 
+//==============================================================================
+TEST(SceneParser, accelerationStructureProperties) {
+  std::string filename =
+      "test_resources/testSceneParser_accelerationStructureProperties.txt";
+  auto result = read_scene_from_file(filename);
+  EXPECT_EQ(result.first.first, success);
+  ASSERT_EQ(result.second.size(), 1);
+
+  auto ac = result.second[0].acceleration_structure;
+  EXPECT_STREQ(ac->name.c_str(), "ac1");
+  EXPECT_EQ(ac->type, kdtree_sah);
+  EXPECT_FLOAT_EQ(ac->traversal_cost, 1.5f);
+  EXPECT_FLOAT_EQ(ac->intersection_cost, 20.f);
+  EXPECT_EQ(ac->max_depth, 24);
+  EXPECT_EQ(ac->max_primitives, 3);
+  EXPECT_FLOAT_EQ(ac->refit_threshold, 2.f);
+  EXPECT_TRUE(ac->distance_field);
+  EXPECT_TRUE(ac->exact_insertion);
+  EXPECT_STREQ(ac->cache_directory.c_str(), "as_cache");
+}
+
 //==============================================================================
 TEST(SceneParser, exhaustiveSceneCreation) {
   std::string filename =
@@ -0,0 +1,274 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../src/core/Scene.h"
+#include "../src/accelerators/DynamicGrid.h"
+#include "../src/accelerators/TwoLevel.h"
+#include "../src/objects/MeshCache.h"
+
+namespace {
+// A scene description with a camera and an image plane rendered by the
+// given number of threads, but without objects.
+scene_description empty_scene(const uint32_t &number_threads) {
+  scene_description sd("scene");
+  sd.camera = std::make_shared<camera_description>("c");
+  sd.camera->type = perspective;
+  sd.image_plane = std::make_shared<image_plane_description>("ip");
+  sd.image_plane->horizontal = 4;
+  sd.image_plane->vertical = 4;
+  sd.image_plane->number_threads = number_threads;
+  return sd;
+}
+
+object_description sphere_description(const std::string &name) {
+  object_description od(name);
+  od.type = sphere;
+  od.radius = 1.f;
+  return od;
+}
+
+object_description triangle_description(const std::string &name) {
+  object_description od(name);
+  od.type = triangle;
+  od.vertices = {std::make_shared<vector_description>("v0"),
+                 std::make_shared<vector_description>("v1"),
+                 std::make_shared<vector_description>("v2")};
+  od.vertices[1]->x = 1.f;
+  od.vertices[2]->y = 1.f;
+  return od;
+}
+
+object_description mesh_description(const std::string &name,
+                                    const std::string &file_name) {
+  object_description od(name);
+  od.type = triangle_mesh;
+  od.file_name = file_name;
+  return od;
+}
+
+// Writes a strip of n quads, i.e. 2 * n triangles, into an OBJ file.
+void write_strip(const char *fp, const uint32_t &n) {
+  std::ofstream fs(fp);
+  for (uint32_t i = 0; i <= n; i++) fs << "v " << i << " 0 0\nv " << i << " 1 0\n";
+  fs << "vn 0 0 1\n";
+  for (uint32_t i = 0; i < n; i++) {
+    fs << "f " << 2 * i + 1 << "//1 " << 2 * i + 3 << "//1 "
+       << 2 * i + 4 << "//1 " << 2 * i + 2 << "//1\n";
+  }
+}
+}
+
+//==============================================================================
+TEST(Scene, objectsInDeclarationOrder) {
+  const char *small = "test_scene_small.obj";
+  const char *large = "test_scene_large.obj";
+  write_strip(small, 1);
+  write_strip(large, 20000);
+
+  // The large mesh is declared first, so it finishes loading last.
+  std::vector<std::pair<std::string, ObjectType>> expected = {
+      {"large", triangle_mesh},
+      {"s1",    sphere},
+      {"t1",    triangle},
+      {"small", triangle_mesh},
+      {"s2",    sphere},
+      {"t2",    triangle}
+  };
+
+  for (uint32_t number_threads : {1u, 4u}) {
+    auto sd = empty_scene(number_threads);
+    sd.objects.push_back(mesh_description("large", large));
+    sd.objects.push_back(sphere_description("s1"));
+    sd.objects.push_back(triangle_description("t1"));
+    sd.objects.push_back(mesh_description("small", small));
+    sd.objects.push_back(sphere_description("s2"));
+    sd.objects.push_back(triangle_description("t2"));
+
+    Scene scene;
+    ASSERT_TRUE(scene.load_scene(sd));
+
+    auto const &objects = scene.get_objects();
+    auto const &animated = scene.get_animated_objects();
+    ASSERT_EQ(objects.size(), expected.size());
+    ASSERT_EQ(animated.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+      EXPECT_EQ(objects[i]->object_type(), expected[i].second);
+      EXPECT_EQ(animated.at(expected[i].first), i);
+    }
+    EXPECT_EQ(std::static_pointer_cast<TriangleMesh>(objects[0])->nt, 40000);
+    EXPECT_EQ(std::static_pointer_cast<TriangleMesh>(objects[3])->nt, 2);
+  }
+
+  for (auto const &fp : {small, large}) {
+    std::remove(fp);
+    std::remove(mesh_cache_path(fp).c_str());
+  }
+}
+
+//==============================================================================
+TEST(Scene, placementsShareVertices) {
+  const char *fp = "test_scene_placements.obj";
+  write_strip(fp, 4);
+  const uint32_t n = 8;
+
+  auto sd = empty_scene(1);
+  for (uint32_t i = 0; i < n; i++) {
+    auto od = mesh_description("m" + std::to_string(i), fp);
+    transformation_description t;
+    t.type = translation;
+    t.axis = Y;
+    t.amount = 2.f * i;
+    od.transformations.push_back(t);
+    if (i % 2 == 1) {
+      t.type = rotation;
+      t.axis = X;
+      t.amount = 90.f;
+      od.transformations.push_back(t);
+    }
+    sd.objects.push_back(od);
+  }
+
+  Scene scene;
+  ASSERT_TRUE(scene.load_scene(sd));
+  auto const &objects = scene.get_objects();
+  ASSERT_EQ(objects.size(), n);
+
+  // Every placement views the vertices of the one loaded file.
+  auto first = std::static_pointer_cast<TriangleMesh>(objects[0]);
+  for (auto const &o : objects) {
+    auto mesh = std::static_pointer_cast<TriangleMesh>(o);
+    EXPECT_TRUE(mesh->va.shared());
+    EXPECT_TRUE(mesh->vna.shared());
+    EXPECT_EQ(static_cast<const Buffer<glm::vec4> &>(mesh->va).data(),
+              static_cast<const Buffer<glm::vec4> &>(first->va).data());
+    EXPECT_EQ(static_cast<const Buffer<uint32_t> &>(mesh->via).data(),
+              static_cast<const Buffer<uint32_t> &>(first->via).data());
+    EXPECT_EQ(mesh->geometry_key(), first->geometry_key());
+  }
+
+  // The placements share one bottom-level hierarchy and are intersected
+  // where they're placed.
+  AABBox box;
+  for (auto const &o : objects) {
+    box.extend_by(o->bounding_box().bounds[0]);
+    box.extend_by(o->bounding_box().bounds[1]);
+  }
+  TwoLevel tl;
+  as_construct_info info;
+  tl.construct(box, objects, n * 8, info);
+  EXPECT_EQ(info.nb, 1);
+  EXPECT_EQ(info.ni, n);
+
+  for (uint32_t i = 0; i < n; i += 2) {
+    Ray r;
+    r.set_orig({1.5f, 2.f * i + 0.5f, 1.f, 1.f});
+    r.set_dir( {0.f, 0.f, -1.f, 0.f});
+    hit_record hr;
+    traversal_info ti;
+    ASSERT_TRUE(tl.closest_hit(r, hr, ti));
+    EXPECT_FLOAT_EQ(hr.t, 1.f);
+    EXPECT_EQ(static_cast<uint32_t>(hr.p.oi), i);
+  }
+
+  std::remove(fp);
+  std::remove(mesh_cache_path(fp).c_str());
+}
+
+//==============================================================================
+TEST(Scene, parallelRenderMatchesSerial) {
+  const char *fp = "test_scene_render.obj";
+  write_strip(fp, 3);
+
+  std::vector<std::vector<glm::vec3>> images;
+  std::vector<glm::vec2> samples;
+  for (uint32_t number_threads : {1u, 4u}) {
+    auto sd = empty_scene(number_threads);
+    sd.image_plane->horizontal = 40;
+    sd.image_plane->vertical = 30;
+    sd.image_plane->tile_size = 8;
+
+    auto s = sphere_description("s");
+    s.center = std::make_shared<vector_description>("c");
+    s.center->z = -5.f;
+    sd.objects.push_back(s);
+    auto t = triangle_description("t");
+    for (auto const &v : t.vertices) v->z = -4.f;
+    sd.objects.push_back(t);
+    auto m = mesh_description("m", fp);
+    transformation_description tr;
+    tr.type = translation;
+    tr.axis = Z;
+    tr.amount = -6.f;
+    m.transformations.push_back(tr);
+    sd.objects.push_back(m);
+
+    light_description l("l");
+    l.type = point;
+    l.intensity = 100.f;
+    l.property = {position, std::make_shared<vector_description>("p")};
+    l.property.second->y = 3.f;
+    sd.lights.push_back(l);
+
+    sd.acceleration_structure = std::make_shared<acceleration_structure_description>("as");
+    sd.acceleration_structure->type = bvh;
+
+    Scene scene;
+    ASSERT_TRUE(scene.load_scene(sd));
+
+    // The unit samples are random; both renders use the first one's.
+    if (samples.empty()) samples = scene.get_image_plane()->us;
+    scene.get_image_plane()->us = samples;
+    scene.render_image("test_scene_render");
+    images.push_back(scene.get_image_plane()->fb);
+  }
+
+  // The image isn't just background, and the threads don't change a pixel.
+  ASSERT_EQ(images[0].size(), images[1].size());
+  EXPECT_NE(std::count(images[0].begin(), images[0].end(), images[0][0]),
+            static_cast<std::ptrdiff_t>(images[0].size()));
+  for (size_t i = 0; i < images[0].size(); i++) {
+    EXPECT_EQ(images[0][i], images[1][i]) << "pixel " << i;
+  }
+
+  std::remove("test_scene_render.png");
+  std::remove(fp);
+  std::remove(mesh_cache_path(fp).c_str());
+}
+
+//==============================================================================
+TEST(Scene, setAsUsesScenePool) {
+  const char *fp = "test_scene_set_as.obj";
+  write_strip(fp, 16);
+
+  auto sd = empty_scene(4);
+  auto m = mesh_description("m", fp);
+  transformation_description tr;
+  tr.type = translation;
+  tr.axis = Z;
+  tr.amount = -3.f;
+  m.transformations.push_back(tr);
+  sd.objects.push_back(m);
+
+  Scene scene;
+  ASSERT_TRUE(scene.load_scene(sd));
+
+  // A structure set from outside is traversed by all the scene's workers,
+  // which need a mailbox each.
+  auto grid = std::make_shared<DynamicGrid>();
+  scene.set_as(grid);
+  ASSERT_NE(grid->get_thread_pool(), nullptr);
+  EXPECT_EQ(grid->get_thread_pool()->size(), 4);
+  scene.render_image("test_scene_set_as");
+
+  std::remove("test_scene_set_as.png");
+  std::remove(fp);
+  std::remove(mesh_cache_path(fp).c_str());
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2018, University of Freiburg.
+// Author: Haralambi Todorov <harrytodorov@gmail.com>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "../src/core/ThreadPool.h"
+
+//==============================================================================
+TEST(ThreadPool, executeAllTasks) {
+  const uint32_t number_tasks = 1000;
+  std::vector<std::atomic<uint32_t>> executed(number_tasks);
+  for (auto &e : executed) e = 0;
+
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.size(), 4);
+
+  for (uint32_t i = 0; i < number_tasks; i++) {
+    pool.submit([i, &executed, &pool](const uint32_t &worker) {
+      EXPECT_LT(worker, pool.size());
+      executed[i]++;
+    });
+  }
+  pool.wait();
+
+  for (auto const &e : executed) {
+    EXPECT_EQ(e, 1);
+  }
+}
+
+//==============================================================================
+TEST(ThreadPool, executeTasksSubmittedFromTasks) {
+  std::atomic<uint32_t> executed(0);
+
+  ThreadPool pool(3);
+
+  for (uint32_t i = 0; i < 10; i++) {
+    pool.submit([&pool, &executed](const uint32_t &worker) {
+      EXPECT_LT(worker, pool.size());
+      for (uint32_t j = 0; j < 10; j++) {
+        pool.submit([&executed](const uint32_t &) { executed++; });
+      }
+      executed++;
+    });
+  }
+  pool.wait();
+
+  EXPECT_EQ(executed, 110);
+}